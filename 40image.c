@@ -1,36 +1,188 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <inttypes.h>
+#include <unistd.h>
 #include "assert.h"
 #include "compress40.h"
+#include "codec40.h"
+#include "mapfile.h"
 #include "a2methods.h"
+#include "a2morton.h"
+#include "batch40.h"
+#include "pipeline40.h"
+
+static Rgbtable40_stats table_stats;
+static Pipeline40_stats pipeline_stats;
+static struct Codec40_opts opts = { .fused = false, .threads = 1,
+                                     .streaming = false, .pipelined = false,
+                                     .pipeline_stats = &pipeline_stats,
+                                     .methods = NULL,
+                                     .fixed_point = false, .rgb_table = false,
+                                     .table_stats = &table_stats };
+
+static void compress(FILE *input)
+{
+        compress40_opts(input, &opts);
+}
+
+static void decompress(FILE *input)
+{
+        decompress40_opts(input, &opts);
+}
 
-static void (*compress_or_decompress)(FILE *input) = compress40;
+static bool compress_inplace(const unsigned char *data, size_t size)
+{
+        return compress40_inplace(data, size, &opts);
+}
+
+static bool decompress_inplace(const unsigned char *data, size_t size)
+{
+        return decompress40_inplace(data, size, &opts);
+}
+
+/* With -t, reports on stderr how the decoders' tables were used, summed
+   over every table built (one per decoding thread per image) */
+static void report_table_stats(void)
+{
+        if (table_stats.entries == 0) {
+                return;
+        }
+        double pixels = table_stats.hits + table_stats.misses +
+                        table_stats.fallbacks;
+        pixels = pixels == 0 ? 1 : pixels;
+        fprintf(stderr, "rgb table: %" PRIu64 " table%s of %zu entries "
+                "(%zu KB each), %" PRIu64 " filled in all; pixels %.3f%% "
+                "hits, %.3f%% misses, %.3f%% fallbacks\n",
+                table_stats.tables, table_stats.tables == 1 ? "" : "s",
+                table_stats.entries,
+                table_stats.bytes / 1024, table_stats.filled,
+                100 * table_stats.hits / pixels,
+                100 * table_stats.misses / pixels,
+                100 * table_stats.fallbacks / pixels);
+}
+
+/* With -p, reports on stderr how busy each stage of the pipeline was */
+static void report_pipeline_stats(void)
+{
+        Pipeline40_report(&pipeline_stats, stderr);
+}
+
+static void (*compress_or_decompress)(FILE *input) = compress;
+static bool (*inplace)(const unsigned char *data, size_t size) =
+        compress_inplace;
+
+/*
+ * With -b, codes every file named after the options, or listed one per line
+ * on stdin if none are, on a worker per thread (-j, or one per online
+ * CPU), writing each output next to its input or into outdir
+ */
+static bool run_batch(int argc, char *argv[], int i, const char *outdir,
+                      unsigned workers)
+{
+        bool compressing = compress_or_decompress == compress;
+        bool ok;
+        if (workers == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                workers = cpus > 0 ? cpus : 1;
+        }
+        if (i < argc) {
+                ok = Batch40_run(&argv[i], argc - i, compressing, outdir,
+                                 workers, &opts);
+        } else {
+                size_t count;
+                char **paths = Batch40_read_manifest(stdin, &count);
+                ok = Batch40_run(paths, count, compressing, outdir,
+                                 workers, &opts);
+                Batch40_free_manifest(paths, count);
+        }
+        return ok;
+}
 
 int main(int argc, char *argv[])
 {
         int i;
+        bool batch = false;
+        const char *outdir = NULL;
+        unsigned workers = 0;
         
         for (i = 1; i < argc; i++) {
                 if (strcmp(argv[i], "-c") == 0) {
-                        compress_or_decompress = compress40;
+                        compress_or_decompress = compress;
+                        inplace = compress_inplace;
+                } else if (strcmp(argv[i], "-f") == 0) {
+                        opts.fused = true;
+                } else if (strcmp(argv[i], "-m") == 0) {
+                        opts.methods = uarray2_methods_morton;
+                } else if (strcmp(argv[i], "-i") == 0) {
+                        opts.fixed_point = true;
+                } else if (strcmp(argv[i], "-t") == 0) {
+                        opts.rgb_table = true;
+                } else if (strcmp(argv[i], "-s") == 0) {
+                        opts.streaming = true;
+                } else if (strcmp(argv[i], "-p") == 0) {
+                        opts.pipelined = true;
+                } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                        int threads = atoi(argv[++i]);
+                        if (threads < 1) {
+                                fprintf(stderr, "%s: -j needs a positive "
+                                        "number of threads\n", argv[0]);
+                                exit(1);
+                        }
+                        opts.threads = workers = threads;
+                } else if (strcmp(argv[i], "-b") == 0) {
+                        batch = true;
+                } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                        outdir = argv[++i];
                 } else if (strcmp(argv[i], "-d") == 0) {
-                        compress_or_decompress = decompress40;
+                        compress_or_decompress = decompress;
+                        inplace = decompress_inplace;
                 } else if (*argv[i] == '-') {
                         fprintf(stderr, "%s: unknown option '%s'\n",
                                 argv[0], argv[i]);
                         exit(1);
+                } else if (batch) {
+                        break;
                 } else if (argc - i > 2) {
-                        fprintf(stderr, "Usage: %s -d [filename]\n"
-                                "       %s -c [filename]\n",
-                                argv[0], argv[0]);
+                        fprintf(stderr, "Usage: %s -d [-f] [-m] [-i] [-t] "
+                                "[-s] [-p] [-j threads] [filename]\n"
+                                "       %s -c [-f] [-m] [-i] [-s] [-p] "
+                                "[-j threads] [filename]\n"
+                                "       %s -c|-d -b [options] [-o outdir] "
+                                "[filename...]\n"
+                                "-t decodes through a table of about 8.6 MB "
+                                "per thread (-j) or batch worker,\n"
+                                "filled anew for each image\n",
+                                argv[0], argv[0], argv[0]);
                         exit(1);
                 } else {
                         break;
                 }
         }
+        if (batch) {
+                bool ok = run_batch(argc, argv, i, outdir, workers);
+                report_table_stats();
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         assert(argc - i <= 1);    /* at most one file on command line */
         if (i < argc) {
+                /* decode regular files in place from a mapping; anything
+                   that cannot be mapped or decoded that way goes through
+                   stdio, as pipes do, and so does everything with -p,
+                   whose reader thread is what overlaps the input */
+                Mapfile_T map = opts.pipelined ? NULL
+                                               : Mapfile_open(argv[i]);
+                if (map != NULL) {
+                        bool done = inplace(Mapfile_data(map),
+                                            Mapfile_size(map));
+                        Mapfile_close(&map);
+                        if (done) {
+                                report_table_stats();
+                                return EXIT_SUCCESS;
+                        }
+                }
                 FILE *fp = fopen(argv[i], "r");
                 assert(fp != NULL);
                 compress_or_decompress(fp);
@@ -38,6 +190,8 @@ int main(int argc, char *argv[])
         } else {
                 compress_or_decompress(stdin);
         }
+        report_table_stats();
+        report_pipeline_stats();
 
 
 
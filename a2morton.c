@@ -0,0 +1,118 @@
+#include <stdlib.h>
+
+#include "a2morton.h"
+#include "uarray2m.h"
+
+// define a private version of each function in A2Methods_T that we implement
+
+typedef A2Methods_UArray2 A2;    // private abbreviation
+
+static A2 new(int width, int height, int size)
+{
+    return UArray2m_new(width, height, size, DEFAULT_MORTON_TILE);
+}
+
+static A2 new_with_blocksize(int width, int height, int size, int blocksize)
+{
+    return UArray2m_new(width, height, size, blocksize);
+}
+
+static void a2free(A2 * array2p)
+{
+    UArray2m_free((UArray2m_T *) array2p);
+}
+
+static int width(A2 array2)
+{
+    return UArray2m_width(array2);
+}
+static int height(A2 array2)
+{
+    return UArray2m_height(array2);
+}
+static int size(A2 array2)
+{
+    return UArray2m_size(array2);
+}
+static int blocksize(A2 array2)
+{
+    return UArray2m_tilesize(array2);
+}
+
+static A2Methods_Object *at(A2 array2, int i, int j)
+{
+    return UArray2m_at(array2, i, j);
+}
+
+static void map_row_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+    UArray2m_map_row_major(array2, (UArray2m_applyfun *) apply, cl);
+}
+
+static void map_col_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+    UArray2m_map_col_major(array2, (UArray2m_applyfun *) apply, cl);
+}
+
+static void map_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+    UArray2m_map_morton(array2, (UArray2m_applyfun *) apply, cl);
+}
+
+struct small_closure {
+    A2Methods_smallapplyfun *apply;
+    void *cl;
+};
+
+static void apply_small(int i, int j, UArray2m_T array2, void *elem, void *vcl)
+{
+    struct small_closure *cl = vcl;
+    (void)i;
+    (void)j;
+    (void)array2;
+    cl->apply(elem, cl->cl);
+}
+
+static void small_map_row_major(A2 a2, A2Methods_smallapplyfun apply,
+                                void *cl)
+{
+    struct small_closure mycl = { apply, cl };
+    UArray2m_map_row_major(a2, apply_small, &mycl);
+}
+
+static void small_map_col_major(A2 a2, A2Methods_smallapplyfun apply,
+                                void *cl)
+{
+    struct small_closure mycl = { apply, cl };
+    UArray2m_map_col_major(a2, apply_small, &mycl);
+}
+
+static void small_map_block_major(A2 a2, A2Methods_smallapplyfun apply,
+                                  void *cl)
+{
+    struct small_closure mycl = { apply, cl };
+    UArray2m_map_morton(a2, apply_small, &mycl);
+}
+
+static struct A2Methods_T uarray2_methods_morton_struct = {
+    new,
+    new_with_blocksize,
+    a2free,
+    width,
+    height,
+    size,
+    blocksize,
+    at,
+    map_row_major,
+    map_col_major,
+    map_block_major,
+    map_block_major,    // map_default
+    small_map_row_major,
+    small_map_col_major,
+    small_map_block_major,
+    small_map_block_major,    // small_map_default
+};
+
+// finally the payoff: here is the exported pointer to the struct
+
+A2Methods_T uarray2_methods_morton = &uarray2_methods_morton_struct;
@@ -0,0 +1,28 @@
+/******************************************************************************
+ *
+ *                                a2morton.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     A2Methods suite backed by UArray2m_T, which stores cells in Morton
+ *     (Z) order within power-of-two tiles (see uarray2m.h). new makes tiles
+ *     of DEFAULT_MORTON_TILE cells across; new_with_blocksize rounds the
+ *     blocksize up to a power of two and uses it as the tile edge.
+ *     map_block_major and map_default visit cells in storage order, which
+ *     covers every aligned 2x2 group in the same order as
+ *     uarray2_methods_blocked does with a blocksize of 2.
+ *
+ *****************************************************************************/
+
+#include "a2methods.h"
+
+#ifndef A2MORTON_H
+#define A2MORTON_H
+
+#define DEFAULT_MORTON_TILE 64
+
+extern A2Methods_T uarray2_methods_morton;
+
+#endif
@@ -0,0 +1,565 @@
+/******************************************************************************
+ *
+ *                                 batch40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the batch40.h interface. Every worker thread owns a deque
+ *     of files. The files are sorted by size, largest first, and dealt out
+ *     round-robin, so each deque starts with about the same amount of work
+ *     and its largest files at the front. A worker takes files from the
+ *     front of its own deque; once that is empty it steals from the back of
+ *     the others', so a worker left with a huge file sheds its small ones
+ *     to idle workers rather than keeping every other core waiting. Each
+ *     deque has its own mutex, taken once per file, which is nothing next
+ *     to the cost of coding a file.
+ *
+ *     Files are coded single-threaded, as the workers already keep the
+ *     cores busy, from a mapping (or a copy read into memory if the file
+ *     cannot be mapped): in place when the options choose the fused
+ *     kernels, and otherwise through the stdio path, reading the memory
+ *     with fmemopen. Every file is checked before any of it is coded, a
+ *     compressed one with Buffer40_parse and Bitpack40_valid_row and a
+ *     PPM, binary or plain, with Ppmreader_valid, which accepts exactly
+ *     what the stdio path reads without raising. So an invalid file is
+ *     reported and skipped rather than ending the process, and the other
+ *     files are still coded. Each output
+ *     is written to a temporary file beside it and renamed into place once
+ *     complete, so a partial output never appears under the final name; a
+ *     failed file leaves no output.
+ *
+ *     Each worker allocates the codec's buffers for a file from its own
+ *     region (region40.h), reset once the file is done, so after its first
+ *     few files a worker codes without calling malloc, and workers never
+ *     contend for the heap.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "batch40.h"
+#include "bitpack40.h"
+#include "buffer40.h"
+#include "mapfile.h"
+#include "ppmreader.h"
+#include "region40.h"
+
+/* Suffix of the temporary file an output is written to */
+#define TEMP_SUFFIX ".tmp"
+
+/* Suffix given to decompressed files whose input lacks BATCH40_SUFFIX */
+#define PPM_SUFFIX ".ppm"
+
+/* One input file and what became of it */
+struct Job {
+    const char *input;
+    char *output;
+    size_t in_bytes, out_bytes;
+    double seconds;
+    unsigned worker; /* the worker that coded it */
+    bool ok;
+};
+
+/* A worker's files, jobs[head] to jobs[tail - 1], largest first */
+struct Deque {
+    pthread_mutex_t lock;
+    struct Job **jobs;
+    size_t head, tail;
+};
+
+struct Batch;
+
+struct Worker {
+    struct Batch *batch;
+    unsigned id;
+    pthread_t thread;
+    uint64_t steals;        /* files taken from other workers' deques */
+    Rgbtable40_stats stats; /* of the tables of the files it decoded */
+};
+
+struct Batch {
+    bool compress;
+    struct Codec40_opts opts;
+    unsigned nworkers;
+    struct Deque *deques;
+    struct Worker *workers;
+};
+
+/* Static function declarations */
+static double now(void);
+static int compare_sizes(const void *x, const void *y);
+static char *output_path(const char *input, const char *outdir,
+                         bool compress);
+static struct Job *take_job(struct Worker *worker);
+static unsigned char *read_file(const char *path, size_t *size);
+static const char *code_file(const unsigned char *data, size_t size,
+                             bool compress, Codec40_opts opts);
+static void run_job(struct Worker *worker, struct Job *job);
+static void *work(void *vworker);
+static void report(struct Job *jobs, size_t count, struct Batch *batch,
+                   double seconds);
+
+/*
+ *  Function:  now
+ *  Arguments: none
+ *  Does:      Reads the monotonic clock.
+ *  Return:    double - the time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Orders pointers to jobs by decreasing input size */
+static int compare_sizes(const void *x, const void *y)
+{
+    size_t sx = (*(struct Job *const *)x)->in_bytes;
+    size_t sy = (*(struct Job *const *)y)->in_bytes;
+    return (sx < sy) - (sx > sy);
+}
+
+/*
+ *  Function:  output_path
+ *  Arguments: const char *input - an input file
+ *             const char *outdir - the output directory, or NULL to write
+ *                                  next to the input
+ *             bool compress - whether the input is being compressed
+ *  Does:      Names an input's output as described in batch40.h.
+ *  Return:    char * - the path, allocated with ALLOC
+ */
+static char *output_path(const char *input, const char *outdir,
+                         bool compress)
+{
+    const char *name = input;
+    if (outdir != NULL) {
+        const char *slash = strrchr(input, '/');
+        name = slash != NULL ? slash + 1 : input;
+    }
+    size_t length = strlen(name);
+    size_t suffix_length = strlen(BATCH40_SUFFIX);
+    const char *suffix = compress ? BATCH40_SUFFIX : PPM_SUFFIX;
+    if (!compress && length > suffix_length &&
+        strcmp(&name[length - suffix_length], BATCH40_SUFFIX) == 0) {
+        length -= suffix_length;
+        suffix = "";
+    }
+
+    size_t size = (outdir != NULL ? strlen(outdir) + 1 : 0) + length +
+                  strlen(suffix) + 1;
+    char *path = ALLOC(size);
+    snprintf(path, size, "%s%s%.*s%s", outdir != NULL ? outdir : "",
+             outdir != NULL ? "/" : "", (int)length, name, suffix);
+    return path;
+}
+
+/*
+ *  Function:  take_job
+ *  Arguments: struct Worker *worker - the worker looking for a file
+ *  Does:      Takes the file at the front of the worker's deque or, if that
+ *             is empty, steals the one at the back of the next worker's
+ *             deque that is not.
+ *  Return:    struct Job * - the file, or NULL once every deque is empty
+ */
+static struct Job *take_job(struct Worker *worker)
+{
+    struct Batch *batch = worker->batch;
+    struct Job *job = NULL;
+    struct Deque *own = &batch->deques[worker->id];
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        job = own->jobs[own->head++];
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (unsigned i = 1; job == NULL && i < batch->nworkers; i++) {
+        struct Deque *victim =
+            &batch->deques[(worker->id + i) % batch->nworkers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            job = victim->jobs[--victim->tail];
+            worker->steals++;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return job;
+}
+
+/*
+ *  Function:  read_file
+ *  Arguments: const char *path - the file to read
+ *             size_t *size - set to the number of bytes read
+ *  Does:      Reads a whole file into memory, for files that cannot be
+ *             mapped (such as empty ones).
+ *  Return:    unsigned char * - the bytes, to be freed with FREE, or NULL
+ *             if the file cannot be read
+ */
+static unsigned char *read_file(const char *path, size_t *size)
+{
+    FILE *input = fopen(path, "rb");
+    if (input == NULL) {
+        return NULL;
+    }
+    size_t capacity = 64 * 1024;
+    unsigned char *data = ALLOC(capacity);
+    *size = 0;
+    size_t got;
+    while ((got = fread(&data[*size], 1, capacity - *size, input)) > 0) {
+        *size += got;
+        if (*size == capacity) {
+            capacity *= 2;
+            RESIZE(data, capacity);
+        }
+    }
+    bool failed = ferror(input);
+    fclose(input);
+    if (failed) {
+        FREE(data);
+    }
+    return data;
+}
+
+/*
+ *  Function:  code_file
+ *  Arguments: const unsigned char *data - the whole input file
+ *             size_t size - the number of bytes in data
+ *             bool compress - whether to compress rather than decompress
+ *             Codec40_opts opts - the worker's codec options
+ *  Does:      Checks the input and, if it is valid, codes it to
+ *             opts->output. Nothing is written for an invalid input.
+ *  Return:    const char * - NULL once the file is coded, or a static
+ *             description of what is wrong with it
+ */
+static const char *code_file(const unsigned char *data, size_t size,
+                             bool compress, Codec40_opts opts)
+{
+    /* the codec ends the process on a corrupt word, so the words of a
+       compressed file are checked before any of them is decoded */
+    unsigned width, height;
+    const unsigned char *first;
+    if (!compress) {
+        Buffer40_status status = Buffer40_parse(data, size, &width,
+                                                &height, &first);
+        if (status != BUFFER40_OK) {
+            return Buffer40_message(status);
+        }
+        if (!Bitpack40_valid_row(first, (size_t)width * height, true)) {
+            return Buffer40_message(BUFFER40_BAD_FORMAT);
+        }
+    }
+    if (compress ? compress40_inplace(data, size, opts)
+                 : decompress40_inplace(data, size, opts)) {
+        return NULL;
+    }
+    /* the rest go through the stdio path: compressed files the options
+       decode through a pixmap, and valid PPMs that are too small to
+       compress in place, plain, or to be compressed through a pixmap */
+    if (compress && !Ppmreader_valid(data, size)) {
+        return "invalid PPM file";
+    }
+    FILE *input = fmemopen((void *)data, size, "rb");
+    if (input == NULL) {
+        return "cannot read";
+    }
+    (compress ? compress40_opts : decompress40_opts)(input, opts);
+    fclose(input);
+    return NULL;
+}
+
+/*
+ *  Function:  run_job
+ *  Arguments: struct Worker *worker - the worker coding the file
+ *             struct Job *job - the file
+ *  Does:      Compresses or decompresses one file into a temporary file,
+ *             renames that to the output path and fills in the rest of
+ *             job. An invalid input, and failures to read, write or
+ *             rename, are reported on stderr and leave no output.
+ *  Return:    void
+ */
+static void run_job(struct Worker *worker, struct Job *job)
+{
+    struct Batch *batch = worker->batch;
+    double start = now();
+    job->worker = worker->id;
+    job->ok = false;
+
+    size_t size = strlen(job->output) + strlen(TEMP_SUFFIX) + 1;
+    char *temp = ALLOC(size);
+    snprintf(temp, size, "%s%s", job->output, TEMP_SUFFIX);
+    FILE *output = fopen(temp, "wb");
+    if (output == NULL) {
+        fprintf(stderr, "batch: cannot write %s\n", temp);
+        FREE(temp);
+        return;
+    }
+
+    struct Codec40_opts opts = batch->opts;
+    opts.threads = 1;
+    opts.pipelined = false; /* the workers already overlap one file's I/O
+                               with another's coding */
+    opts.table_stats = &worker->stats;
+    opts.output = output;
+    opts.region = Region40_thread();
+
+    /* the whole input in memory, mapped if possible */
+    const char *problem = "cannot read";
+    Mapfile_T map = Mapfile_open(job->input);
+    if (map != NULL) {
+        problem = code_file(Mapfile_data(map), Mapfile_size(map),
+                            batch->compress, &opts);
+        Mapfile_close(&map);
+    } else {
+        size_t bytes;
+        unsigned char *data = read_file(job->input, &bytes);
+        if (data != NULL) {
+            problem = code_file(data, bytes, batch->compress, &opts);
+            FREE(data);
+        }
+    }
+
+    long written = ftell(output);
+    bool wrote = !ferror(output);
+    wrote = fclose(output) == 0 && wrote;
+    if (problem != NULL) {
+        fprintf(stderr, "batch: %s: %s\n", job->input, problem);
+    } else if (!wrote) {
+        fprintf(stderr, "batch: error writing %s\n", temp);
+    } else if (rename(temp, job->output) != 0) {
+        fprintf(stderr, "batch: cannot rename %s to %s\n", temp,
+                job->output);
+    } else {
+        job->ok = true;
+        job->out_bytes = written < 0 ? 0 : written;
+    }
+    if (!job->ok) {
+        remove(temp);
+    }
+    Region40_reset(opts.region);
+    FREE(temp);
+    job->seconds = now() - start;
+}
+
+/*
+ *  Function:  work
+ *  Arguments: void *vworker - the struct Worker of this thread
+ *  Does:      Body of each worker thread: codes files until there are none
+ *             left to take or steal.
+ *  Return:    void * - always NULL
+ */
+static void *work(void *vworker)
+{
+    struct Worker *worker = vworker;
+    struct Job *job;
+    while ((job = take_job(worker)) != NULL) {
+        run_job(worker, job);
+    }
+    return NULL;
+}
+
+/*
+ *  Function:  report
+ *  Arguments: struct Job *jobs - every file, in the order given
+ *             size_t count - the number of files
+ *             struct Batch *batch - the finished batch
+ *             double seconds - wall-clock time of the whole batch
+ *  Does:      Writes the size, time and throughput of every file, then the
+ *             totals, to stderr. Throughput is counted in bytes of PPM: the
+ *             input when compressing and the output when decompressing.
+ *  Return:    void
+ */
+static void report(struct Job *jobs, size_t count, struct Batch *batch,
+                   double seconds)
+{
+    size_t failed = 0;
+    double ppm_bytes = 0, busy = 0;
+    uint64_t steals = 0;
+    fprintf(stderr, "%12s %12s %10s %10s %6s  %s\n", "in bytes",
+            "out bytes", "ms", "MB/s", "worker", "file");
+    for (size_t i = 0; i < count; i++) {
+        struct Job *job = &jobs[i];
+        busy += job->seconds;
+        if (!job->ok) {
+            failed++;
+            fprintf(stderr, "%12zu %12s %10.2f %10s %6u  %s (failed)\n",
+                    job->in_bytes, "-", job->seconds * 1e3, "-",
+                    job->worker, job->input);
+            continue;
+        }
+        double bytes = batch->compress ? job->in_bytes : job->out_bytes;
+        ppm_bytes += bytes;
+        fprintf(stderr, "%12zu %12zu %10.2f %10.1f %6u  %s\n", job->in_bytes,
+                job->out_bytes, job->seconds * 1e3,
+                job->seconds > 0 ? bytes / job->seconds / 1e6 : 0.0,
+                job->worker, job->output);
+    }
+    for (unsigned w = 0; w < batch->nworkers; w++) {
+        steals += batch->workers[w].steals;
+    }
+    fprintf(stderr, "batch: %zu files (%zu failed) in %.3f s on %u workers, "
+            "%.1f MB/s of PPM, %.0f%% busy, %" PRIu64 " stolen\n", count,
+            failed, seconds, batch->nworkers,
+            seconds > 0 ? ppm_bytes / seconds / 1e6 : 0.0,
+            seconds > 0 ? 100 * busy / (seconds * batch->nworkers) : 0.0,
+            steals);
+}
+
+/*
+ *  Function:  Batch40_run
+ *  Arguments: char **paths - the input files
+ *             size_t count - the number of paths
+ *             bool compress - whether to compress rather than decompress
+ *             const char *outdir - the directory to write outputs to, or
+ *                                  NULL to write each next to its input
+ *             unsigned workers - the number of worker threads, at least 1
+ *             Codec40_opts opts - the codec options for every file, or
+ *                                 NULL; its threads, pipelined, output and
+ *                                 region are ignored, and its table_stats,
+ *                                 if not NULL, get the statistics of every
+ *                                 file
+ *  Does:      Codes every file on a pool of worker threads and reports on
+ *             stderr how long each took.
+ *  Return:    bool - true if every file was coded
+ */
+bool Batch40_run(char **paths, size_t count, bool compress,
+                 const char *outdir, unsigned workers, Codec40_opts opts)
+{
+    assert(paths != NULL && workers > 0);
+    struct Batch batch = { .compress = compress };
+    if (opts != NULL) {
+        batch.opts = *opts;
+    }
+    batch.nworkers = count == 0 ? 1 : workers > count ? count : workers;
+
+    /* size every file and deal them out, largest first */
+    struct Job *jobs = CALLOC(count == 0 ? 1 : count, sizeof(*jobs));
+    struct Job **order = CALLOC(count == 0 ? 1 : count, sizeof(*order));
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        jobs[i].input = paths[i];
+        jobs[i].output = output_path(paths[i], outdir, compress);
+        jobs[i].in_bytes = stat(paths[i], &st) == 0 ? (size_t)st.st_size
+                                                   : 0;
+        order[i] = &jobs[i];
+    }
+    qsort(order, count, sizeof(*order), compare_sizes);
+
+    size_t per_worker = (count + batch.nworkers - 1) / batch.nworkers;
+    batch.deques = CALLOC(batch.nworkers, sizeof(*batch.deques));
+    batch.workers = CALLOC(batch.nworkers, sizeof(*batch.workers));
+    for (unsigned w = 0; w < batch.nworkers; w++) {
+        struct Deque *deque = &batch.deques[w];
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->jobs = CALLOC(per_worker == 0 ? 1 : per_worker,
+                             sizeof(*deque->jobs));
+        for (size_t i = w; i < count; i += batch.nworkers) {
+            deque->jobs[deque->tail++] = order[i];
+        }
+    }
+
+    double start = now();
+    for (unsigned w = 0; w < batch.nworkers; w++) {
+        batch.workers[w].batch = &batch;
+        batch.workers[w].id = w;
+        int err = pthread_create(&batch.workers[w].thread, NULL, work,
+                                 &batch.workers[w]);
+        assert(err == 0);
+    }
+    for (unsigned w = 0; w < batch.nworkers; w++) {
+        pthread_join(batch.workers[w].thread, NULL);
+    }
+    report(jobs, count, &batch, now() - start);
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        ok = ok && jobs[i].ok;
+        FREE(jobs[i].output);
+    }
+    for (unsigned w = 0; w < batch.nworkers; w++) {
+        if (opts != NULL && opts->table_stats != NULL &&
+            batch.workers[w].stats.entries != 0) {
+            Rgbtable40_stats *total = opts->table_stats;
+            Rgbtable40_stats *stats = &batch.workers[w].stats;
+            total->entries = stats->entries;
+            total->bytes = stats->bytes;
+            total->tables += stats->tables;
+            total->filled += stats->filled;
+            total->hits += stats->hits;
+            total->misses += stats->misses;
+            total->fallbacks += stats->fallbacks;
+        }
+        pthread_mutex_destroy(&batch.deques[w].lock);
+        FREE(batch.deques[w].jobs);
+    }
+    FREE(batch.deques);
+    FREE(batch.workers);
+    FREE(order);
+    FREE(jobs);
+    return ok;
+}
+
+/*
+ *  Function:  Batch40_read_manifest
+ *  Arguments: FILE *input - a list of paths, one per line
+ *             size_t *count - set to the number of paths read
+ *  Does:      Reads a manifest, ignoring blank lines and a carriage return
+ *             at the end of a line.
+ *  Return:    char ** - the paths, to be freed with Batch40_free_manifest
+ */
+char **Batch40_read_manifest(FILE *input, size_t *count)
+{
+    assert(input != NULL && count != NULL);
+    size_t capacity = 16;
+    char **paths = ALLOC(capacity * sizeof(*paths));
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    *count = 0;
+    while ((length = getline(&line, &line_size, input)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' ||
+                              line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length == 0) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            RESIZE(paths, capacity * sizeof(*paths));
+        }
+        paths[*count] = ALLOC(length + 1);
+        memcpy(paths[*count], line, length + 1);
+        (*count)++;
+    }
+    free(line);
+    return paths;
+}
+
+/*
+ *  Function:  Batch40_free_manifest
+ *  Arguments: char **paths, size_t count - a manifest read with
+ *                                          Batch40_read_manifest
+ *  Does:      Frees the paths and the array holding them.
+ *  Return:    void
+ */
+void Batch40_free_manifest(char **paths, size_t count)
+{
+    assert(paths != NULL);
+    for (size_t i = 0; i < count; i++) {
+        FREE(paths[i]);
+    }
+    FREE(paths);
+}
@@ -0,0 +1,44 @@
+/******************************************************************************
+ *
+ *                                 batch40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for compressing or decompressing many files in one process
+ *     (40image -b). The files are shared out among a pool of worker
+ *     threads, each of which runs the codec on one whole file at a time,
+ *     and a table of per-file throughput is written to stderr at the end.
+ *     (See the implementation file batch40.c for more information)
+ *
+ *     Output files are named after their inputs: compressing adds
+ *     BATCH40_SUFFIX, and decompressing removes it, or adds ".ppm" to a
+ *     name that does not end in it. They go next to their inputs, or into
+ *     an output directory if one is given, and replace any existing file
+ *     of the same name. An invalid input file is reported and skipped,
+ *     leaving no output, and the other files are still coded.
+ *
+ *     It is a checked run-time error to pass a NULL path or count to any
+ *     function in this interface.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "codec40.h"
+
+#ifndef BATCH40_H
+#define BATCH40_H
+
+#define BATCH40_SUFFIX ".c40"
+
+extern bool   Batch40_run          (char **paths, size_t count,
+                                    bool compress, const char *outdir,
+                                    unsigned workers, Codec40_opts opts);
+extern char **Batch40_read_manifest(FILE *input, size_t *count);
+extern void   Batch40_free_manifest(char **paths, size_t count);
+
+#endif
@@ -0,0 +1,1733 @@
+/******************************************************************************
+ *
+ *                                 bench40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Benchmark driver for the codec (run with make bench). For every input
+ *     image it times
+ *
+ *       - the whole codec, compressing and decompressing from memory with
+ *         each A2 storage variant and each Codec40_opts mode;
+ *       - the stages of the callback-based path one at a time (scale_rgb,
+ *         rgb_to_cv, pix_to_dct, quantization, bitpacking and their
+ *         inverses), with the generic Bitpack functions next to the fixed
+ *         layout ones of bitpack40.h;
+ *       - the fused row kernels;
+ *       - the map functions of each A2 storage variant, with a trivial
+ *         callback.
+ *
+ *     Inputs are synthetic images of the sizes given with -s, a smooth one
+ *     and a noisy one of each, plus the PPM files in the directory given
+ *     with -c. Each benchmark is run once to warm up and then -r times; the
+ *     best time is reported as ns/pixel and as MB/s of 24-bit RGB pixels,
+ *     on stderr and in a JSON file (-o) for tracking regressions.
+ *
+ *     Before timing an input, and instead of timing with -k (make check),
+ *     it checks that the kernels which claim to agree bit for bit do: the
+ *     words of compress_row, compress_row_scalar, compress_row_raw and the
+ *     callback-based path with and without cvtable40, the pixels of
+ *     decompress_row, its scalar, big endian and rgbtable40 variants and
+ *     the callback-based path, and the bulk bitpacking and chroma search
+ *     against their scalar references. Any mismatch makes the exit status
+ *     nonzero. The fixed-point kernels are approximations and are only
+ *     timed.
+ *
+ *     The codec writes to stdout, which is sent to /dev/null throughout.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+
+#include "assert.h"
+#include "bitpack.h"
+#include "arith40.h"
+#include "pnm.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "compress40.h"
+
+#include "a2morton.h"
+#include "bitpack40.h"
+#include "chroma40.h"
+#include "codec40.h"
+#include "compressinfo.h"
+#include "compressmath.h"
+#include "compressrow.h"
+#include "context40.h"
+#include "cvtable40.h"
+#include "region40.h"
+#include "decompressmath.h"
+#include "decompressrow.h"
+#include "fixedrow.h"
+#include "rgbtable40.h"
+
+/* Defaults for the command line options */
+#define DEFAULT_REPS 5
+#define DEFAULT_THREADS 4
+#define DEFAULT_OUTPUT "bench40.json"
+
+/* Largest number of synthetic sizes accepted */
+#define MAX_SIZES 16
+
+/* Denominators of the synthetic images checked with -k: the common one,
+   one whose 8-bit samples are scaled, and one of 16-bit samples */
+static const unsigned check_denominators[] = { 255, 100, 65535 };
+
+/* Size of the image of random words the decompressors are checked on */
+#define RANDOM_WIDTH 61
+#define RANDOM_HEIGHT 67
+
+/* An input image, with the intermediate results of every stage of the
+   callback-based codec, which each stage benchmark reads and writes */
+struct Image {
+    char name[256];
+    unsigned width, height, denominator;
+    size_t pixel_count;        /* width * height */
+    size_t group_count;        /* 2x2 pixel groups, (width/2) * (height/2) */
+    unsigned char *ppm;        /* the image as a PPM file */
+    size_t ppm_size;
+    const unsigned char *raster; /* the raster within ppm */
+    unsigned char *compressed; /* the image as a compressed file */
+    size_t compressed_size;
+    struct Pnm_rgb *pixels;    /* row-major */
+    struct Pnm_rgb *decoded;   /* row-major, from unscale_rgb */
+
+    float *normalized;         /* 3 per pixel, from scale_rgb */
+    float *cv;                 /* 3 per pixel, from rgb_to_cv */
+    float *dcts;               /* 4 per group, from pix_to_dct */
+    unsigned *a, *pb, *pr;     /* quantized fields, one per group */
+    int *b, *c, *d;
+    uint32_t *words;           /* one per group, row-major */
+    unsigned char *scanlines;  /* two decoded scanlines */
+};
+
+/* One timed result */
+struct Result {
+    char input[256];
+    char group[32];
+    char name[64];
+    unsigned width, height;
+    double best, median; /* seconds */
+};
+
+/* Configuration and results of the whole run */
+static struct {
+    unsigned reps;
+    unsigned threads;
+    struct Result *results;
+    size_t count, capacity;
+    size_t mismatches; /* found by the exactness checks */
+} bench = { DEFAULT_REPS, DEFAULT_THREADS, NULL, 0, 0, 0 };
+
+typedef void Bench_fun(struct Image *image, void *cl);
+
+/* Static function declarations */
+static double now(void);
+static int compare_doubles(const void *x, const void *y);
+static void run(struct Image *image, const char *group, const char *name,
+                Bench_fun *fun, void *cl);
+static void image_from_pixels(struct Image *image, const char *name,
+                              unsigned width, unsigned height,
+                              unsigned denominator);
+static void image_make_ppm(struct Image *image);
+static void image_make_compressed(struct Image *image);
+static void image_synthetic(struct Image *image, unsigned width,
+                            unsigned height, bool noisy,
+                            unsigned denominator);
+static bool image_from_file(struct Image *image, const char *path);
+static void image_free(struct Image *image);
+static uint32_t xorshift(uint32_t *state);
+static void check_same(const char *input, const char *what,
+                       const void *expected, const void *actual,
+                       size_t size);
+static void check_bitpack(void);
+static void check_chroma(void);
+static void check_decompress(const char *input, const uint32_t *words,
+                             unsigned width, unsigned height);
+static void check_image(struct Image *image);
+static void check_random_words(void);
+static void bench_image(struct Image *image);
+static void process_image(struct Image *image, bool check_only);
+static void write_json_string(FILE *fp, const char *string);
+static void write_json(const char *path);
+static void bench_corpus(const char *dir, bool check_only);
+
+/*
+ *  Function:  now
+ *  Arguments: none
+ *  Does:      Reads the monotonic clock.
+ *  Return:    double - the time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *x, const void *y)
+{
+    double dx = *(const double *)x, dy = *(const double *)y;
+    return (dx > dy) - (dx < dy);
+}
+
+/*
+ *  Function:  run
+ *  Arguments: struct Image *image - the input
+ *             const char *group, *name - what is being measured
+ *             Bench_fun *fun - runs the benchmark once on image
+ *             void *cl - closure for fun
+ *  Does:      Runs fun once to warm up and then bench.reps times, records
+ *             the best and median times and prints them.
+ *  Return:    void
+ */
+static void run(struct Image *image, const char *group, const char *name,
+                Bench_fun *fun, void *cl)
+{
+    double *times = malloc(bench.reps * sizeof(*times));
+    assert(times != NULL);
+    fun(image, cl);
+    for (unsigned i = 0; i < bench.reps; i++) {
+        double start = now();
+        fun(image, cl);
+        times[i] = now() - start;
+    }
+    qsort(times, bench.reps, sizeof(*times), compare_doubles);
+
+    if (bench.count == bench.capacity) {
+        bench.capacity = bench.capacity == 0 ? 64 : 2 * bench.capacity;
+        bench.results = realloc(bench.results,
+                                bench.capacity * sizeof(*bench.results));
+        assert(bench.results != NULL);
+    }
+    struct Result *result = &bench.results[bench.count++];
+    snprintf(result->input, sizeof(result->input), "%s", image->name);
+    snprintf(result->group, sizeof(result->group), "%s", group);
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->width = image->width;
+    result->height = image->height;
+    result->best = times[0];
+    result->median = times[bench.reps / 2];
+    free(times);
+
+    fprintf(stderr, "  %-8s %-28s %9.2f ns/px %9.1f MB/s\n", group, name,
+            result->best * 1e9 / image->pixel_count,
+            image->pixel_count * 3 / result->best / 1e6);
+}
+
+/*****************************************************************************
+ *                                  Inputs
+ *****************************************************************************/
+
+/*
+ *  Function:  image_from_pixels
+ *  Arguments: struct Image *image - an image whose pixels are set
+ *             const char *name - the name to report it by
+ *             unsigned width, height, denominator - its dimensions
+ *  Does:      Fills in everything else: the PPM and compressed files and
+ *             the buffers of the stage benchmarks.
+ *  Return:    void
+ */
+static void image_from_pixels(struct Image *image, const char *name,
+                              unsigned width, unsigned height,
+                              unsigned denominator)
+{
+    snprintf(image->name, sizeof(image->name), "%s", name);
+    image->width = width;
+    image->height = height;
+    image->denominator = denominator;
+    image->pixel_count = (size_t)width * height;
+    image->group_count = (size_t)(width / 2) * (height / 2);
+
+    size_t groups = image->group_count;
+    image->normalized = malloc(3 * image->pixel_count * sizeof(float));
+    image->cv = malloc(3 * image->pixel_count * sizeof(float));
+    image->dcts = malloc(4 * groups * sizeof(float));
+    image->a = malloc(groups * sizeof(unsigned));
+    image->pb = malloc(groups * sizeof(unsigned));
+    image->pr = malloc(groups * sizeof(unsigned));
+    image->b = malloc(groups * sizeof(int));
+    image->c = malloc(groups * sizeof(int));
+    image->d = malloc(groups * sizeof(int));
+    image->words = malloc(groups * sizeof(uint32_t));
+    image->scanlines = malloc(2 * 3 * (size_t)width);
+    image->decoded = malloc(image->pixel_count * sizeof(struct Pnm_rgb));
+    assert(image->normalized != NULL && image->cv != NULL &&
+           image->dcts != NULL && image->a != NULL && image->pb != NULL &&
+           image->pr != NULL && image->b != NULL && image->c != NULL &&
+           image->d != NULL && image->words != NULL &&
+           image->scanlines != NULL && image->decoded != NULL);
+
+    image_make_ppm(image);
+    image_make_compressed(image);
+}
+
+/*
+ *  Function:  image_make_ppm
+ *  Arguments: struct Image *image - an image whose pixels are set
+ *  Does:      Encodes the pixels as a binary PPM file in memory.
+ *  Return:    void
+ */
+static void image_make_ppm(struct Image *image)
+{
+    char header[64];
+    int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n%u\n",
+                               image->width, image->height,
+                               image->denominator);
+    unsigned sample_size = image->denominator > 255 ? 2 : 1;
+    image->ppm_size = header_size + 3 * sample_size * image->pixel_count;
+    image->ppm = malloc(image->ppm_size);
+    assert(image->ppm != NULL);
+    memcpy(image->ppm, header, header_size);
+    image->raster = &image->ppm[header_size];
+
+    unsigned char *out = &image->ppm[header_size];
+    for (size_t i = 0; i < image->pixel_count; i++) {
+        unsigned samples[3] = { image->pixels[i].red, image->pixels[i].green,
+                                image->pixels[i].blue };
+        for (int k = 0; k < 3; k++) {
+            if (sample_size == 2) {
+                *out++ = samples[k] >> 8;
+            }
+            *out++ = samples[k];
+        }
+    }
+}
+
+/*
+ *  Function:  image_make_compressed
+ *  Arguments: struct Image *image - an image whose pixels are set
+ *  Does:      Compresses the pixels into a compressed file in memory, with
+ *             the fused kernel, and fills in image->words.
+ *  Return:    void
+ */
+static void image_make_compressed(struct Image *image)
+{
+    unsigned width = image->width / 2, height = image->height / 2;
+    char header[64];
+    int header_size = snprintf(header, sizeof(header),
+                               "COMP40 Compressed image format 2\n%u %u\n",
+                               width, height);
+    image->compressed_size = header_size + 4 * image->group_count;
+    image->compressed = malloc(image->compressed_size);
+    assert(image->compressed != NULL);
+    memcpy(image->compressed, header, header_size);
+
+    unsigned char *out = &image->compressed[header_size];
+    for (unsigned row = 0; row < height; row++) {
+        const struct Pnm_rgb *top = &image->pixels[2 * row * image->width];
+        uint32_t *words = &image->words[(size_t)row * width];
+        compress_row(top, top + image->width, width, image->denominator,
+                     words);
+        for (unsigned col = 0; col < width; col++) {
+            *out++ = words[col] >> 24;
+            *out++ = words[col] >> 16;
+            *out++ = words[col] >> 8;
+            *out++ = words[col];
+        }
+    }
+}
+
+/*
+ *  Function:  xorshift
+ *  Arguments: uint32_t *state - the state of the generator, not zero
+ *  Does:      Advances a fixed xorshift generator.
+ *  Return:    uint32_t - the new state
+ */
+static uint32_t xorshift(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/*
+ *  Function:  image_synthetic
+ *  Arguments: struct Image *image - the image to fill in
+ *             unsigned width, height - its size
+ *             bool noisy - whether to make uniform noise, or else smooth
+ *                          gradients, which compress like photographs
+ *             unsigned denominator - its denominator, 1 to 65535
+ *  Does:      Generates a synthetic image. The noise comes from a fixed
+ *             xorshift generator, so every run times the same pixels. Names
+ *             of images with a denominator other than 255 end in it.
+ *  Return:    void
+ */
+static void image_synthetic(struct Image *image, unsigned width,
+                            unsigned height, bool noisy,
+                            unsigned denominator)
+{
+    image->pixels = malloc((size_t)width * height * sizeof(struct Pnm_rgb));
+    assert(image->pixels != NULL);
+    uint32_t state = 2463534242u;
+    unsigned levels = denominator + 1;
+    for (unsigned row = 0; row < height; row++) {
+        for (unsigned col = 0; col < width; col++) {
+            struct Pnm_rgb *pixel = &image->pixels[(size_t)row * width + col];
+            if (noisy) {
+                xorshift(&state);
+                pixel->red = state % levels;
+                pixel->green = (state >> 8) % levels;
+                pixel->blue = (state >> 16) % levels;
+            } else {
+                pixel->red = (size_t)denominator * col /
+                             (width > 1 ? width - 1 : 1);
+                pixel->green = (size_t)denominator * row /
+                               (height > 1 ? height - 1 : 1);
+                pixel->blue = (size_t)denominator * (col + row) /
+                              (width + height);
+            }
+        }
+    }
+
+    char name[64];
+    int length = snprintf(name, sizeof(name), "%s-%ux%u",
+                          noisy ? "noise" : "smooth", width, height);
+    if (denominator != 255) {
+        snprintf(&name[length], sizeof(name) - length, "-%u", denominator);
+    }
+    image_from_pixels(image, name, width, height, denominator);
+}
+
+/*
+ *  Function:  image_from_file
+ *  Arguments: struct Image *image - the image to fill in
+ *             const char *path - a PPM file
+ *  Does:      Reads a corpus image.
+ *  Return:    bool - false if the file cannot be opened or is smaller than
+ *             one pixel group
+ */
+static bool image_from_file(struct Image *image, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    A2Methods_T methods = uarray2_methods_plain;
+    Pnm_ppm ppm = Pnm_ppmread(fp, methods);
+    fclose(fp);
+    if (ppm->width < 2 || ppm->height < 2) {
+        Pnm_ppmfree(&ppm);
+        return false;
+    }
+
+    image->pixels = malloc((size_t)ppm->width * ppm->height *
+                           sizeof(struct Pnm_rgb));
+    assert(image->pixels != NULL);
+    for (unsigned row = 0; row < ppm->height; row++) {
+        for (unsigned col = 0; col < ppm->width; col++) {
+            image->pixels[(size_t)row * ppm->width + col] =
+                *(struct Pnm_rgb *)methods->at(ppm->pixels, col, row);
+        }
+    }
+    const char *base = strrchr(path, '/');
+    image_from_pixels(image, base != NULL ? base + 1 : path, ppm->width,
+                      ppm->height, ppm->denominator);
+    Pnm_ppmfree(&ppm);
+    return true;
+}
+
+/*
+ *  Function:  image_free
+ *  Arguments: struct Image *image - an image filled in by image_synthetic
+ *                                   or image_from_file
+ *  Does:      Frees everything the image holds.
+ *  Return:    void
+ */
+static void image_free(struct Image *image)
+{
+    free(image->pixels);
+    free(image->ppm);
+    free(image->compressed);
+    free(image->normalized);
+    free(image->cv);
+    free(image->dcts);
+    free(image->a);
+    free(image->b);
+    free(image->c);
+    free(image->d);
+    free(image->pb);
+    free(image->pr);
+    free(image->words);
+    free(image->scanlines);
+    free(image->decoded);
+}
+
+/*****************************************************************************
+ *                            Whole-codec benchmarks
+ *****************************************************************************/
+
+static void bench_compress(struct Image *image, void *cl)
+{
+    FILE *input = fmemopen(image->ppm, image->ppm_size, "rb");
+    assert(input != NULL);
+    compress40_opts(input, cl);
+    fclose(input);
+}
+
+static void bench_decompress(struct Image *image, void *cl)
+{
+    FILE *input = fmemopen(image->compressed, image->compressed_size, "rb");
+    assert(input != NULL);
+    decompress40_opts(input, cl);
+    fclose(input);
+}
+
+static void bench_compress_inplace(struct Image *image, void *cl)
+{
+    bool done = compress40_inplace(image->ppm, image->ppm_size, cl);
+    assert(done);
+}
+
+static void bench_decompress_inplace(struct Image *image, void *cl)
+{
+    bool done = decompress40_inplace(image->compressed,
+                                     image->compressed_size, cl);
+    assert(done);
+}
+
+/* A context is reused from run to run, as a service coding same-size
+   frames would; only the warm-up allocates */
+static void bench_compress_context(struct Image *image, void *cl)
+{
+    const uint32_t *words;
+    unsigned sample_bytes = image->denominator > 255 ? 2 : 1;
+    size_t stride = (size_t)image->width * 3 * sample_bytes;
+    Buffer40_status status = Context40_compress(cl, image->raster, stride,
+                                                stride * image->height,
+                                                image->width, image->height,
+                                                image->denominator, &words);
+    assert(status == BUFFER40_OK);
+}
+
+static void bench_decompress_context(struct Image *image, void *cl)
+{
+    const unsigned char *pixels;
+    unsigned width, height;
+    Buffer40_status status = Context40_decompress_file(
+        cl, image->compressed, image->compressed_size, &width, &height,
+        &pixels);
+    assert(status == BUFFER40_OK);
+}
+
+/* The codec's buffers come from a region which is reset after every
+   image, as a batch worker's is */
+static void bench_compress_region(struct Image *image, void *cl)
+{
+    bench_compress(image, cl);
+    Region40_reset(((Codec40_opts)cl)->region);
+}
+
+static void bench_decompress_region(struct Image *image, void *cl)
+{
+    bench_decompress(image, cl);
+    Region40_reset(((Codec40_opts)cl)->region);
+}
+
+/*****************************************************************************
+ *                              Stage benchmarks
+ *****************************************************************************/
+
+static void bench_scale_rgb(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t i = 0; i < image->pixel_count; i++) {
+        scale_rgb(&image->pixels[i], image->denominator,
+                  &image->normalized[3 * i]);
+    }
+}
+
+static void bench_rgb_to_cv(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t i = 0; i < image->pixel_count; i++) {
+        rgb_to_cv(&image->normalized[3 * i], &image->cv[3 * i]);
+    }
+}
+
+/*
+ *  Function:  group_pixel
+ *  Arguments: struct Image *image - the image
+ *             size_t group - a 2x2 pixel group, counted row-major
+ *             int k - 0 to 3 for the top-left, top-right, bottom-left and
+ *                     bottom-right pixel
+ *  Does:      Finds a pixel of a group.
+ *  Return:    size_t - the pixel's index in image->pixels
+ */
+static inline size_t group_pixel(struct Image *image, size_t group, int k)
+{
+    size_t groups_wide = image->width / 2;
+    size_t row = 2 * (group / groups_wide) + k / 2;
+    size_t col = 2 * (group % groups_wide) + k % 2;
+    return row * image->width + col;
+}
+
+static void bench_pix_to_dct(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        float y_vals[4];
+        for (int k = 0; k < 4; k++) {
+            y_vals[k] = image->cv[3 * group_pixel(image, g, k)];
+        }
+        pix_to_dct(y_vals, &image->dcts[4 * g]);
+    }
+}
+
+/* The closure of bench_quantize points to whether to quantize chroma with
+   the tables of chroma40.h rather than the arith40 library */
+static void bench_quantize(struct Image *image, void *cl)
+{
+    bool use_tables = *(bool *)cl;
+    const Chroma40_tables *chroma = Chroma40_get();
+    for (size_t g = 0; g < image->group_count; g++) {
+        const float *dct = &image->dcts[4 * g];
+        float sum_pb = 0, sum_pr = 0;
+        for (int k = 0; k < 4; k++) {
+            size_t pixel = group_pixel(image, g, k);
+            sum_pb += image->cv[3 * pixel + 1];
+            sum_pr += image->cv[3 * pixel + 2];
+        }
+        image->a[g] = quantize_avg_brightness(dct[0]);
+        image->b[g] = quantize_dct(dct[1]);
+        image->c[g] = quantize_dct(dct[2]);
+        image->d[g] = quantize_dct(dct[3]);
+        if (use_tables) {
+            image->pb[g] = Chroma40_index(chroma, sum_pb / 4.0);
+            image->pr[g] = Chroma40_index(chroma, sum_pr / 4.0);
+        } else {
+            image->pb[g] = Arith40_index_of_chroma(sum_pb / 4.0);
+            image->pr[g] = Arith40_index_of_chroma(sum_pr / 4.0);
+        }
+    }
+}
+
+static void bench_pack_generic(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        uint64_t word = 0;
+        word = Bitpack_newu(word, A_WIDTH, a_lsb, image->a[g]);
+        word = Bitpack_news(word, B_WIDTH, b_lsb, image->b[g]);
+        word = Bitpack_news(word, C_WIDTH, c_lsb, image->c[g]);
+        word = Bitpack_news(word, D_WIDTH, d_lsb, image->d[g]);
+        word = Bitpack_newu(word, PB_WIDTH, pb_lsb, image->pb[g]);
+        word = Bitpack_newu(word, PR_WIDTH, pr_lsb, image->pr[g]);
+        image->words[g] = word;
+    }
+}
+
+static void bench_pack_fixed(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        image->words[g] = Bitpack40_pack(image->a[g], image->b[g],
+                                         image->c[g], image->d[g],
+                                         image->pb[g], image->pr[g]);
+    }
+}
+
+static Bitpack40_columns image_columns(struct Image *image)
+{
+    Bitpack40_columns columns = { image->a, image->b, image->c, image->d,
+                                  image->pb, image->pr };
+    return columns;
+}
+
+static void bench_pack_bulk(struct Image *image, void *cl)
+{
+    (void)cl;
+    Bitpack40_pack_n(image->group_count, image_columns(image), image->words);
+}
+
+static void bench_unpack_generic(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        uint64_t word = image->words[g];
+        image->a[g] = Bitpack_getu(word, A_WIDTH, a_lsb);
+        image->b[g] = Bitpack_gets(word, B_WIDTH, b_lsb);
+        image->c[g] = Bitpack_gets(word, C_WIDTH, c_lsb);
+        image->d[g] = Bitpack_gets(word, D_WIDTH, d_lsb);
+        image->pb[g] = Bitpack_getu(word, PB_WIDTH, pb_lsb);
+        image->pr[g] = Bitpack_getu(word, PR_WIDTH, pr_lsb);
+    }
+}
+
+static void bench_unpack_fixed(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        Bitpack40_fields fields = Bitpack40_unpack(image->words[g]);
+        image->a[g] = fields.a;
+        image->b[g] = fields.b;
+        image->c[g] = fields.c;
+        image->d[g] = fields.d;
+        image->pb[g] = fields.pb;
+        image->pr[g] = fields.pr;
+    }
+}
+
+static void bench_unpack_bulk(struct Image *image, void *cl)
+{
+    (void)cl;
+    Bitpack40_unpack_n(image->group_count, image->words,
+                       image_columns(image));
+}
+
+static void bench_dequantize(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        float *dct = &image->dcts[4 * g];
+        dct[0] = dequantize_avg_brightness(image->a[g]);
+        dct[1] = dequantize_dct(image->b[g]);
+        dct[2] = dequantize_dct(image->c[g]);
+        dct[3] = dequantize_dct(image->d[g]);
+        float pb = Arith40_chroma_of_index(image->pb[g]);
+        float pr = Arith40_chroma_of_index(image->pr[g]);
+        for (int k = 0; k < 4; k++) {
+            size_t pixel = group_pixel(image, g, k);
+            image->cv[3 * pixel + 1] = pb;
+            image->cv[3 * pixel + 2] = pr;
+        }
+    }
+}
+
+static void bench_dct_to_brightness(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t g = 0; g < image->group_count; g++) {
+        float y_vals[4];
+        dct_to_brightness(&image->dcts[4 * g], y_vals);
+        for (int k = 0; k < 4; k++) {
+            image->cv[3 * group_pixel(image, g, k)] = y_vals[k];
+        }
+    }
+}
+
+static void bench_cv_to_rgb(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t i = 0; i < image->pixel_count; i++) {
+        cv_to_rgb(&image->cv[3 * i], &image->normalized[3 * i]);
+    }
+}
+
+static void bench_unscale_rgb(struct Image *image, void *cl)
+{
+    (void)cl;
+    for (size_t i = 0; i < image->pixel_count; i++) {
+        float *rgb = &image->normalized[3 * i];
+        for (int k = 0; k < 3; k++) {
+            rgb[k] = rgb[k] < 0 ? 0 : rgb[k] > 1 ? 1 : rgb[k];
+        }
+        image->decoded[i] = unscale_rgb(rgb, image->denominator);
+    }
+}
+
+/*****************************************************************************
+ *                            Row kernel benchmarks
+ *****************************************************************************/
+
+typedef void Compress_row_fun(const struct Pnm_rgb *top,
+                              const struct Pnm_rgb *bottom, unsigned width,
+                              unsigned denominator, uint32_t *words);
+typedef void Decompress_row_fun(const uint32_t *words, unsigned width,
+                                unsigned char *top, unsigned char *bottom);
+
+/* The closure of bench_compress_rows, holding a kernel of compressrow.h or
+   fixedrow.h; function pointers cannot be passed as void * in C99 */
+struct Compress_kernel {
+    Compress_row_fun *fun;
+};
+
+struct Decompress_kernel {
+    Decompress_row_fun *fun;
+};
+
+static void bench_compress_rows(struct Image *image, void *cl)
+{
+    Compress_row_fun *fun = ((struct Compress_kernel *)cl)->fun;
+    unsigned width = image->width / 2;
+    for (unsigned row = 0; row < image->height / 2; row++) {
+        const struct Pnm_rgb *top = &image->pixels[2 * row * image->width];
+        fun(top, top + image->width, width, image->denominator,
+            &image->words[(size_t)row * width]);
+    }
+}
+
+static void bench_decompress_rows(struct Image *image, void *cl)
+{
+    Decompress_row_fun *fun = ((struct Decompress_kernel *)cl)->fun;
+    unsigned width = image->width / 2;
+    unsigned char *top = image->scanlines;
+    for (unsigned row = 0; row < image->height / 2; row++) {
+        fun(&image->words[(size_t)row * width], width, top,
+            top + 3 * image->width);
+    }
+}
+
+/* The table persists across runs, so all but the warm-up are warm */
+static void bench_decompress_table(struct Image *image, void *cl)
+{
+    Rgbtable40_T table = cl;
+    unsigned width = image->width / 2;
+    unsigned char *top = image->scanlines;
+    for (unsigned row = 0; row < image->height / 2; row++) {
+        Rgbtable40_decode_row(table, &image->words[(size_t)row * width],
+                              width, top, top + 3 * image->width);
+    }
+}
+
+/*****************************************************************************
+ *                           A2 storage benchmarks
+ *****************************************************************************/
+
+/* The closure of the A2 benchmarks */
+struct A2_bench {
+    A2Methods_T methods;
+    A2Methods_UArray2 array;
+    A2Methods_mapfun *map;
+    unsigned long sum;
+};
+
+static void sum_red(int col, int row, A2Methods_UArray2 array, void *elem,
+                    void *cl)
+{
+    (void)col;
+    (void)row;
+    (void)array;
+    ((struct A2_bench *)cl)->sum += ((struct Pnm_rgb *)elem)->red;
+}
+
+static void bench_a2_map(struct Image *image, void *cl)
+{
+    (void)image;
+    struct A2_bench *a2 = cl;
+    a2->map(a2->array, sum_red, a2);
+}
+
+static void bench_a2_at(struct Image *image, void *cl)
+{
+    struct A2_bench *a2 = cl;
+    for (unsigned row = 0; row < image->height; row++) {
+        for (unsigned col = 0; col < image->width; col++) {
+            a2->sum += ((struct Pnm_rgb *)a2->methods->at(a2->array, col,
+                                                          row))->red;
+        }
+    }
+}
+
+/*
+ *  Function:  bench_a2
+ *  Arguments: struct Image *image - the input
+ *             const char *suite - the name of methods
+ *             A2Methods_T methods - an A2 storage variant
+ *  Does:      Copies the image into an array of the variant and times its
+ *             map functions and at.
+ *  Return:    void
+ */
+static void bench_a2(struct Image *image, const char *suite,
+                     A2Methods_T methods)
+{
+    struct A2_bench a2 = { methods, NULL, NULL, 0 };
+    a2.array = methods->new(image->width, image->height,
+                            sizeof(struct Pnm_rgb));
+    for (unsigned row = 0; row < image->height; row++) {
+        for (unsigned col = 0; col < image->width; col++) {
+            *(struct Pnm_rgb *)methods->at(a2.array, col, row) =
+                image->pixels[(size_t)row * image->width + col];
+        }
+    }
+
+    struct {
+        const char *name;
+        A2Methods_mapfun *map;
+    } maps[] = {
+        { "map_row_major", methods->map_row_major },
+        { "map_col_major", methods->map_col_major },
+        { "map_block_major", methods->map_block_major },
+        { "map_default", methods->map_default }
+    };
+    char name[64];
+    for (size_t i = 0; i < sizeof(maps) / sizeof(maps[0]); i++) {
+        if (maps[i].map == NULL) {
+            continue;
+        }
+        a2.map = maps[i].map;
+        snprintf(name, sizeof(name), "%s/%s", suite, maps[i].name);
+        run(image, "a2", name, bench_a2_map, &a2);
+    }
+    snprintf(name, sizeof(name), "%s/at_row_major", suite);
+    run(image, "a2", name, bench_a2_at, &a2);
+    methods->free(&a2.array);
+}
+
+/*****************************************************************************
+ *                             Exactness checks
+ *****************************************************************************/
+
+/* Number of words the bulk bitpacking is checked on; not a multiple of 8,
+   so the scalar tail of the vector loops is checked too */
+#define CHECK_WORDS 1003
+
+/* Number of evenly spaced values the chroma search is checked on, besides
+   every threshold and its neighbours */
+#define CHECK_CHROMAS 4096
+
+/* The fields of CHECK_WORDS words */
+struct Check_fields {
+    unsigned a[CHECK_WORDS], pb[CHECK_WORDS], pr[CHECK_WORDS];
+    int b[CHECK_WORDS], c[CHECK_WORDS], d[CHECK_WORDS];
+};
+
+/*
+ *  Function:  check_same
+ *  Arguments: const char *input - the input the results are from
+ *             const char *what - the path whose results are compared with
+ *                                the reference
+ *             const void *expected - the results of the reference
+ *             const void *actual - the results of the path
+ *             size_t size - the size of each in bytes
+ *  Does:      Reports and counts a mismatch if the results differ in any
+ *             byte, giving the offset of the first.
+ *  Return:    void
+ */
+static void check_same(const char *input, const char *what,
+                       const void *expected, const void *actual,
+                       size_t size)
+{
+    const unsigned char *x = expected, *y = actual;
+    for (size_t i = 0; i < size; i++) {
+        if (x[i] != y[i]) {
+            fprintf(stderr, "MISMATCH %s: %s differs at byte %zu\n", input,
+                    what, i);
+            bench.mismatches++;
+            return;
+        }
+    }
+}
+
+static Bitpack40_columns field_columns(struct Check_fields *fields)
+{
+    Bitpack40_columns columns = { fields->a, fields->b, fields->c,
+                                  fields->d, fields->pb, fields->pr };
+    return columns;
+}
+
+/*
+ *  Function:  check_bitpack
+ *  Arguments: none
+ *  Does:      Checks the bulk bitpacking functions and their scalar
+ *             references against the generic Bitpack functions, packing
+ *             random values from the whole range of each field and
+ *             unpacking random words.
+ *  Return:    void
+ */
+static void check_bitpack(void)
+{
+    static struct Check_fields fields, unpacked;
+    uint32_t expected[CHECK_WORDS], actual[CHECK_WORDS];
+    uint32_t state = 2463534242u;
+
+    for (size_t i = 0; i < CHECK_WORDS; i++) {
+        fields.a[i] = xorshift(&state) % (1u << A_WIDTH);
+        fields.b[i] = (int)(xorshift(&state) % (1u << B_WIDTH)) -
+                      (1 << (B_WIDTH - 1));
+        fields.c[i] = (int)(xorshift(&state) % (1u << C_WIDTH)) -
+                      (1 << (C_WIDTH - 1));
+        fields.d[i] = (int)(xorshift(&state) % (1u << D_WIDTH)) -
+                      (1 << (D_WIDTH - 1));
+        fields.pb[i] = xorshift(&state) % (1u << PB_WIDTH);
+        fields.pr[i] = xorshift(&state) % (1u << PR_WIDTH);
+        uint64_t word = 0;
+        word = Bitpack_newu(word, A_WIDTH, a_lsb, fields.a[i]);
+        word = Bitpack_news(word, B_WIDTH, b_lsb, fields.b[i]);
+        word = Bitpack_news(word, C_WIDTH, c_lsb, fields.c[i]);
+        word = Bitpack_news(word, D_WIDTH, d_lsb, fields.d[i]);
+        word = Bitpack_newu(word, PB_WIDTH, pb_lsb, fields.pb[i]);
+        word = Bitpack_newu(word, PR_WIDTH, pr_lsb, fields.pr[i]);
+        expected[i] = word;
+    }
+    Bitpack40_pack_n_scalar(CHECK_WORDS, field_columns(&fields), actual);
+    check_same("bitpack", "Bitpack40_pack_n_scalar", expected, actual,
+               sizeof(actual));
+    Bitpack40_pack_n(CHECK_WORDS, field_columns(&fields), actual);
+    check_same("bitpack", "Bitpack40_pack_n", expected, actual,
+               sizeof(actual));
+
+    for (size_t i = 0; i < CHECK_WORDS; i++) {
+        uint64_t word = expected[i] = xorshift(&state);
+        fields.a[i] = Bitpack_getu(word, A_WIDTH, a_lsb);
+        fields.b[i] = Bitpack_gets(word, B_WIDTH, b_lsb);
+        fields.c[i] = Bitpack_gets(word, C_WIDTH, c_lsb);
+        fields.d[i] = Bitpack_gets(word, D_WIDTH, d_lsb);
+        fields.pb[i] = Bitpack_getu(word, PB_WIDTH, pb_lsb);
+        fields.pr[i] = Bitpack_getu(word, PR_WIDTH, pr_lsb);
+    }
+    memset(&unpacked, 0, sizeof(unpacked));
+    Bitpack40_unpack_n_scalar(CHECK_WORDS, expected, field_columns(&unpacked));
+    check_same("bitpack", "Bitpack40_unpack_n_scalar", &fields, &unpacked,
+               sizeof(unpacked));
+    memset(&unpacked, 0, sizeof(unpacked));
+    Bitpack40_unpack_n(CHECK_WORDS, expected, field_columns(&unpacked));
+    check_same("bitpack", "Bitpack40_unpack_n", &fields, &unpacked,
+               sizeof(unpacked));
+}
+
+#ifdef CPUFEATURES_X86
+
+/*
+ *  Function:  chroma_index_avx2 / chroma_index_fixed_avx2
+ *  Arguments: const Chroma40_tables *tables - the chroma tables
+ *             const float *values - n chroma values
+ *             const int32_t *sums - n fixed-point sums, as for
+ *                                   Chroma40_index_fixed
+ *             size_t n - the number of values or sums
+ *             unsigned *indices - set to their n indices
+ *  Does:      Finds indices 8 at a time with the vector searches, padding
+ *             the last 8 with zeros.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void chroma_index_avx2(const Chroma40_tables *tables,
+                              const float *values, size_t n,
+                              unsigned *indices)
+{
+    for (size_t i = 0; i < n; i += 8) {
+        size_t lanes = n - i < 8 ? n - i : 8;
+        float x[8] = { 0 };
+        unsigned index[8];
+        memcpy(x, &values[i], lanes * sizeof(float));
+        _mm256_storeu_si256((__m256i *)index,
+                            Chroma40_index_avx2(tables, _mm256_loadu_ps(x)));
+        memcpy(&indices[i], index, lanes * sizeof(unsigned));
+    }
+}
+
+TARGET_AVX2
+static void chroma_index_fixed_avx2(const Chroma40_tables *tables,
+                                    const int32_t *sums, size_t n,
+                                    unsigned *indices)
+{
+    for (size_t i = 0; i < n; i += 8) {
+        size_t lanes = n - i < 8 ? n - i : 8;
+        int32_t sum[8] = { 0 };
+        unsigned index[8];
+        memcpy(sum, &sums[i], lanes * sizeof(int32_t));
+        _mm256_storeu_si256((__m256i *)index, Chroma40_index_fixed_avx2(
+            tables, _mm256_loadu_si256((const __m256i *)sum)));
+        memcpy(&indices[i], index, lanes * sizeof(unsigned));
+    }
+}
+
+#endif
+
+/*
+ *  Function:  check_chroma
+ *  Arguments: none
+ *  Does:      Checks Chroma40_index, and Chroma40_index_avx2 if the
+ *             processor has AVX2, against Arith40_index_of_chroma, on an
+ *             even grid across the range of chroma and on every threshold
+ *             and the floats either side of it; Chroma40_chroma against
+ *             Arith40_chroma_of_index; and the vector fixed-point search
+ *             against the scalar one on the thresholds and either side.
+ *  Return:    void
+ */
+static void check_chroma(void)
+{
+    enum { COUNT = CHECK_CHROMAS + 1 + 3 * (CHROMA40_COUNT - 1) };
+    const Chroma40_tables *tables = Chroma40_get();
+    float values[COUNT];
+    unsigned expected[COUNT], actual[COUNT];
+    size_t count = 0;
+    for (int i = 0; i <= CHECK_CHROMAS; i++) {
+        values[count++] = -0.6f + 1.2f * i / CHECK_CHROMAS;
+    }
+    for (int k = 0; k < CHROMA40_COUNT - 1; k++) {
+        float threshold = tables->threshold[k];
+        values[count++] = nextafterf(threshold, -INFINITY);
+        values[count++] = threshold;
+        values[count++] = nextafterf(threshold, INFINITY);
+    }
+    assert(count == COUNT);
+
+    for (size_t i = 0; i < COUNT; i++) {
+        expected[i] = Arith40_index_of_chroma(values[i]);
+        actual[i] = Chroma40_index(tables, values[i]);
+    }
+    check_same("chroma", "Chroma40_index", expected, actual,
+               sizeof(actual));
+    float chroma_expected[CHROMA40_COUNT], chroma_actual[CHROMA40_COUNT];
+    for (unsigned i = 0; i < CHROMA40_COUNT; i++) {
+        chroma_expected[i] = Arith40_chroma_of_index(i);
+        chroma_actual[i] = Chroma40_chroma(tables, i);
+    }
+    check_same("chroma", "Chroma40_chroma", chroma_expected, chroma_actual,
+               sizeof(chroma_actual));
+
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        chroma_index_avx2(tables, values, COUNT, actual);
+        check_same("chroma", "Chroma40_index_avx2", expected, actual,
+                   sizeof(actual));
+        int32_t sums[3 * (CHROMA40_COUNT - 1)];
+        size_t n = 0;
+        for (int k = 0; k < CHROMA40_COUNT - 1; k++) {
+            for (int i = -1; i <= 1; i++) {
+                sums[n] = tables->fixed_threshold[k] + i;
+                expected[n] = Chroma40_index_fixed(tables, sums[n]);
+                n++;
+            }
+        }
+        chroma_index_fixed_avx2(tables, sums, n, actual);
+        check_same("chroma", "Chroma40_index_fixed_avx2", expected, actual,
+                   n * sizeof(unsigned));
+    }
+#endif
+}
+
+/*
+ *  Function:  reference_compress_row
+ *  Arguments: see compress_row, plus
+ *             const Cvtable40 *cvtable - the table of the denominator, or
+ *                                        NULL
+ *  Does:      Compresses a row of pixel groups one pixel at a time, in the
+ *             order and with the calls of compress_cb, and packs each word
+ *             with the generic Bitpack functions. With a table, 8-bit
+ *             pixels are transformed with it and chroma is quantized with
+ *             chroma40.h, as compress40.c does; without one, every pixel is
+ *             scaled and transformed and chroma is quantized by the arith40
+ *             library, as the original callback-based path did.
+ *  Return:    void
+ */
+static void reference_compress_row(const struct Pnm_rgb *top,
+                                   const struct Pnm_rgb *bottom,
+                                   unsigned width, unsigned denominator,
+                                   const Cvtable40 *cvtable, uint32_t *words)
+{
+    const Chroma40_tables *chroma = Chroma40_get();
+    for (unsigned col = 0; col < width; col++) {
+        /* block-major order: top-left, bottom-left, top-right,
+           bottom-right */
+        const struct Pnm_rgb *group[4] = { &top[2 * col], &bottom[2 * col],
+                                           &top[2 * col + 1],
+                                           &bottom[2 * col + 1] };
+        float y_vals[4], dcts[4];
+        float sum_pb = 0, sum_pr = 0;
+        for (int k = 0; k < 4; k++) {
+            const struct Pnm_rgb *rgb = group[k];
+            float cv[3];
+            if (cvtable != NULL &&
+                (rgb->red | rgb->green | rgb->blue) < CVTABLE40_SAMPLES) {
+                Cvtable40_cv(cvtable, rgb->red, rgb->green, rgb->blue,
+                             &cv[0], &cv[1], &cv[2]);
+            } else {
+                float normalized[3];
+                scale_rgb((Pnm_rgb)rgb, denominator, normalized);
+                rgb_to_cv(normalized, cv);
+            }
+            sum_pb += cv[1];
+            sum_pr += cv[2];
+            y_vals[(k % 2) * 2 + k / 2] = cv[0];
+        }
+        pix_to_dct(y_vals, dcts);
+        float avg_pb = sum_pb / 4.0, avg_pr = sum_pr / 4.0;
+        unsigned pb = cvtable != NULL ? Chroma40_index(chroma, avg_pb)
+                                      : Arith40_index_of_chroma(avg_pb);
+        unsigned pr = cvtable != NULL ? Chroma40_index(chroma, avg_pr)
+                                      : Arith40_index_of_chroma(avg_pr);
+
+        uint64_t word = 0;
+        word = Bitpack_newu(word, A_WIDTH, a_lsb,
+                            quantize_avg_brightness(dcts[0]));
+        word = Bitpack_news(word, B_WIDTH, b_lsb, quantize_dct(dcts[1]));
+        word = Bitpack_news(word, C_WIDTH, c_lsb, quantize_dct(dcts[2]));
+        word = Bitpack_news(word, D_WIDTH, d_lsb, quantize_dct(dcts[3]));
+        word = Bitpack_newu(word, PB_WIDTH, pb_lsb, pb);
+        word = Bitpack_newu(word, PR_WIDTH, pr_lsb, pr);
+        words[col] = word;
+    }
+}
+
+/*
+ *  Function:  reference_decompress_row
+ *  Arguments: see decompress_row_scalar
+ *  Does:      Decompresses a row of words one group at a time, with the
+ *             generic Bitpack functions, the arith40 library and the calls
+ *             of the callback-based path.
+ *  Return:    void
+ */
+static void reference_decompress_row(const uint32_t *words, unsigned width,
+                                     unsigned char *top,
+                                     unsigned char *bottom)
+{
+    for (unsigned col = 0; col < width; col++) {
+        uint64_t word = words[col];
+        float dcts[4] = {
+            dequantize_avg_brightness(Bitpack_getu(word, A_WIDTH, a_lsb)),
+            dequantize_dct(Bitpack_gets(word, B_WIDTH, b_lsb)),
+            dequantize_dct(Bitpack_gets(word, C_WIDTH, c_lsb)),
+            dequantize_dct(Bitpack_gets(word, D_WIDTH, d_lsb))
+        };
+        float y_vals[4];
+        dct_to_brightness(dcts, y_vals);
+        float cv[3] = {
+            0, Arith40_chroma_of_index(Bitpack_getu(word, PB_WIDTH, pb_lsb)),
+            Arith40_chroma_of_index(Bitpack_getu(word, PR_WIDTH, pr_lsb))
+        };
+        for (int k = 0; k < 4; k++) {
+            float rgb[3];
+            cv[0] = y_vals[k];
+            cv_to_rgb(cv, rgb);
+            for (int i = 0; i < 3; i++) {
+                rgb[i] = rgb[i] < 0 ? 0 : rgb[i] > 1 ? 1 : rgb[i];
+            }
+            struct Pnm_rgb pixel = unscale_rgb(rgb, DECOMPRESS_DENOMINATOR);
+            unsigned char *out = &(k < 2 ? top : bottom)[6 * col + 3 * (k % 2)];
+            out[0] = pixel.red;
+            out[1] = pixel.green;
+            out[2] = pixel.blue;
+        }
+    }
+}
+
+/*
+ *  Function:  check_decompress
+ *  Arguments: const char *input - the input the words are from
+ *             const uint32_t *words - width * height words, row-major
+ *             unsigned width, height - the size of the image in words
+ *  Does:      Checks that decompress_row, decompress_row_scalar and
+ *             decompress_row_be, and rgbtable40 with a cold and then a warm
+ *             table, decode the words to exactly the pixels of the
+ *             callback-based path.
+ *  Return:    void
+ */
+static void check_decompress(const char *input, const uint32_t *words,
+                             unsigned width, unsigned height)
+{
+    const char *names[] = {
+        "decompress_row", "decompress_row_scalar", "decompress_row_be",
+        "rgbtable40_decode_row (cold)", "rgbtable40_decode_row (warm)",
+        "rgbtable40_decode_row_be"
+    };
+    size_t count = (size_t)width * height;
+    size_t row_size = 12 * (size_t)width; /* two scanlines of 3 bytes */
+    unsigned char *bytes = malloc(4 * count);
+    unsigned char *expected = malloc(row_size * height);
+    unsigned char *actual = malloc(row_size * height);
+    assert(bytes != NULL && expected != NULL && actual != NULL);
+    for (size_t i = 0; i < count; i++) {
+        bytes[4 * i] = words[i] >> 24;
+        bytes[4 * i + 1] = words[i] >> 16;
+        bytes[4 * i + 2] = words[i] >> 8;
+        bytes[4 * i + 3] = words[i];
+    }
+    for (unsigned row = 0; row < height; row++) {
+        unsigned char *top = &expected[row * row_size];
+        reference_decompress_row(&words[(size_t)row * width], width, top,
+                                 top + row_size / 2);
+    }
+
+    Rgbtable40_T table = Rgbtable40_new();
+    for (size_t v = 0; v < sizeof(names) / sizeof(names[0]); v++) {
+        for (unsigned row = 0; row < height; row++) {
+            const uint32_t *row_words = &words[(size_t)row * width];
+            const unsigned char *row_bytes = &bytes[4 * (size_t)row * width];
+            unsigned char *top = &actual[row * row_size];
+            unsigned char *bottom = top + row_size / 2;
+            switch (v) {
+            case 0:
+                decompress_row(row_words, width, top, bottom);
+                break;
+            case 1:
+                decompress_row_scalar(row_words, width, top, bottom);
+                break;
+            case 2:
+                decompress_row_be(row_bytes, width, top, bottom);
+                break;
+            case 3:
+            case 4:
+                Rgbtable40_decode_row(table, row_words, width, top, bottom);
+                break;
+            default:
+                Rgbtable40_decode_row_be(table, row_bytes, width, top,
+                                         bottom);
+            }
+        }
+        check_same(input, names[v], expected, actual, row_size * height);
+    }
+    Rgbtable40_free(&table);
+    free(bytes);
+    free(expected);
+    free(actual);
+}
+
+/*
+ *  Function:  check_image
+ *  Arguments: struct Image *image - an input
+ *  Does:      Checks that compress_row, compress_row_scalar,
+ *             compress_row_raw and, for denominators that have one, the
+ *             callback-based path with cvtable40 compress the image to
+ *             exactly the words of the original callback-based path, then
+ *             checks the decompressors on those words.
+ *  Return:    void
+ */
+static void check_image(struct Image *image)
+{
+    const char *names[] = {
+        "callback path with cvtable40", "compress_row",
+        "compress_row_scalar", "compress_row_raw"
+    };
+    unsigned width = image->width / 2, height = image->height / 2;
+    size_t size = image->group_count * sizeof(uint32_t);
+    uint32_t *expected = malloc(size);
+    uint32_t *actual = malloc(size);
+    assert(expected != NULL && actual != NULL);
+    const Cvtable40 *cvtable = Cvtable40_get(image->denominator);
+    unsigned sample_bytes = image->denominator > 255 ? 2 : 1;
+    size_t stride = (size_t)image->width * 3 * sample_bytes;
+    for (unsigned row = 0; row < height; row++) {
+        const struct Pnm_rgb *top = &image->pixels[2 * (size_t)row *
+                                                   image->width];
+        reference_compress_row(top, top + image->width, width,
+                               image->denominator, NULL,
+                               &expected[(size_t)row * width]);
+    }
+
+    for (size_t v = cvtable != NULL ? 0 : 1;
+         v < sizeof(names) / sizeof(names[0]); v++) {
+        for (unsigned row = 0; row < height; row++) {
+            const struct Pnm_rgb *top = &image->pixels[2 * (size_t)row *
+                                                       image->width];
+            const struct Pnm_rgb *bottom = top + image->width;
+            const unsigned char *raw = &image->raster[2 * row * stride];
+            uint32_t *words = &actual[(size_t)row * width];
+            switch (v) {
+            case 0:
+                reference_compress_row(top, bottom, width,
+                                       image->denominator, cvtable, words);
+                break;
+            case 1:
+                compress_row(top, bottom, width, image->denominator, words);
+                break;
+            case 2:
+                compress_row_scalar(top, bottom, width, image->denominator,
+                                    words);
+                break;
+            default:
+                compress_row_raw(raw, raw + stride, width,
+                                 image->denominator, words);
+            }
+        }
+        check_same(image->name, names[v], expected, actual, size);
+    }
+
+    check_decompress(image->name, expected, width, height);
+    free(expected);
+    free(actual);
+}
+
+/*
+ *  Function:  check_random_words
+ *  Arguments: none
+ *  Does:      Checks the decompressors on an image of random words, each
+ *             holding any value its fields can take in a compressed file,
+ *             so that combinations no synthetic image compresses to, and
+ *             the words rgbtable40 cannot decode from its table, are
+ *             checked too.
+ *  Return:    void
+ */
+static void check_random_words(void)
+{
+    uint32_t words[RANDOM_WIDTH * RANDOM_HEIGHT];
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < RANDOM_WIDTH * RANDOM_HEIGHT; i++) {
+        unsigned a = xorshift(&state) % (1u << A_WIDTH);
+        int dct[3];
+        for (int k = 0; k < 3; k++) {
+            dct[k] = (int)(xorshift(&state) % (2 * BITPACK40_MAX_DCT + 1)) -
+                     BITPACK40_MAX_DCT;
+        }
+        unsigned pb = xorshift(&state) % (1u << PB_WIDTH);
+        unsigned pr = xorshift(&state) % (1u << PR_WIDTH);
+        words[i] = Bitpack40_pack(a, dct[0], dct[1], dct[2], pb, pr);
+    }
+    check_decompress("random words", words, RANDOM_WIDTH, RANDOM_HEIGHT);
+}
+
+/*****************************************************************************
+ *                                  Driver
+ *****************************************************************************/
+
+/*
+ *  Function:  bench_image
+ *  Arguments: struct Image *image - an input
+ *  Does:      Runs every benchmark on one input.
+ *  Return:    void
+ */
+static void bench_image(struct Image *image)
+{
+    /* whole codec, one entry per storage variant and mode */
+    struct {
+        const char *name;
+        struct Codec40_opts opts;
+    } modes[] = {
+        { "blocked", { .threads = 1 } },
+        { "morton", { .threads = 1, .methods = uarray2_methods_morton } },
+        { "plain", { .threads = 1, .methods = uarray2_methods_plain } },
+        { "fused", { .fused = true, .threads = 1 } },
+        { "fixed", { .fixed_point = true, .threads = 1 } },
+        { "table", { .rgb_table = true, .threads = 1 } },
+        { "streaming", { .streaming = true, .threads = 1 } },
+        { "pipelined", { .pipelined = true, .threads = 1 } },
+        { "threads", { .threads = bench.threads } }
+    };
+    char name[64];
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        struct Codec40_opts *opts = &modes[i].opts;
+        /* compressing needs block-major maps and has no table */
+        bool compress = !opts->rgb_table &&
+                        opts->methods != uarray2_methods_plain;
+        if (compress) {
+            snprintf(name, sizeof(name), "compress/%s", modes[i].name);
+            run(image, "codec", name, bench_compress, opts);
+        }
+        snprintf(name, sizeof(name), "decompress/%s", modes[i].name);
+        run(image, "codec", name, bench_decompress, opts);
+    }
+    /* the in-place paths turn down some inputs, which are left out */
+    struct Codec40_opts inplace = { .fused = true, .threads = 1 };
+    if (compress40_inplace(image->ppm, image->ppm_size, &inplace)) {
+        run(image, "codec", "compress/inplace", bench_compress_inplace,
+            &inplace);
+    }
+    if (decompress40_inplace(image->compressed, image->compressed_size,
+                             &inplace)) {
+        run(image, "codec", "decompress/inplace", bench_decompress_inplace,
+            &inplace);
+    }
+    struct {
+        const char *name;
+        bool compress, rgb_table;
+    } contexts[] = {
+        { "compress/context", true, false },
+        { "decompress/context", false, false },
+        { "decompress/context-table", false, true }
+    };
+    for (size_t i = 0; i < sizeof(contexts) / sizeof(contexts[0]); i++) {
+        Context40_T context = Context40_new(false, contexts[i].rgb_table);
+        run(image, "codec", contexts[i].name,
+            contexts[i].compress ? bench_compress_context
+                                 : bench_decompress_context, context);
+        /* every call after the warm-up should have reused the buffers */
+        assert(Context40_stats_get(context).allocations <=
+               1u + contexts[i].rgb_table);
+        Context40_free(&context);
+    }
+    struct Codec40_opts in_region = { .fused = true, .threads = 1,
+                                      .region = Region40_new(0) };
+    run(image, "codec", "compress/region", bench_compress_region,
+        &in_region);
+    run(image, "codec", "decompress/region", bench_decompress_region,
+        &in_region);
+    /* only the warm-ups take chunks from the heap: one for compressing,
+       up to two more when decompressing first spills past it, and the one
+       the reset after that coalesces them into */
+    assert(Region40_stats_get(in_region.region).chunks <= 4);
+    Region40_free(&in_region.region);
+
+    /* stages of the callback-based path, in order, so each one reads what
+       the previous one wrote */
+    run(image, "stage", "scale_rgb", bench_scale_rgb, NULL);
+    run(image, "stage", "rgb_to_cv", bench_rgb_to_cv, NULL);
+    run(image, "stage", "pix_to_dct", bench_pix_to_dct, NULL);
+    bool use_tables = false;
+    run(image, "stage", "quantize/arith40", bench_quantize, &use_tables);
+    use_tables = true;
+    run(image, "stage", "quantize/chroma40", bench_quantize, &use_tables);
+    run(image, "stage", "bitpack/generic", bench_pack_generic, NULL);
+    run(image, "stage", "bitpack/fixed", bench_pack_fixed, NULL);
+    run(image, "stage", "bitpack/bulk", bench_pack_bulk, NULL);
+    run(image, "stage", "unpack/generic", bench_unpack_generic, NULL);
+    run(image, "stage", "unpack/fixed", bench_unpack_fixed, NULL);
+    run(image, "stage", "unpack/bulk", bench_unpack_bulk, NULL);
+    run(image, "stage", "dequantize", bench_dequantize, NULL);
+    run(image, "stage", "dct_to_brightness", bench_dct_to_brightness, NULL);
+    run(image, "stage", "cv_to_rgb", bench_cv_to_rgb, NULL);
+    run(image, "stage", "unscale_rgb", bench_unscale_rgb, NULL);
+
+    /* fused row kernels; the decompressors read the words the last
+       compressor wrote */
+    struct Compress_kernel compressors[] = {
+        { compress_row }, { compress_row_scalar }, { compress_row_fixed }
+    };
+    const char *compressor_names[] = {
+        "compress_row", "compress_row_scalar", "compress_row_fixed"
+    };
+    for (int i = 0; i < 3; i++) {
+        run(image, "row", compressor_names[i], bench_compress_rows,
+            &compressors[i]);
+    }
+    struct Decompress_kernel decompressors[] = {
+        { decompress_row }, { decompress_row_scalar },
+        { decompress_row_fixed }
+    };
+    const char *decompressor_names[] = {
+        "decompress_row", "decompress_row_scalar", "decompress_row_fixed"
+    };
+    for (int i = 0; i < 3; i++) {
+        run(image, "row", decompressor_names[i], bench_decompress_rows,
+            &decompressors[i]);
+    }
+    Rgbtable40_T table = Rgbtable40_new();
+    run(image, "row", "rgbtable40_decode_row", bench_decompress_table,
+        table);
+    Rgbtable40_free(&table);
+
+    /* A2 storage variants */
+    bench_a2(image, "plain", uarray2_methods_plain);
+    bench_a2(image, "blocked", uarray2_methods_blocked);
+    bench_a2(image, "morton", uarray2_methods_morton);
+}
+
+/*
+ *  Function:  process_image
+ *  Arguments: struct Image *image - an input
+ *             bool check_only - whether to skip the benchmarks
+ *  Does:      Checks the input, so that no result is reported for a kernel
+ *             whose output is wrong, and then benchmarks it.
+ *  Return:    void
+ */
+static void process_image(struct Image *image, bool check_only)
+{
+    fprintf(stderr, "%s (%ux%u, denominator %u)\n", image->name,
+            image->width, image->height, image->denominator);
+    check_image(image);
+    if (!check_only) {
+        bench_image(image);
+    }
+}
+
+/*
+ *  Function:  write_json_string
+ *  Arguments: FILE *fp - the output
+ *             const char *string - a string, such as a file name
+ *  Does:      Writes a string as a JSON string literal.
+ *  Return:    void
+ */
+static void write_json_string(FILE *fp, const char *string)
+{
+    fputc('"', fp);
+    for (const unsigned char *c = (const unsigned char *)string; *c != '\0';
+         c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(fp, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(fp, "\\u%04x", *c);
+        } else {
+            fputc(*c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/*
+ *  Function:  write_json
+ *  Arguments: const char *path - the file to write
+ *  Does:      Writes the configuration and every result as JSON: an object
+ *             with "reps", "threads" and a "results" array holding one
+ *             object per benchmark and input.
+ *  Return:    void
+ */
+static void write_json(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "bench40: cannot write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(fp, "{\n  \"reps\": %u,\n  \"threads\": %u,\n  \"results\": [",
+            bench.reps, bench.threads);
+    for (size_t i = 0; i < bench.count; i++) {
+        struct Result *result = &bench.results[i];
+        double pixels = (double)result->width * result->height;
+        fprintf(fp, "%s\n    {\"input\": ", i == 0 ? "" : ",");
+        write_json_string(fp, result->input);
+        fprintf(fp, ", \"width\": %u, \"height\": %u, \"group\": ",
+                result->width, result->height);
+        write_json_string(fp, result->group);
+        fprintf(fp, ", \"name\": ");
+        write_json_string(fp, result->name);
+        fprintf(fp, ",\n     \"ns_per_pixel\": %.4f, \"mb_per_s\": %.2f, "
+                "\"best_s\": %.9f, \"median_s\": %.9f}",
+                result->best * 1e9 / pixels, pixels * 3 / result->best / 1e6,
+                result->best, result->median);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+}
+
+/*
+ *  Function:  bench_corpus
+ *  Arguments: const char *dir - a directory
+ *             bool check_only - whether to skip the benchmarks
+ *  Does:      Checks, and unless check_only runs every benchmark on, each
+ *             file in dir whose name ends in .ppm, skipping those that
+ *             cannot be used.
+ *  Return:    void
+ */
+static void bench_corpus(const char *dir, bool check_only)
+{
+    DIR *dp = opendir(dir);
+    if (dp == NULL) {
+        fprintf(stderr, "bench40: cannot open directory %s\n", dir);
+        exit(EXIT_FAILURE);
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < 4 || strcmp(&entry->d_name[length - 4], ".ppm") != 0) {
+            continue;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct Image image = { .pixels = NULL };
+        if (!image_from_file(&image, path)) {
+            fprintf(stderr, "bench40: skipping %s\n", path);
+            continue;
+        }
+        process_image(&image, check_only);
+        image_free(&image);
+    }
+    closedir(dp);
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-k] [-s WIDTHxHEIGHT]... [-c corpus-dir] "
+            "[-r reps] [-j threads] [-o results.json]\n"
+            "  -k: only check that the kernels agree bit for bit, with "
+            "synthetic images\n"
+            "      of denominators 255, 100 and 65535, and time nothing\n"
+            "  -s: size of the synthetic images (may be repeated; "
+            "default 640x480 and 1920x1080)\n"
+            "  -c: also check and time every .ppm file in a directory\n"
+            "  -r: timed runs of each benchmark (default %d)\n"
+            "  -j: threads of the multithreaded codec runs (default %d)\n"
+            "  -o: file to write the results to (default %s)\n",
+            progname, DEFAULT_REPS, DEFAULT_THREADS, DEFAULT_OUTPUT);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned widths[MAX_SIZES], heights[MAX_SIZES];
+    unsigned sizes = 0;
+    const char *corpus = NULL;
+    const char *output = DEFAULT_OUTPUT;
+    bool check_only = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0) {
+            check_only = true;
+            continue;
+        }
+        if (i + 1 == argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage(argv[0]);
+        }
+        const char *arg = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 's':
+            if (sizes == MAX_SIZES ||
+                sscanf(arg, "%ux%u", &widths[sizes], &heights[sizes]) != 2 ||
+                widths[sizes] < 2 || heights[sizes] < 2) {
+                usage(argv[0]);
+            }
+            sizes++;
+            break;
+        case 'c':
+            corpus = arg;
+            break;
+        case 'r':
+            if (sscanf(arg, "%u", &bench.reps) != 1 || bench.reps == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'j':
+            if (sscanf(arg, "%u", &bench.threads) != 1 ||
+                bench.threads == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'o':
+            output = arg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (sizes == 0) {
+        widths[0] = 640;
+        heights[0] = 480;
+        widths[1] = 1920;
+        heights[1] = 1080;
+        sizes = 2;
+    }
+
+    /* the codec writes its output to stdout */
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "bench40: cannot open /dev/null\n");
+        exit(EXIT_FAILURE);
+    }
+
+    check_bitpack();
+    check_chroma();
+    check_random_words();
+    /* benchmarks use the usual denominator only */
+    size_t denominators = check_only ? sizeof(check_denominators) /
+                                       sizeof(check_denominators[0]) : 1;
+    for (unsigned i = 0; i < sizes; i++) {
+        for (size_t d = 0; d < denominators; d++) {
+            for (int noisy = 0; noisy <= 1; noisy++) {
+                struct Image image = { .pixels = NULL };
+                image_synthetic(&image, widths[i], heights[i], noisy,
+                                check_denominators[d]);
+                process_image(&image, check_only);
+                image_free(&image);
+            }
+        }
+    }
+    if (corpus != NULL) {
+        bench_corpus(corpus, check_only);
+    }
+
+    if (!check_only) {
+        write_json(output);
+        fprintf(stderr, "%zu results written to %s\n", bench.count,
+                output);
+    }
+    free(bench.results);
+    if (bench.mismatches > 0) {
+        fprintf(stderr, "bench40: %zu mismatches\n", bench.mismatches);
+        return EXIT_FAILURE;
+    }
+    if (check_only) {
+        fprintf(stderr, "every kernel agrees with its reference\n");
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/******************************************************************************
+ *
+ *                               bitpack40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the bulk functions of the bitpack40.h interface, which
+ *     pack and unpack arrays of compressed words held in columnar form (one
+ *     array per field). The scalar versions loop over Bitpack40_pack and
+ *     friends; on processors with AVX2 the dispatching versions handle 8
+ *     words per iteration with the register-level helpers in bitpack40.h
+ *     and finish any leftover words with the scalar loop.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+
+#include "assert.h"
+
+#include "bitpack40.h"
+
+/* Number of words handled per iteration of the AVX2 loops */
+#define AVX2_WORDS 8
+
+/*
+ *  Function:  Bitpack40_pack_n_scalar
+ *  Arguments: size_t n - the number of words to pack
+ *             Bitpack40_columns fields - n values of each field
+ *             uint32_t *words - filled in with the n packed words
+ *  Does:      Packs n words one at a time.
+ *  Return:    void
+ */
+void Bitpack40_pack_n_scalar(size_t n, Bitpack40_columns fields,
+                             uint32_t *words)
+{
+    assert(n == 0 || words != NULL);
+    for (size_t i = 0; i < n; i++) {
+        words[i] = Bitpack40_pack(fields.a[i], fields.b[i], fields.c[i],
+                                  fields.d[i], fields.pb[i], fields.pr[i]);
+    }
+}
+
+/*
+ *  Function:  Bitpack40_unpack_n_scalar
+ *  Arguments: size_t n - the number of words to unpack
+ *             const uint32_t *words - the words
+ *             Bitpack40_columns fields - filled in with n values of each
+ *                                        field
+ *  Does:      Unpacks n words one at a time.
+ *  Return:    void
+ */
+void Bitpack40_unpack_n_scalar(size_t n, const uint32_t *words,
+                               Bitpack40_columns fields)
+{
+    assert(n == 0 || words != NULL);
+    for (size_t i = 0; i < n; i++) {
+        Bitpack40_fields word = Bitpack40_unpack(words[i]);
+        fields.a[i] = word.a;
+        fields.b[i] = word.b;
+        fields.c[i] = word.c;
+        fields.d[i] = word.d;
+        fields.pb[i] = word.pb;
+        fields.pr[i] = word.pr;
+    }
+}
+
+#ifdef CPUFEATURES_X86
+
+/* Loads and stores of 8 lanes of a field array */
+#define LOAD8(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define STORE8(p, v)  _mm256_storeu_si256((__m256i *)(p), (v))
+
+TARGET_AVX2
+static size_t pack_n_avx2(size_t n, Bitpack40_columns f, uint32_t *words)
+{
+    size_t i = 0;
+    for (; i + AVX2_WORDS <= n; i += AVX2_WORDS) {
+        STORE8(&words[i], Bitpack40_pack_avx2(LOAD8(&f.a[i]), LOAD8(&f.b[i]),
+                                              LOAD8(&f.c[i]), LOAD8(&f.d[i]),
+                                              LOAD8(&f.pb[i]),
+                                              LOAD8(&f.pr[i])));
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t unpack_n_avx2(size_t n, const uint32_t *words,
+                            Bitpack40_columns f)
+{
+    size_t i = 0;
+    for (; i + AVX2_WORDS <= n; i += AVX2_WORDS) {
+        __m256i w = LOAD8(&words[i]);
+        STORE8(&f.a[i], Bitpack40_get_unsigned_avx2(w, A_WIDTH, a_lsb));
+        STORE8(&f.b[i], Bitpack40_get_signed_avx2(w, B_WIDTH, b_lsb));
+        STORE8(&f.c[i], Bitpack40_get_signed_avx2(w, C_WIDTH, c_lsb));
+        STORE8(&f.d[i], Bitpack40_get_signed_avx2(w, D_WIDTH, d_lsb));
+        STORE8(&f.pb[i], Bitpack40_get_unsigned_avx2(w, PB_WIDTH, pb_lsb));
+        STORE8(&f.pr[i], Bitpack40_get_unsigned_avx2(w, PR_WIDTH, pr_lsb));
+    }
+    return i;
+}
+
+#endif
+
+/*
+ *  Function:  Bitpack40_pack_n
+ *  Arguments: see Bitpack40_pack_n_scalar
+ *  Does:      Packs n words with the fastest implementation the processor
+ *             supports.
+ *  Return:    void
+ */
+void Bitpack40_pack_n(size_t n, Bitpack40_columns fields, uint32_t *words)
+{
+    size_t done = 0;
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        done = pack_n_avx2(n, fields, words);
+    }
+#endif
+    Bitpack40_columns rest = { fields.a + done, fields.b + done,
+                               fields.c + done, fields.d + done,
+                               fields.pb + done, fields.pr + done };
+    Bitpack40_pack_n_scalar(n - done, rest, words + done);
+}
+
+/*
+ *  Function:  Bitpack40_unpack_n
+ *  Arguments: see Bitpack40_unpack_n_scalar
+ *  Does:      Unpacks n words with the fastest implementation the
+ *             processor supports.
+ *  Return:    void
+ */
+void Bitpack40_unpack_n(size_t n, const uint32_t *words,
+                        Bitpack40_columns fields)
+{
+    size_t done = 0;
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        done = unpack_n_avx2(n, words, fields);
+    }
+#endif
+    Bitpack40_columns rest = { fields.a + done, fields.b + done,
+                               fields.c + done, fields.d + done,
+                               fields.pb + done, fields.pr + done };
+    Bitpack40_unpack_n_scalar(n - done, words + done, rest);
+}
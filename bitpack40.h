@@ -0,0 +1,239 @@
+/******************************************************************************
+ *
+ *                               bitpack40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Inline pack and unpack functions specialized for the fixed layout of
+ *     a compressed word (see compressinfo.h). Every width and least
+ *     significant bit is a compile-time constant, so each field is a shift
+ *     and a mask, and signed fields are sign extended with a pair of
+ *     shifts, with none of the generic Bitpack checks or exceptions.
+ *
+ *     Field values out of range are a checked run-time error, but the
+ *     checks are asserts, which are compiled out when NDEBUG is defined;
+ *     in such a build an out-of-range value silently corrupts its
+ *     neighbouring fields. The codec only packs values that are in range
+ *     by construction.
+ *
+ *     The bulk functions (see bitpack40.c) pack and unpack whole arrays of
+ *     words held as one array per field, with an AVX2 implementation that
+ *     handles 8 words per instruction. The register-level AVX2 helpers
+ *     below are the primitive shared by the bulk functions and the SIMD
+ *     row kernels.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assert.h"
+
+#include "compressinfo.h"
+#include "cpufeatures.h"
+#include "wordio.h"
+
+#ifndef BITPACK40_H
+#define BITPACK40_H
+
+/* The six fields of a compressed word */
+typedef struct Bitpack40_fields {
+    unsigned a;      /* quantized average brightness, A_WIDTH bits */
+    int b, c, d;     /* quantized DCT coefficients, signed */
+    unsigned pb, pr; /* chroma indices */
+} Bitpack40_fields;
+
+/* The fields of n words, one array of n values per field */
+typedef struct Bitpack40_columns {
+    unsigned *a;
+    int *b, *c, *d;
+    unsigned *pb, *pr;
+} Bitpack40_columns;
+
+/* Bulk operations; the _scalar versions are the portable reference for the
+   dispatching ones */
+extern void Bitpack40_pack_n  (size_t n, Bitpack40_columns fields,
+                               uint32_t *words);
+extern void Bitpack40_unpack_n(size_t n, const uint32_t *words,
+                               Bitpack40_columns fields);
+extern void Bitpack40_pack_n_scalar  (size_t n, Bitpack40_columns fields,
+                                      uint32_t *words);
+extern void Bitpack40_unpack_n_scalar(size_t n, const uint32_t *words,
+                                      Bitpack40_columns fields);
+
+/* Largest magnitude of a quantized DCT coefficient in a valid word */
+#define BITPACK40_MAX_DCT 15
+
+/* Mask of the low width bits */
+#define BITPACK40_MASK(width) ((UINT32_C(1) << (width)) - 1)
+
+/*
+ *  Function:  Bitpack40_get_unsigned / Bitpack40_get_signed
+ *  Arguments: uint32_t word - a compressed word
+ *             unsigned width, lsb - the layout of one field (constants from
+ *                                   compressinfo.h)
+ *  Does:      Extracts one field, sign extending a signed field by shifting
+ *             it to the top of the word and arithmetically back down.
+ *  Return:    the value of the field
+ */
+static inline unsigned Bitpack40_get_unsigned(uint32_t word, unsigned width,
+                                              unsigned lsb)
+{
+    return (word >> lsb) & BITPACK40_MASK(width);
+}
+
+static inline int Bitpack40_get_signed(uint32_t word, unsigned width,
+                                       unsigned lsb)
+{
+    return (int32_t)(word << (32 - width - lsb)) >> (32 - width);
+}
+
+/*
+ *  Function:  Bitpack40_pack
+ *  Arguments: unsigned a - quantized average brightness
+ *             int b, c, d - quantized DCT coefficients
+ *             unsigned pb, pr - chroma indices
+ *  Does:      Packs the six fields of a pixel group into a word, exactly
+ *             as the corresponding Bitpack_newu/Bitpack_news calls would.
+ *  Return:    uint32_t - the packed word
+ */
+static inline uint32_t Bitpack40_pack(unsigned a, int b, int c, int d,
+                                      unsigned pb, unsigned pr)
+{
+    assert(a <= BITPACK40_MASK(A_WIDTH));
+    assert(b >= -(1 << (B_WIDTH - 1)) && b < (1 << (B_WIDTH - 1)));
+    assert(c >= -(1 << (C_WIDTH - 1)) && c < (1 << (C_WIDTH - 1)));
+    assert(d >= -(1 << (D_WIDTH - 1)) && d < (1 << (D_WIDTH - 1)));
+    assert(pb <= BITPACK40_MASK(PB_WIDTH) && pr <= BITPACK40_MASK(PR_WIDTH));
+    return (uint32_t)a << a_lsb |
+           ((uint32_t)b & BITPACK40_MASK(B_WIDTH)) << b_lsb |
+           ((uint32_t)c & BITPACK40_MASK(C_WIDTH)) << c_lsb |
+           ((uint32_t)d & BITPACK40_MASK(D_WIDTH)) << d_lsb |
+           (uint32_t)pb << pb_lsb |
+           (uint32_t)pr << pr_lsb;
+}
+
+/*
+ *  Function:  Bitpack40_unpack
+ *  Arguments: uint32_t word - a compressed word
+ *  Does:      Extracts all six fields of a word.
+ *  Return:    Bitpack40_fields - the fields
+ */
+static inline Bitpack40_fields Bitpack40_unpack(uint32_t word)
+{
+    Bitpack40_fields fields = {
+        .a = Bitpack40_get_unsigned(word, A_WIDTH, a_lsb),
+        .b = Bitpack40_get_signed(word, B_WIDTH, b_lsb),
+        .c = Bitpack40_get_signed(word, C_WIDTH, c_lsb),
+        .d = Bitpack40_get_signed(word, D_WIDTH, d_lsb),
+        .pb = Bitpack40_get_unsigned(word, PB_WIDTH, pb_lsb),
+        .pr = Bitpack40_get_unsigned(word, PR_WIDTH, pr_lsb)
+    };
+    return fields;
+}
+
+/*
+ *  Function:  Bitpack40_valid / Bitpack40_valid_row
+ *  Arguments: uint32_t word - a compressed word
+ *             const void *words - a row of words, as for load_word
+ *             size_t n - the number of words in the row
+ *             bool big_endian - whether the row holds big endian bytes
+ *  Does:      Checks that the DCT coefficients b, c and d of a word, or of
+ *             every word of a row, are within +-BITPACK40_MAX_DCT, the
+ *             only values the compressor writes and dequantize_dct
+ *             accepts. The fields have room for larger ones, which only a
+ *             corrupt file holds. The row is checked without branching on
+ *             each word, so the loop vectorizes.
+ *  Return:    bool - true if every coefficient is in range
+ */
+static inline bool Bitpack40_valid(uint32_t word)
+{
+    unsigned b = Bitpack40_get_signed(word, B_WIDTH, b_lsb) +
+                 BITPACK40_MAX_DCT;
+    unsigned c = Bitpack40_get_signed(word, C_WIDTH, c_lsb) +
+                 BITPACK40_MAX_DCT;
+    unsigned d = Bitpack40_get_signed(word, D_WIDTH, d_lsb) +
+                 BITPACK40_MAX_DCT;
+    return (b <= 2 * BITPACK40_MAX_DCT) & (c <= 2 * BITPACK40_MAX_DCT) &
+           (d <= 2 * BITPACK40_MAX_DCT);
+}
+
+static inline bool Bitpack40_valid_row(const void *words, size_t n,
+                                       bool big_endian)
+{
+    bool valid = true;
+    for (size_t i = 0; i < n; i++) {
+        valid &= Bitpack40_valid(load_word(words, i, big_endian));
+    }
+    return valid;
+}
+
+#ifdef CPUFEATURES_X86
+
+/*
+ *  Function:  Bitpack40_get_unsigned_avx2 / Bitpack40_get_signed_avx2
+ *  Arguments: __m256i words - 8 compressed words
+ *             int width, lsb - the layout of one field
+ *  Does:      Extracts one field from each of 8 words, sign extending a
+ *             signed field with a left shift and an arithmetic right shift.
+ *  Return:    __m256i - the 8 field values
+ */
+TARGET_AVX2
+static inline __m256i Bitpack40_get_unsigned_avx2(__m256i words, int width,
+                                                  int lsb)
+{
+    return _mm256_and_si256(_mm256_srl_epi32(words, _mm_cvtsi32_si128(lsb)),
+                            _mm256_set1_epi32(BITPACK40_MASK(width)));
+}
+
+TARGET_AVX2
+static inline __m256i Bitpack40_get_signed_avx2(__m256i words, int width,
+                                                int lsb)
+{
+    __m256i high = _mm256_sll_epi32(words,
+                                    _mm_cvtsi32_si128(32 - width - lsb));
+    return _mm256_sra_epi32(high, _mm_cvtsi32_si128(32 - width));
+}
+
+/*
+ *  Function:  Bitpack40_put_avx2
+ *  Arguments: __m256i value - 8 field values, which must fit in width bits
+ *                             (signed values are truncated to width bits)
+ *             int width, lsb - the layout of the field
+ *  Does:      Positions the low width bits of each value at lsb.
+ *  Return:    __m256i - the 8 positioned fields, to be ORed into words
+ */
+TARGET_AVX2
+static inline __m256i Bitpack40_put_avx2(__m256i value, int width, int lsb)
+{
+    return _mm256_sll_epi32(
+        _mm256_and_si256(value, _mm256_set1_epi32(BITPACK40_MASK(width))),
+        _mm_cvtsi32_si128(lsb));
+}
+
+/*
+ *  Function:  Bitpack40_pack_avx2
+ *  Arguments: __m256i a, b, c, d, pb, pr - the fields of 8 words
+ *  Does:      Vector version of Bitpack40_pack.
+ *  Return:    __m256i - the 8 packed words
+ */
+TARGET_AVX2
+static inline __m256i Bitpack40_pack_avx2(__m256i a, __m256i b, __m256i c,
+                                          __m256i d, __m256i pb, __m256i pr)
+{
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(Bitpack40_put_avx2(a, A_WIDTH, a_lsb),
+                                        Bitpack40_put_avx2(b, B_WIDTH, b_lsb)),
+                        _mm256_or_si256(Bitpack40_put_avx2(c, C_WIDTH, c_lsb),
+                                        Bitpack40_put_avx2(d, D_WIDTH,
+                                                           d_lsb))),
+        _mm256_or_si256(Bitpack40_put_avx2(pb, PB_WIDTH, pb_lsb),
+                        Bitpack40_put_avx2(pr, PR_WIDTH, pr_lsb)));
+}
+
+#endif
+
+#endif
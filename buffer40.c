@@ -0,0 +1,304 @@
+/******************************************************************************
+ *
+ *                                 buffer40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the buffer40.h interface on top of the fused row kernels,
+ *     which already work on caller-provided scanlines and words. Every
+ *     argument is checked before the first row is coded, including that
+ *     each buffer is large enough, with the size arithmetic guarded
+ *     against overflow; after that the kernels cannot fail. The results are
+ *     exactly those of compress40 and decompress40 with the same choice of
+ *     fixed point (40image -i).
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "buffer40.h"
+#include "bitpack40.h"
+#include "compressrow.h"
+#include "decompressrow.h"
+#include "fixedrow.h"
+
+/* Static function declarations */
+static Buffer40_status check_raster(size_t stride, unsigned width,
+                                    unsigned height, unsigned sample_bytes,
+                                    size_t size);
+
+/*
+ *  Function:  Buffer40_message
+ *  Arguments: Buffer40_status status - a status returned by this interface
+ *  Does:      Describes a status in words.
+ *  Return:    const char * - a static string
+ */
+const char *Buffer40_message(Buffer40_status status)
+{
+    switch (status) {
+    case BUFFER40_OK:
+        return "success";
+    case BUFFER40_NULL_ARGUMENT:
+        return "a required pointer is NULL";
+    case BUFFER40_BAD_DIMENSIONS:
+        return "invalid image dimensions";
+    case BUFFER40_BAD_DENOMINATOR:
+        return "invalid denominator";
+    case BUFFER40_BAD_STRIDE:
+        return "row stride shorter than a row";
+    case BUFFER40_NO_SPACE:
+        return "output buffer too small";
+    case BUFFER40_BAD_FORMAT:
+        return "invalid compressed image file";
+    case BUFFER40_TRUNCATED:
+        return "compressed image file is truncated";
+    case BUFFER40_NO_MEMORY:
+        return "out of memory";
+    }
+    return "unknown status";
+}
+
+/*
+ *  Function:  check_raster
+ *  Arguments: size_t stride - bytes from the start of one row to the next
+ *             unsigned width, height - the raster's size in pixels
+ *             unsigned sample_bytes - bytes per sample, 1 or 2
+ *             size_t size - bytes in the buffer holding the raster
+ *  Does:      Checks that height rows of width pixels, stride bytes apart,
+ *             fit in size bytes. The last row need only be width pixels
+ *             long, so a tightly packed image needs no padding after it.
+ *  Return:    Buffer40_status - BUFFER40_OK if they fit
+ */
+static Buffer40_status check_raster(size_t stride, unsigned width,
+                                    unsigned height, unsigned sample_bytes,
+                                    size_t size)
+{
+    if (width > SIZE_MAX / 3 / sample_bytes) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    size_t row = (size_t)width * 3 * sample_bytes;
+    if (stride < row) {
+        return BUFFER40_BAD_STRIDE;
+    }
+    if (height - 1 > (SIZE_MAX - row) / stride) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    if ((size_t)(height - 1) * stride + row > size) {
+        return BUFFER40_NO_SPACE;
+    }
+    return BUFFER40_OK;
+}
+
+/*
+ *  Function:  Buffer40_compress
+ *  Arguments: const unsigned char *pixels - the raster of a PPM image
+ *             size_t stride - bytes from the start of one row of pixels to
+ *                             the next
+ *             size_t size - bytes in pixels
+ *             unsigned width, height - the image's size in pixels, at least
+ *                                      2 each; an odd last row or column is
+ *                                      dropped, as by compress40
+ *             unsigned denominator - the image's denominator, 1 to 65535,
+ *                                    which also sets the sample size
+ *             bool fixed_point - whether to use the fixed-point kernels
+ *             uint32_t *words - filled with the (width / 2) * (height / 2)
+ *                               compressed words, row-major
+ *             size_t capacity - the number of words words can hold
+ *  Does:      Compresses an image from memory into memory. The pixel
+ *             buffer must hold the rows that are compressed, the last of
+ *             which need only be width pixels long.
+ *  Return:    Buffer40_status - BUFFER40_OK, or why nothing was done
+ */
+Buffer40_status Buffer40_compress(const unsigned char *pixels, size_t stride,
+                                  size_t size, unsigned width, unsigned height,
+                                  unsigned denominator, bool fixed_point,
+                                  uint32_t *words, size_t capacity)
+{
+    if (pixels == NULL || words == NULL) {
+        return BUFFER40_NULL_ARGUMENT;
+    }
+    if (width < 2 || height < 2) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    if (denominator == 0 || denominator > 65535) {
+        return BUFFER40_BAD_DENOMINATOR;
+    }
+    unsigned groups_wide = width / 2, groups_high = height / 2;
+    if ((size_t)groups_wide > SIZE_MAX / groups_high) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    if ((size_t)groups_wide * groups_high > capacity) {
+        return BUFFER40_NO_SPACE;
+    }
+    /* only the rows that are compressed need to be present */
+    Buffer40_status status = check_raster(stride, width, groups_high * 2,
+                                          denominator > 255 ? 2 : 1, size);
+    if (status != BUFFER40_OK) {
+        return status;
+    }
+
+    for (unsigned row = 0; row < groups_high; row++) {
+        const unsigned char *top = &pixels[stride * 2 * row];
+        (fixed_point ? compress_row_raw_fixed : compress_row_raw)(
+            top, top + stride, groups_wide, denominator,
+            &words[(size_t)row * groups_wide]);
+    }
+    return BUFFER40_OK;
+}
+
+/*
+ *  Function:  Buffer40_decompress
+ *  Arguments: const uint32_t *words - width * height compressed words,
+ *                                     row-major
+ *             unsigned width, height - the compressed image's size in
+ *                                      words, at least 1 each
+ *             bool fixed_point - whether to use the fixed-point kernels
+ *             unsigned char *pixels - filled with the raster of the
+ *                                     (2 * width) x (2 * height) image, one
+ *                                     byte per sample (a denominator of 255)
+ *             size_t stride - bytes from the start of one row of pixels to
+ *                             the next, at least 6 * width; bytes between
+ *                             the end of a row and the next are untouched
+ *             size_t size - bytes in pixels
+ *  Does:      Decompresses an image from memory into memory, after
+ *             checking every word (see Bitpack40_valid).
+ *  Return:    Buffer40_status - BUFFER40_OK, BUFFER40_BAD_FORMAT for a
+ *             word with a coefficient out of range, or why nothing was done
+ */
+Buffer40_status Buffer40_decompress(const uint32_t *words, unsigned width,
+                                    unsigned height, bool fixed_point,
+                                    unsigned char *pixels, size_t stride,
+                                    size_t size)
+{
+    if (words == NULL || pixels == NULL) {
+        return BUFFER40_NULL_ARGUMENT;
+    }
+    if (width == 0 || height == 0 || width > UINT_MAX / 2 ||
+        height > UINT_MAX / 2) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    Buffer40_status status = check_raster(stride, width * 2, height * 2, 1,
+                                          size);
+    if (status != BUFFER40_OK) {
+        return status;
+    }
+
+    for (unsigned row = 0; row < height; row++) {
+        if (!Bitpack40_valid_row(&words[(size_t)row * width], width,
+                                 false)) {
+            return BUFFER40_BAD_FORMAT;
+        }
+    }
+    for (unsigned row = 0; row < height; row++) {
+        unsigned char *top = &pixels[stride * 2 * row];
+        (fixed_point ? decompress_row_fixed : decompress_row)(
+            &words[(size_t)row * width], width, top, top + stride);
+    }
+    return BUFFER40_OK;
+}
+
+/*
+ *  Function:  Buffer40_parse
+ *  Arguments: const unsigned char *data - a whole compressed image file
+ *             size_t size - the number of bytes in data
+ *             unsigned *width, *height - set to the image's size in words
+ *             const unsigned char **words - set to the first of its big
+ *                                           endian words within data
+ *  Does:      Parses the header of a compressed image file, which is
+ *             BUFFER40_MAGIC, a newline, the width and height in decimal
+ *             separated by a space, and a newline, and checks that every
+ *             word follows it. Bytes after the last word are ignored.
+ *  Return:    Buffer40_status - BUFFER40_OK, BUFFER40_BAD_FORMAT (also for
+ *             a width or height of 0), BUFFER40_TRUNCATED or
+ *             BUFFER40_NULL_ARGUMENT; the outputs are set only on success
+ */
+Buffer40_status Buffer40_parse(const unsigned char *data, size_t size,
+                               unsigned *width, unsigned *height,
+                               const unsigned char **words)
+{
+    if (data == NULL || width == NULL || height == NULL || words == NULL) {
+        return BUFFER40_NULL_ARGUMENT;
+    }
+    size_t magic = strlen(BUFFER40_MAGIC);
+    if (size <= magic || memcmp(data, BUFFER40_MAGIC, magic) != 0 ||
+        data[magic] != '\n') {
+        return BUFFER40_BAD_FORMAT;
+    }
+    size_t i = magic + 1;
+    unsigned long dims[2];
+    for (int d = 0; d < 2; d++) {
+        if (i == size || !isdigit(data[i])) {
+            return BUFFER40_BAD_FORMAT;
+        }
+        dims[d] = 0;
+        while (i < size && isdigit(data[i])) {
+            dims[d] = dims[d] * 10 + (data[i++] - '0');
+            if (dims[d] > 0xffffffffUL) {
+                return BUFFER40_BAD_FORMAT;
+            }
+        }
+        if (i == size || data[i++] != (d == 0 ? ' ' : '\n')) {
+            return BUFFER40_BAD_FORMAT;
+        }
+    }
+    if (dims[0] == 0 || dims[1] == 0) {
+        return BUFFER40_BAD_FORMAT;
+    }
+    if ((size - i) / 4 / dims[0] < dims[1]) {
+        return BUFFER40_TRUNCATED;
+    }
+    *width = dims[0];
+    *height = dims[1];
+    *words = &data[i];
+    return BUFFER40_OK;
+}
+
+/*
+ *  Function:  Buffer40_decompress_be
+ *  Arguments: const unsigned char *bytes - width * height words as stored
+ *                                          in a compressed file (big
+ *                                          endian), such as those found by
+ *                                          Buffer40_parse
+ *             the rest - as for Buffer40_decompress
+ *  Does:      Decompresses an image from the words of a compressed file,
+ *             without copying them first.
+ *  Return:    Buffer40_status - BUFFER40_OK, or why nothing was done
+ */
+Buffer40_status Buffer40_decompress_be(const unsigned char *bytes,
+                                       unsigned width, unsigned height,
+                                       bool fixed_point,
+                                       unsigned char *pixels, size_t stride,
+                                       size_t size)
+{
+    if (bytes == NULL || pixels == NULL) {
+        return BUFFER40_NULL_ARGUMENT;
+    }
+    if (width == 0 || height == 0 || width > UINT_MAX / 2 ||
+        height > UINT_MAX / 2) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    Buffer40_status status = check_raster(stride, width * 2, height * 2, 1,
+                                          size);
+    if (status != BUFFER40_OK) {
+        return status;
+    }
+
+    for (unsigned row = 0; row < height; row++) {
+        if (!Bitpack40_valid_row(&bytes[(size_t)row * width * 4], width,
+                                 true)) {
+            return BUFFER40_BAD_FORMAT;
+        }
+    }
+    for (unsigned row = 0; row < height; row++) {
+        unsigned char *top = &pixels[stride * 2 * row];
+        (fixed_point ? decompress_row_be_fixed : decompress_row_be)(
+            &bytes[(size_t)row * width * 4], width, top, top + stride);
+    }
+    return BUFFER40_OK;
+}
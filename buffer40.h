@@ -0,0 +1,77 @@
+/******************************************************************************
+ *
+ *                                 buffer40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for running the codec between buffers in memory, for
+ *     programs that embed it. Unlike compress40 and decompress40, these
+ *     functions never read or write a stream, never allocate, and never end
+ *     the process: every problem with the arguments or the data is returned
+ *     as a Buffer40_status, and nothing is written to the output unless the
+ *     status is BUFFER40_OK. They keep no state between calls (the lookup
+ *     tables the kernels share are built once and never change), so any
+ *     number of threads may call them at once on different buffers.
+ *
+ *     Pixels are given as in a binary PPM raster: three samples per pixel,
+ *     one byte each when the denominator is below 256 and two big endian
+ *     bytes otherwise, with rows stride bytes apart. Words are the
+ *     bitpacked 2x2 pixel groups of a compressed image, row-major, in
+ *     native byte order; Buffer40_parse finds the big endian words of a
+ *     whole compressed file, which Buffer40_decompress_be decodes.
+ *     (See the implementation file buffer40.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef BUFFER40_H
+#define BUFFER40_H
+
+/* First line of a compressed image file */
+#define BUFFER40_MAGIC "COMP40 Compressed image format 2"
+
+typedef enum Buffer40_status {
+    BUFFER40_OK = 0,
+    BUFFER40_NULL_ARGUMENT,   /* a required pointer is NULL */
+    BUFFER40_BAD_DIMENSIONS,  /* an image smaller than one 2x2 group, or
+                                 too large to address */
+    BUFFER40_BAD_DENOMINATOR, /* a denominator of 0 or above 65535 */
+    BUFFER40_BAD_STRIDE,      /* rows closer together than their length */
+    BUFFER40_NO_SPACE,        /* the output buffer is too small */
+    BUFFER40_BAD_FORMAT,      /* not a compressed image file, or a word
+                                 with a coefficient out of range */
+    BUFFER40_TRUNCATED,       /* a compressed file missing some words */
+    BUFFER40_NO_MEMORY        /* an allocation failed (context40.h) */
+} Buffer40_status;
+
+extern const char     *Buffer40_message      (Buffer40_status status);
+extern Buffer40_status Buffer40_compress     (const unsigned char *pixels,
+                                              size_t stride, size_t size,
+                                              unsigned width, unsigned height,
+                                              unsigned denominator,
+                                              bool fixed_point,
+                                              uint32_t *words,
+                                              size_t capacity);
+extern Buffer40_status Buffer40_decompress   (const uint32_t *words,
+                                              unsigned width,
+                                              unsigned height,
+                                              bool fixed_point,
+                                              unsigned char *pixels,
+                                              size_t stride, size_t size);
+extern Buffer40_status Buffer40_parse        (const unsigned char *data,
+                                              size_t size, unsigned *width,
+                                              unsigned *height,
+                                              const unsigned char **words);
+extern Buffer40_status Buffer40_decompress_be(const unsigned char *bytes,
+                                              unsigned width,
+                                              unsigned height,
+                                              bool fixed_point,
+                                              unsigned char *pixels,
+                                              size_t stride, size_t size);
+
+#endif
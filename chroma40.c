@@ -0,0 +1,136 @@
+/******************************************************************************
+ *
+ *                                chroma40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the chroma40.h interface. The tables are built once per
+ *     process, on the first call to Chroma40_get, and are read-only after
+ *     that, so any number of threads may share them.
+ *
+ *     Arith40_index_of_chroma rounds to the nearest of the chroma values in
+ *     increasing order, which makes it a monotonic step function of its
+ *     argument. Each threshold is therefore found by bisecting between two
+ *     neighbouring chroma values for the first float at which the library
+ *     returns the higher index. Floats are bisected in order of value
+ *     through their bit patterns, so the thresholds are exact to the last
+ *     bit, including whichever way the library breaks ties.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "arith40.h"
+
+#include "chroma40.h"
+
+static Chroma40_tables tables;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/* Static function declarations */
+static inline uint32_t float_key(float x);
+static inline float key_float(uint32_t key);
+static float find_threshold(unsigned index);
+static void build_tables(void);
+
+/*
+ *  Function:  float_key / key_float
+ *  Arguments: float x - a non-NaN float / uint32_t key - a key of one
+ *  Does:      Converts between a float and an unsigned key with the same
+ *             order: negative floats have their bits inverted and positive
+ *             ones their sign bit set, so that keys compare like values.
+ *  Return:    uint32_t - the key of x / float - the float of key
+ */
+static inline uint32_t float_key(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+static inline float key_float(uint32_t key)
+{
+    uint32_t bits = key & 0x80000000u ? key & 0x7fffffffu : ~key;
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+/*
+ *  Function:  find_threshold
+ *  Arguments: unsigned index - a chroma index, at least 1
+ *  Does:      Bisects the floats between the chroma values of index - 1
+ *             and index for the least one that the library quantizes to
+ *             index or above.
+ *  Return:    float - the threshold of index
+ */
+static float find_threshold(unsigned index)
+{
+    /* the library maps lo below index and hi to index itself */
+    uint32_t lo = float_key(Arith40_chroma_of_index(index - 1));
+    uint32_t hi = float_key(Arith40_chroma_of_index(index));
+    assert(Arith40_index_of_chroma(key_float(lo)) < index);
+    assert(Arith40_index_of_chroma(key_float(hi)) >= index);
+
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (Arith40_index_of_chroma(key_float(mid)) >= index) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    return key_float(hi);
+}
+
+/*
+ *  Function:  build_tables
+ *  Arguments: none
+ *  Does:      Fills in the tables from the arith40 library. Run once,
+ *             through pthread_once.
+ *  Return:    void
+ */
+static void build_tables(void)
+{
+    for (unsigned k = 0; k < CHROMA40_COUNT; k++) {
+        tables.chroma[k] = Arith40_chroma_of_index(k);
+    }
+    for (unsigned k = 0; k + 1 < CHROMA40_COUNT; k++) {
+        tables.threshold[k] = find_threshold(k + 1);
+    }
+    tables.threshold[CHROMA40_COUNT - 1] = INFINITY;
+
+    /* scaling by a power of two is exact, so only the rounding to an
+       integer changes these values */
+    for (unsigned k = 0; k < CHROMA40_COUNT; k++) {
+        tables.fixed_chroma[k] = lroundf(tables.chroma[k] * 65536.0f);
+    }
+    for (unsigned k = 0; k + 1 < CHROMA40_COUNT; k++) {
+        tables.fixed_threshold[k] = ceilf(tables.threshold[k] * 262144.0f);
+    }
+    tables.fixed_threshold[CHROMA40_COUNT - 1] = INT32_MAX;
+}
+
+/*
+ *  Function:  Chroma40_get
+ *  Arguments: none
+ *  Does:      Returns the chroma tables, building them on first use.
+ *             Thread-safe.
+ *  Return:    const Chroma40_tables * - the tables, valid for the rest of
+ *             the process
+ */
+const Chroma40_tables *Chroma40_get(void)
+{
+    pthread_once(&tables_once, build_tables);
+    return &tables;
+}
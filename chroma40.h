@@ -0,0 +1,168 @@
+/******************************************************************************
+ *
+ *                                chroma40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Local lookup tables for chroma quantization, so that the codec's hot
+ *     loops need not call into the arith40 library for every pixel group.
+ *     Chroma40_get builds the tables from Arith40_index_of_chroma and
+ *     Arith40_chroma_of_index the first time it is called; after that,
+ *     Chroma40_index gives exactly the index Arith40_index_of_chroma would
+ *     for every non-NaN float, and Chroma40_chroma exactly the value
+ *     Arith40_chroma_of_index would for every index.
+ *
+ *     The fixed-point versions serve the integer codec path (see
+ *     fixedrow.h): Chroma40_index_fixed quantizes the sum of four Q16
+ *     chroma values, which is their average in Q18, exactly as the library
+ *     would quantize that average, and Chroma40_chroma_fixed gives each
+ *     chroma value rounded to Q16.
+ *     (See the implementation file chroma40.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+
+#include "compressinfo.h"
+#include "cpufeatures.h"
+
+#ifndef CHROMA40_H
+#define CHROMA40_H
+
+/* Number of chroma indices, and entries in each table */
+#define CHROMA40_COUNT (1 << PB_WIDTH)
+
+typedef struct Chroma40_tables {
+    /* threshold[k] is the least float whose index is greater than k, so
+       the index of x is the number of thresholds at or below x; the last
+       entry is infinity, which no finite chroma reaches */
+    float threshold[CHROMA40_COUNT];
+    float chroma[CHROMA40_COUNT]; /* the chroma value of each index */
+
+    /* the same tables in fixed point: each threshold rounded up to Q18,
+       the last one INT32_MAX, and each chroma value rounded to Q16 */
+    int32_t fixed_threshold[CHROMA40_COUNT];
+    int32_t fixed_chroma[CHROMA40_COUNT];
+} Chroma40_tables;
+
+extern const Chroma40_tables *Chroma40_get(void);
+
+/*
+ *  Function:  Chroma40_index
+ *  Arguments: const Chroma40_tables *tables - tables from Chroma40_get
+ *             float x - an average chroma value, which must not be NaN
+ *  Does:      Quantizes x with a branchless binary search of the
+ *             thresholds, four comparisons in all.
+ *  Return:    unsigned - the index of x's chroma value
+ */
+static inline unsigned Chroma40_index(const Chroma40_tables *tables, float x)
+{
+    const float *threshold = tables->threshold;
+    unsigned i = 0;
+    i += (x >= threshold[i + 7]) << 3;
+    i += (x >= threshold[i + 3]) << 2;
+    i += (x >= threshold[i + 1]) << 1;
+    i += x >= threshold[i];
+    return i;
+}
+
+/*
+ *  Function:  Chroma40_chroma
+ *  Arguments: const Chroma40_tables *tables - tables from Chroma40_get
+ *             unsigned index - a chroma index, less than CHROMA40_COUNT
+ *  Does:      Dequantizes a chroma index.
+ *  Return:    float - the index's chroma value
+ */
+static inline float Chroma40_chroma(const Chroma40_tables *tables,
+                                    unsigned index)
+{
+    return tables->chroma[index];
+}
+
+/*
+ *  Function:  Chroma40_index_fixed
+ *  Arguments: const Chroma40_tables *tables - tables from Chroma40_get
+ *             int32_t sum - the sum of four Q16 chroma values, which is
+ *                           their average in Q18
+ *  Does:      Integer version of Chroma40_index. The sum is far below
+ *             2^24 in magnitude, so sum / 2^18 is exactly a float, and
+ *             comparing the sum with a threshold rounded up to Q18 gives the
+ *             same answer as comparing that float with the threshold.
+ *  Return:    unsigned - the index of the average's chroma value
+ */
+static inline unsigned Chroma40_index_fixed(const Chroma40_tables *tables,
+                                            int32_t sum)
+{
+    const int32_t *threshold = tables->fixed_threshold;
+    unsigned i = 0;
+    i += (sum >= threshold[i + 7]) << 3;
+    i += (sum >= threshold[i + 3]) << 2;
+    i += (sum >= threshold[i + 1]) << 1;
+    i += sum >= threshold[i];
+    return i;
+}
+
+/*
+ *  Function:  Chroma40_chroma_fixed
+ *  Arguments: const Chroma40_tables *tables - tables from Chroma40_get
+ *             unsigned index - a chroma index, less than CHROMA40_COUNT
+ *  Does:      Integer version of Chroma40_chroma.
+ *  Return:    int32_t - the index's chroma value in Q16
+ */
+static inline int32_t Chroma40_chroma_fixed(const Chroma40_tables *tables,
+                                            unsigned index)
+{
+    return tables->fixed_chroma[index];
+}
+
+#ifdef CPUFEATURES_X86
+
+/*
+ *  Function:  Chroma40_index_avx2
+ *  Arguments: const Chroma40_tables *tables - tables from Chroma40_get
+ *             __m256 x - 8 average chroma values, none of them NaN
+ *  Does:      Vector version of Chroma40_index: compares every value with
+ *             each finite threshold and counts the comparisons that hold
+ *             (a true comparison is all ones, or -1).
+ *  Return:    __m256i - the 8 indices
+ */
+TARGET_AVX2
+static inline __m256i Chroma40_index_avx2(const Chroma40_tables *tables,
+                                          __m256 x)
+{
+    __m256i index = _mm256_setzero_si256();
+    for (int k = 0; k < CHROMA40_COUNT - 1; k++) {
+        __m256 at_least = _mm256_cmp_ps(
+            x, _mm256_broadcast_ss(&tables->threshold[k]), _CMP_GE_OQ);
+        index = _mm256_sub_epi32(index, _mm256_castps_si256(at_least));
+    }
+    return index;
+}
+
+/*
+ *  Function:  Chroma40_index_fixed_avx2
+ *  Arguments: const Chroma40_tables *tables - tables from Chroma40_get
+ *             __m256i sum - 8 sums of four Q16 chroma values
+ *  Does:      Vector version of Chroma40_index_fixed. AVX2 only compares
+ *             integers for greater than, so this counts the thresholds
+ *             above each sum (as -1s) and subtracts them from the most the
+ *             index can be.
+ *  Return:    __m256i - the 8 indices
+ */
+TARGET_AVX2
+static inline __m256i Chroma40_index_fixed_avx2(const Chroma40_tables *tables,
+                                                __m256i sum)
+{
+    __m256i index = _mm256_set1_epi32(CHROMA40_COUNT - 1);
+    for (int k = 0; k < CHROMA40_COUNT - 1; k++) {
+        index = _mm256_add_epi32(index, _mm256_cmpgt_epi32(
+            _mm256_set1_epi32(tables->fixed_threshold[k]), sum));
+    }
+    return index;
+}
+
+#endif
+
+#endif
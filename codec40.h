@@ -0,0 +1,130 @@
+/******************************************************************************
+ *
+ *                                codec40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Extended entry points to the compress40/decompress40 codec that accept
+ *     a set of tuning options. compress40 and decompress40 (see
+ *     compress40.h) behave exactly like these functions called with a NULL
+ *     options pointer. Every option combination except fixed_point produces
+ *     byte-identical output; the options only select how the work is
+ *     carried out. Every path checks the words it decodes, so a corrupt
+ *     file is a checked run-time error whatever the options. The paths
+ *     that hold every word in memory (the default, fused and in-place
+ *     ones) check them all before writing anything; those that read the
+ *     words as they go (streaming, pipelined and the threaded path reading
+ *     a stream) check each row before decoding it, and may have written
+ *     the rows before a corrupt one.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "a2methods.h"
+#include "pipeline40.h"
+#include "region40.h"
+#include "rgbtable40.h"
+#include "uarray2.h"
+
+#ifndef CODEC40_H
+#define CODEC40_H
+
+typedef struct Codec40_opts {
+    bool fused; /* convert between two scanlines and one row of words at a
+                   time with the fused row kernels, instead of mapping a
+                   callback over every pixel or word */
+    unsigned threads; /* number of worker threads; 0 or 1 means the work
+                         is done on the calling thread. More than one
+                         thread implies fused, and when decompressing,
+                         that output is streamed band by band */
+    bool streaming;   /* read, convert and write two scanlines (one row of
+                         words) at a time, using memory proportional to the
+                         image width only; single-threaded, implies fused.
+                         Output starts before all input is read, so bad
+                         input may be reported after a partial image */
+    bool pipelined;   /* like streaming, but the reading, converting and
+                         writing of chunks of rows overlap, on a reader
+                         thread, the calling thread and a writer thread
+                         (see pipeline40.h); takes precedence over
+                         streaming and threads */
+    Pipeline40_stats *pipeline_stats; /* if not NULL, the stage times of
+                                         pipelined runs are added to it */
+    A2Methods_T methods; /* storage for the pixels on the callback-based
+                            (not fused) paths, or NULL for
+                            uarray2_methods_blocked. Its map_block_major
+                            must visit the four cells of every aligned 2x2
+                            group consecutively, top-left, bottom-left,
+                            top-right, bottom-right, as the blocked and
+                            Morton suites do */
+    bool fixed_point;    /* use the all-integer kernels of fixedrow.h, whose
+                            output stays within the error bound given there
+                            of the default floating-point output and is the
+                            same on every platform; implies fused */
+    bool rgb_table;      /* when decompressing, look pixels up in the
+                            direct-to-RGB tables of rgbtable40.h (one per
+                            thread) instead of computing them; same output,
+                            implies fused, ignored with fixed_point */
+    Rgbtable40_stats *table_stats; /* if not NULL, the statistics of the
+                                      tables used are added to it */
+    FILE *output;        /* where the output is written, or NULL for
+                            stdout */
+    Region40_T region;   /* if not NULL, the array of words and the
+                            scanline buffers of each image are allocated
+                            from this region rather than the heap, and left
+                            for the caller to release by resetting it
+                            between images. The pixmaps built through an
+                            A2Methods suite still come from the heap */
+} *Codec40_opts;
+
+/* The stream the output of opts goes to */
+static inline FILE *Codec40_output(Codec40_opts opts)
+{
+    return opts != NULL && opts->output != NULL ? opts->output : stdout;
+}
+
+/* Per-image buffers of opts: from its region if it has one, else from the
+   heap with malloc, so that a NULL result is possible only then. Buffers
+   from Codec40_alloc are released with Codec40_release, and arrays from
+   Codec40_array with UArray2_free, which leaves region arrays alone */
+static inline void *Codec40_alloc(Codec40_opts opts, size_t bytes)
+{
+    return opts != NULL && opts->region != NULL
+           ? Region40_alloc(opts->region, bytes) : malloc(bytes);
+}
+
+static inline void Codec40_release(Codec40_opts opts, void *buffer)
+{
+    if (opts == NULL || opts->region == NULL) {
+        free(buffer);
+    }
+}
+
+static inline UArray2_T Codec40_array(Codec40_opts opts, int width,
+                                      int height, int size)
+{
+    return opts != NULL && opts->region != NULL
+           ? UArray2_new_in(opts->region, width, height, size)
+           : UArray2_new(width, height, size);
+}
+
+extern void compress40_opts  (FILE *input, Codec40_opts opts);
+extern void decompress40_opts(FILE *input, Codec40_opts opts);
+
+/* Decode a whole file held in memory (e.g. mapped with mapfile.h) in place.
+   Both return false, having written nothing, if the data cannot be handled
+   that way, which includes options that do not choose the fused row
+   kernels (so the callback-based path and opts->methods are honoured); the
+   caller should then fall back to the FILE * versions above, which accept
+   every input and option and report errors */
+extern bool compress40_inplace  (const unsigned char *data, size_t size,
+                                 Codec40_opts opts);
+extern bool decompress40_inplace(const unsigned char *data, size_t size,
+                                 Codec40_opts opts);
+
+#endif
@@ -16,21 +16,29 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "assert.h"
 
 #include "compress40.h"
 #include "a2methods.h"
 #include "pnm.h"
-#include "arith40.h"
 
+#include "codec40.h"
 #include "compressmath.h"
+#include "compressrow.h"
+#include "fixedrow.h"
 #include "a2blocked.h"
 #include "a2plain.h"
 #include "uarray2b.h"
 #include "uarray2.h"
-#include "bitpack.h"
+#include "bitpack40.h"
+#include "chroma40.h"
+#include "cvtable40.h"
 #include "compressinfo.h"
+#include "ppmreader.h"
+#include "threadpool.h"
+#include "wordio.h"
 
 /* Mapping closure struct declaration, implementation, and pointer typedef */
 typedef struct Compression_Info {
@@ -38,79 +46,96 @@ typedef struct Compression_Info {
     float *y_vals;
     float avg_pr;
     float avg_pb;
+    const Chroma40_tables *chroma;
+    const Cvtable40 *cvtable; /* NULL if the denominator has no table */
     unsigned denominator;
     unsigned orig_width;
     unsigned orig_height;
 } *Compression_Info;
 
+/* A horizontal band of the compressed image, compressed as one task. The
+   source scanlines come either from a row-major pixmap or, when image is
+   NULL, straight from the binary raster of a file held in memory */
+struct Band {
+    Pnm_ppm image;
+    const unsigned char *raster; /* used when image is NULL */
+    size_t scanline;             /* bytes per scanline of raster */
+    unsigned denominator;
+    UArray2_T compressed;
+    unsigned first_row; /* first row of words in the band */
+    unsigned end_row;   /* one past the last row of words in the band */
+    bool fixed_point;   /* compress with the kernels of fixedrow.h */
+};
+
+/* Number of bands per worker thread; more bands than threads keeps every
+   thread busy even if some bands take longer than others */
+#define BANDS_PER_THREAD 4
+
+/* Target size in bytes of the pixels read for one chunk of rows, and the
+   number of chunks in the ring, of a pipelined compression */
+#define CHUNK_BYTES (1 << 20)
+#define PIPELINE_SLOTS 4
+
+/* A pipelined compression, shared by its stages. A chunk is chunk_rows
+   rows of words (the last may have fewer), read as twice as many
+   scanlines */
+struct Pipelined {
+    Ppmreader_T reader;
+    FILE *output;
+    unsigned pixels;      /* pixels per scanline */
+    unsigned width;       /* words per row */
+    unsigned height;      /* rows of words */
+    unsigned denominator;
+    unsigned chunk_rows;
+    bool fixed_point;
+};
+
 /* Static function declarations */
 static uint32_t bitpack_pixels(unsigned a, int b, int c, int d,
                                unsigned avg_pb_ind, unsigned avg_pr_ind);
 static void compress_cb(int col, int row, A2Methods_UArray2 image, void *elem,
                         void *cl);
-static void write_compressed(UArray2_T compressed);
-static void print_compress_cb(int col, int row, UArray2_T compressed,
-                              void *elem, void *cl);
-static void print_big_endian(uint32_t word);
+static void write_compressed(UArray2_T compressed, FILE *output);
 static void pack_pixel(Compression_Info c_info, int col, int row);
+static inline void compress_pixel(Compression_Info c_info, int col, int row,
+                                  Pnm_rgb rgb);
+static void compress_blocks(Pnm_ppm image, Compression_Info c_info);
+static UArray2_T compress_mapped(Pnm_ppm image, Codec40_opts opts);
+static UArray2_T compress_fused(Pnm_ppm image, Codec40_opts opts);
+static void compress_band(void *cl);
+static void compress_bands(struct Band whole, unsigned threads);
+static void compress_streaming(FILE *input, Codec40_opts opts);
+static unsigned rows_in_chunk(struct Pipelined *pipelined, unsigned chunk);
+static bool read_chunk(void *cl, unsigned chunk, void *in, void *out);
+static bool compress_chunk(void *cl, unsigned chunk, void *in, void *out);
+static bool write_chunk(void *cl, unsigned chunk, void *in, void *out);
+static void compress_pipelined(FILE *input, Codec40_opts opts);
+static bool uses_row_kernels(Codec40_opts opts);
 
 /*
  *  Function:  write_compressed
  *  Arguments: UArray2_T compressed - a pointer to an existing 2d array
  *                                    containing bitpacked pixel groups
- *  Does:      Writes the bytes of a compressed PPM file to stdout in Big 
+ *             FILE *output - the stream to write to
+ *  Does:      Writes the bytes of a compressed PPM file to output in Big 
  *             Endian order. 
  *  Return:    void
  */
-static void write_compressed(UArray2_T compressed)
+static void write_compressed(UArray2_T compressed, FILE *output)
 {
     assert(compressed != NULL);
-    printf("COMP40 Compressed image format 2\n%u %u\n",
-           UArray2_width(compressed), UArray2_height(compressed));
-    
-    /* print all bytes in compressed in big endian order */
-    UArray2_map_row_major(compressed, print_compress_cb, NULL);
-}
-
-/*
- *  Function:  print_compress_cb
- *  Arguments: int col - the column index of a bitpacked pixel group in the
- *                       specified 2D array (unnessary for function, voided)
- *             int row - the column index of a bitpacked pixel group in the
- *                       specified 2D array (unnessary for function, voided)
- *             UArray2_T compressed - a pointer to an existing 2d array 
- *                                    containing bitpacked pixel groups
- *                                    (unnessary for function, voided)
- *             void *elem - pointer to an element in the compressed 2d array
- *             void *cl - a pointer to some closure. (unnessary for function,
- *                        voided)
- *  Does:      Callback function used to write the bytes of a compressed PPM 
- *             file to stdout in Big Endian order. 
- *  Return:    void
- */
-static void print_compress_cb(int col, int row, UArray2_T compressed,
-                              void *elem, void *cl)
-{
-    assert(elem != NULL);
-    (void)col;
-    (void)row;
-    (void)compressed;
-    (void)cl;
-    print_big_endian(*(uint32_t *)elem);
-}
+    unsigned width = UArray2_width(compressed);
+    unsigned height = UArray2_height(compressed);
+    fprintf(output, "COMP40 Compressed image format 2\n%u %u\n", width,
+            height);
+    if (width == 0) {
+        return;
+    }
 
-/*
- *  Function:  print_big_endian
- *  Arguments: uint32_t word - a bitpacked, 32-bit word
- *  Does:      Outputs (with putchar) each byte in the word in big endian 
- *             order. 
- *  Return:    void
- */
-static void print_big_endian(uint32_t word)
-{   
-    for (int i = (int)(sizeof word) - 1; i >= 0; i--)
-    {
-        putchar(Bitpack_getu(word, 8, i * 8));
+    /* write each row in big endian order; the words of a row are
+       contiguous, so a row goes out in one bulk write */
+    for (unsigned row = 0; row < height; row++) {
+        write_words(output, UArray2_row(compressed, row), width);
     }
 }
 
@@ -123,20 +148,14 @@ static void print_big_endian(uint32_t word)
  *             unsigned pb_ind - index of chroma pb value in external table
  *             unsigned pr_ind - index of chroma pr value in external table
  *  Does:      Bitpacks DCT and chroma values into a uint32_t. Each value 
- *             has a width and lsb specified in compressinfo.h.
+ *             has a width and lsb specified in compressinfo.h, so the
+ *             specialized Bitpack40_pack does the work.
  *  Return:    a uint32_t with all arguments bitpacked in it
  */
 static uint32_t bitpack_pixels(unsigned a, int b, int c, int d,
                                unsigned pb_ind, unsigned pr_ind)
 {
-    uint64_t word = 0;
-    word = Bitpack_newu(word, A_WIDTH, a_lsb, a);
-    word = Bitpack_news(word, B_WIDTH, b_lsb, b);
-    word = Bitpack_news(word, C_WIDTH, c_lsb, c);
-    word = Bitpack_news(word, D_WIDTH, d_lsb, d);
-    word = Bitpack_newu(word, PB_WIDTH, pb_lsb, pb_ind);
-    word = Bitpack_newu(word, PR_WIDTH, pr_lsb, pr_ind);
-    return word;
+    return Bitpack40_pack(a, b, c, d, pb_ind, pr_ind);
 }
 
 /*
@@ -171,12 +190,14 @@ static void pack_pixel(Compression_Info c_info, int col, int row)
 
     /* bitpack dcts and index of chromas */
     uint32_t bitpacked_data = bitpack_pixels(a, b, c, d,
-                                             Arith40_index_of_chroma(avg_pb),
-                                             Arith40_index_of_chroma(avg_pr));
+                                             Chroma40_index(c_info->chroma,
+                                                            avg_pb),
+                                             Chroma40_index(c_info->chroma,
+                                                            avg_pr));
     
     /* place bitpacked data into compressed 2d array */
-    *(uint32_t *)UArray2_at(c_info->compressed, col / 2, row / 2) = 
-        bitpacked_data;
+    *(uint32_t *)UArray2_at_unchecked(c_info->compressed, col / 2,
+                                      row / 2) = bitpacked_data;
 
     /* reset closure for reading new pixels */
     c_info->avg_pb = 0;
@@ -205,7 +226,24 @@ static void compress_cb(int col, int row, A2Methods_UArray2 image, void *elem,
                         void *cl)
 {
     assert(image != NULL && elem != NULL && cl != NULL);
-    Compression_Info c_info = (Compression_Info)cl;
+    compress_pixel(cl, col, row, elem);
+}
+
+/*
+ *  Function:  compress_pixel
+ *  Arguments: Compression_Info c_info - the closure of the pixel group
+ *                                       being accumulated
+ *             int col, row - the position of the pixel in the image
+ *             Pnm_rgb rgb - the pixel
+ *  Does:      Adds one pixel to the current pixel group, and packs the
+ *             group once its fourth (bottom-right) pixel has been added.
+ *             Pixels must arrive group by group, top-left, bottom-left,
+ *             top-right, bottom-right.
+ *  Return:    void
+ */
+static inline void compress_pixel(Compression_Info c_info, int col, int row,
+                                  Pnm_rgb rgb)
+{
     assert(c_info != NULL && c_info->y_vals != NULL);
 
     /* ensure that only pixel groups with exactly four pixels are read */
@@ -214,14 +252,19 @@ static void compress_cb(int col, int row, A2Methods_UArray2 image, void *elem,
         return;
     }
     
-    /* scale rgb to the range [0, 1] */
-    Pnm_rgb rgb = (Pnm_rgb)elem;
-    float normalized_rgbs[3];
-    scale_rgb(rgb, c_info->denominator, normalized_rgbs);
-
-    /* get chroma values */
+    /* get chroma values, looking up 8-bit pixels in the table if there is
+       one, and otherwise scaling rgb to the range [0, 1] and transforming
+       it */
     float chromas[3];
-    rgb_to_cv(normalized_rgbs, chromas);
+    if (c_info->cvtable != NULL &&
+        (rgb->red | rgb->green | rgb->blue) < CVTABLE40_SAMPLES) {
+        Cvtable40_cv(c_info->cvtable, rgb->red, rgb->green, rgb->blue,
+                     &chromas[0], &chromas[1], &chromas[2]);
+    } else {
+        float normalized_rgbs[3];
+        scale_rgb(rgb, c_info->denominator, normalized_rgbs);
+        rgb_to_cv(normalized_rgbs, chromas);
+    }
     c_info->avg_pb += chromas[1];
     c_info->avg_pr += chromas[2];
 
@@ -236,6 +279,363 @@ static void compress_cb(int col, int row, A2Methods_UArray2 image, void *elem,
     }
 }
 
+/*
+ *  Function:  compress_mapped
+ *  Arguments: Pnm_ppm image - a PPM image whose pixels are stored in a
+ *                             blocked 2D array with a blocksize of 2, or
+ *                             any suite whose map_block_major visits 2x2
+ *                             groups in the same order (see codec40.h)
+ *             Codec40_opts opts - the options, or NULL, whose region (if
+ *                                 any) holds the returned array
+ *  Does:      Compresses the image by visiting every pixel in block-major
+ *             order: with a plain loop over the blocks of a UArray2b_T, or
+ *             by mapping compress_cb over any other suite. The returned
+ *             array must be freed by the caller.
+ *  Return:    UArray2_T - the array of bitpacked pixel groups
+ */
+static UArray2_T compress_mapped(Pnm_ppm image, Codec40_opts opts)
+{
+    assert(image != NULL && image->pixels != NULL);
+
+    /* create the compressed image unboxed 2D array */
+    UArray2_T compressed = Codec40_array(opts, image->width / 2,
+                                         image->height / 2,
+                                         sizeof(uint32_t));
+
+    /* map across each 2x2 block and compress/store each block */
+    float y_vals[4];
+    struct Compression_Info c_info = {compressed, y_vals, 0, 0,
+                                      Chroma40_get(),
+                                      Cvtable40_get(image->denominator),
+                                      image->denominator, image->width,
+                                      image->height};
+    if (image->methods == uarray2_methods_blocked) {
+        compress_blocks(image, &c_info);
+    } else {
+        image->methods->map_block_major(image->pixels, compress_cb, &c_info);
+    }
+    return compressed;
+}
+
+/*
+ *  Function:  compress_blocks
+ *  Arguments: Pnm_ppm image - a PPM image whose pixels are stored in a
+ *                             UArray2b_T
+ *             Compression_Info c_info - the closure for compress_pixel
+ *  Does:      Feeds every pixel to compress_pixel in the order that
+ *             UArray2b_map would, but as a plain loop over the contiguous
+ *             cells of each block, with no callback per pixel.
+ *  Return:    void
+ */
+static void compress_blocks(Pnm_ppm image, Compression_Info c_info)
+{
+    UArray2b_T pixels = image->pixels;
+    int b = UArray2b_blocksize(pixels);
+    int width = image->width;
+    int height = image->height;
+
+    for (int bx = 0; bx < UArray2b_xblocks(pixels); bx++) {
+        for (int by = 0; by < UArray2b_yblocks(pixels); by++) {
+            struct Pnm_rgb *cells = UArray2b_block(pixels, bx, by);
+            for (int i = 0; i < b; i++) {
+                for (int j = 0; j < b; j++) {
+                    int col = bx * b + i;
+                    int row = by * b + j;
+                    if (col < width && row < height) {
+                        compress_pixel(c_info, col, row, &cells[i * b + j]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ *  Function:  compress_band
+ *  Arguments: void *cl - a struct Band describing the rows to compress
+ *  Does:      Compresses one band of the image two scanlines at a time with
+ *             the fused row kernel. The cells of each row of a UArray2_T
+ *             are contiguous, so UArray2_row gives the whole scanline.
+ *             Bands share no state, so any number of them may be
+ *             compressed concurrently.
+ *  Return:    void
+ */
+static void compress_band(void *cl)
+{
+    struct Band *band = cl;
+    assert(band != NULL);
+    Pnm_ppm image = band->image;
+    unsigned width = UArray2_width(band->compressed);
+
+    for (unsigned row = band->first_row; row < band->end_row; row++) {
+        uint32_t *words = UArray2_row(band->compressed, row);
+        if (image == NULL) {
+            const unsigned char *top = &band->raster[band->scanline * 2 *
+                                                     row];
+            (band->fixed_point ? compress_row_raw_fixed : compress_row_raw)(
+                top, top + band->scanline, width, band->denominator, words);
+        } else {
+            (band->fixed_point ? compress_row_fixed : compress_row)(
+                UArray2_row(image->pixels, row * 2),
+                UArray2_row(image->pixels, row * 2 + 1), width,
+                band->denominator, words);
+        }
+    }
+}
+
+/*
+ *  Function:  compress_bands
+ *  Arguments: struct Band whole - a band covering every row of the
+ *                                 compressed image
+ *             unsigned threads - number of threads to compress with
+ *  Does:      Compresses the image with the fused row kernel. With more
+ *             than one thread, the compressed image is split into
+ *             horizontal bands which are compressed by a pool of worker
+ *             threads; every band writes only its own rows, so the result
+ *             does not depend on the number of threads.
+ *  Return:    void
+ */
+static void compress_bands(struct Band whole, unsigned threads)
+{
+    unsigned height = whole.end_row;
+    if (threads <= 1) {
+        compress_band(&whole);
+        return;
+    }
+
+    unsigned nbands = threads * BANDS_PER_THREAD;
+    nbands = nbands > height ? height : nbands;
+    struct Band *bands = malloc(nbands * sizeof(*bands));
+    assert(bands != NULL);
+    Threadpool_T pool = Threadpool_new(threads);
+    for (unsigned i = 0; i < nbands; i++) {
+        bands[i] = whole;
+        bands[i].first_row = (uint64_t)height * i / nbands;
+        bands[i].end_row = (uint64_t)height * (i + 1) / nbands;
+        Threadpool_submit(pool, compress_band, &bands[i]);
+    }
+    Threadpool_wait(pool);
+    Threadpool_free(&pool);
+    free(bands);
+}
+
+/*
+ *  Function:  compress_fused
+ *  Arguments: Pnm_ppm image - a PPM image whose pixels are stored in a
+ *                             plain (row-major) UArray2_T
+ *             Codec40_opts opts - the options giving the number of threads,
+ *                                 the kernel and the region (if any) to
+ *                                 hold the returned array
+ *  Does:      Compresses the image with the fused row kernel on
+ *             opts->threads threads (see compress_bands). The returned
+ *             array must be freed by the caller.
+ *  Return:    UArray2_T - the array of bitpacked pixel groups
+ */
+static UArray2_T compress_fused(Pnm_ppm image, Codec40_opts opts)
+{
+    assert(image != NULL && image->pixels != NULL && opts != NULL);
+    unsigned width = image->width / 2;
+    unsigned height = image->height / 2;
+    UArray2_T compressed = Codec40_array(opts, width, height,
+                                         sizeof(uint32_t));
+    if (width == 0 || height == 0) {
+        return compressed;
+    }
+
+    struct Band whole = { image, NULL, 0, image->denominator, compressed,
+                          0, height, opts->fixed_point };
+    compress_bands(whole, opts->threads);
+    return compressed;
+}
+
+/*
+ *  Function:  compress_streaming
+ *  Arguments: FILE *input - a non-null pointer to an opened PPM image file,
+ *                           positioned at its start
+ *             Codec40_opts opts - the options, giving the kernel, the
+ *                                 output and the region (if any) for the
+ *                                 scanline buffers
+ *  Does:      Compresses the image without ever holding it in memory: the
+ *             compressed header is written as soon as the PPM header has
+ *             been read, then each pair of scanlines is read, compressed
+ *             into one row of words with the fused row kernel, and written
+ *             immediately. Memory use is proportional to the width of the
+ *             image and independent of its height. The scanlines no pair
+ *             uses (an odd last one, or all of them in an image one pixel
+ *             wide) are read and checked too, so that a file is accepted
+ *             exactly when Pnm_ppmread would accept it.
+ *  Return:    void
+ */
+static void compress_streaming(FILE *input, Codec40_opts opts)
+{
+    bool fixed_point = opts->fixed_point;
+    FILE *output = Codec40_output(opts);
+    Ppmreader_T reader = Ppmreader_new(input);
+    unsigned pixels = Ppmreader_width(reader);
+    unsigned width = pixels / 2;
+    unsigned height = Ppmreader_height(reader) / 2;
+    unsigned denominator = Ppmreader_denominator(reader);
+    fprintf(output, "COMP40 Compressed image format 2\n%u %u\n", width,
+            height);
+
+    if (width > 0) {
+        struct Pnm_rgb *top = Codec40_alloc(opts, pixels * sizeof(*top));
+        struct Pnm_rgb *bottom = Codec40_alloc(opts,
+                                               pixels * sizeof(*bottom));
+        uint32_t *words = Codec40_alloc(opts, width * sizeof(*words));
+        assert(top != NULL && bottom != NULL && words != NULL);
+
+        for (unsigned row = 0; row < height; row++) {
+            Ppmreader_read_row(reader, top);
+            Ppmreader_read_row(reader, bottom);
+            (fixed_point ? compress_row_fixed : compress_row)(
+                top, bottom, width, denominator, words);
+            write_words(output, words, width);
+        }
+        Codec40_release(opts, top);
+        Codec40_release(opts, bottom);
+        Codec40_release(opts, words);
+    }
+    Ppmreader_finish(reader);
+    Ppmreader_free(&reader);
+}
+
+/*
+ *  Function:  rows_in_chunk
+ *  Arguments: struct Pipelined *pipelined - the compression
+ *             unsigned chunk - the number of a chunk
+ *  Does:      Counts the rows of words in a chunk.
+ *  Return:    unsigned - chunk_rows, or fewer for the last chunk
+ */
+static unsigned rows_in_chunk(struct Pipelined *pipelined, unsigned chunk)
+{
+    unsigned first = chunk * pipelined->chunk_rows;
+    unsigned left = pipelined->height - first;
+    return left < pipelined->chunk_rows ? left : pipelined->chunk_rows;
+}
+
+/*
+ *  Function:  read_chunk
+ *  Arguments: void *cl - the struct Pipelined
+ *             unsigned chunk - the number of the chunk
+ *             void *in - filled with the chunk's scanlines
+ *             void *out - unused
+ *  Does:      The read stage of a pipelined compression: reads the next
+ *             two scanlines per row of words of the chunk. It runs on the
+ *             reader thread, so a bad file is reported to the pipeline
+ *             rather than raised.
+ *  Return:    bool - false if the file ends early or is badly formatted
+ */
+static bool read_chunk(void *cl, unsigned chunk, void *in, void *out)
+{
+    struct Pipelined *pipelined = cl;
+    struct Pnm_rgb *scanlines = in;
+    (void)out;
+    unsigned scanline_count = 2 * rows_in_chunk(pipelined, chunk);
+    for (unsigned i = 0; i < scanline_count; i++) {
+        if (!Ppmreader_try_read_row(pipelined->reader,
+                                    &scanlines[(size_t)i *
+                                               pipelined->pixels])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ *  Function:  compress_chunk
+ *  Arguments: void *cl - the struct Pipelined
+ *             unsigned chunk - the number of the chunk
+ *             void *in - the chunk's scanlines
+ *             void *out - filled with the chunk's rows of words
+ *  Does:      The compute stage of a pipelined compression: compresses
+ *             each pair of scanlines with the fused row kernel.
+ *  Return:    bool - always true
+ */
+static bool compress_chunk(void *cl, unsigned chunk, void *in, void *out)
+{
+    struct Pipelined *pipelined = cl;
+    const struct Pnm_rgb *scanlines = in;
+    uint32_t *words = out;
+    unsigned rows = rows_in_chunk(pipelined, chunk);
+    size_t pixels = pipelined->pixels;
+    for (unsigned row = 0; row < rows; row++) {
+        const struct Pnm_rgb *top = &scanlines[pixels * 2 * row];
+        (pipelined->fixed_point ? compress_row_fixed : compress_row)(
+            top, top + pixels, pipelined->width, pipelined->denominator,
+            &words[(size_t)row * pipelined->width]);
+    }
+    return true;
+}
+
+/*
+ *  Function:  write_chunk
+ *  Arguments: void *cl - the struct Pipelined
+ *             unsigned chunk - the number of the chunk
+ *             void *in - unused
+ *             void *out - the chunk's rows of words
+ *  Does:      The write stage of a pipelined compression: writes the
+ *             chunk's words in big endian order.
+ *  Return:    bool - always true
+ */
+static bool write_chunk(void *cl, unsigned chunk, void *in, void *out)
+{
+    struct Pipelined *pipelined = cl;
+    (void)in;
+    write_words(pipelined->output, out,
+                (size_t)rows_in_chunk(pipelined, chunk) * pipelined->width);
+    return true;
+}
+
+/*
+ *  Function:  compress_pipelined
+ *  Arguments: FILE *input - a non-null pointer to an opened PPM image file,
+ *                           positioned at its start
+ *             Codec40_opts opts - the options, giving the kernel, the
+ *                                 output and where to add the stage times
+ *  Does:      Compresses the image as compress_streaming does, with the
+ *             same output, but in chunks of rows that pass through a
+ *             pipeline (see pipeline40.h): while one chunk is compressed,
+ *             the next is read and the one before is written. A bad file
+ *             is raised on the calling thread once the pipeline has
+ *             stopped, after the chunks before the error were written.
+ *  Return:    void
+ */
+static void compress_pipelined(FILE *input, Codec40_opts opts)
+{
+    Ppmreader_T reader = Ppmreader_new(input);
+    unsigned pixels = Ppmreader_width(reader);
+    struct Pipelined pipelined = {
+        .reader = reader, .output = Codec40_output(opts),
+        .pixels = pixels, .width = pixels / 2,
+        .height = Ppmreader_height(reader) / 2,
+        .denominator = Ppmreader_denominator(reader),
+        .fixed_point = opts->fixed_point
+    };
+    fprintf(pipelined.output, "COMP40 Compressed image format 2\n%u %u\n",
+            pipelined.width, pipelined.height);
+
+    if (pipelined.width > 0 && pipelined.height > 0) {
+        size_t pair = (size_t)pixels * 2 * sizeof(struct Pnm_rgb);
+        size_t rows = CHUNK_BYTES / pair;
+        rows = rows == 0 ? 1 : rows;
+        pipelined.chunk_rows = rows > pipelined.height ? pipelined.height
+                                                       : rows;
+        unsigned chunks = (pipelined.height + pipelined.chunk_rows - 1) /
+                          pipelined.chunk_rows;
+        if (!Pipeline40_run(chunks, PIPELINE_SLOTS,
+                            pipelined.chunk_rows * pair,
+                            (size_t)pipelined.chunk_rows * pipelined.width *
+                            sizeof(uint32_t), read_chunk, compress_chunk,
+                            write_chunk, &pipelined, opts->pipeline_stats)) {
+            Ppmreader_free(&reader);
+            RAISE(Pnm_Badformat);
+        }
+    }
+    Ppmreader_finish(reader);
+    Ppmreader_free(&reader);
+}
+
 /*
  *  Function:  compress40
  *  Arguments: FILE *input - a non-null pointer to an opened PPM image file
@@ -244,30 +644,135 @@ static void compress_cb(int col, int row, A2Methods_UArray2 image, void *elem,
  *  Return:    void
  */
 void compress40(FILE *input)
+{
+    compress40_opts(input, NULL);
+}
+
+/*
+ *  Function:  compress40_opts
+ *  Arguments: FILE *input - a non-null pointer to an opened PPM image file
+ *             Codec40_opts opts - options selecting how the image is
+ *                                 compressed, or NULL for the defaults
+ *  Does:      Compresses a provided PPM file and writes the compressed PPM to
+ *             stdout, or opts->output. The output depends only on
+ *             opts->fixed_point. Does not close the provided FILE pointer.
+ *  Return:    void
+ */
+void compress40_opts(FILE *input, Codec40_opts opts)
 {
     assert(input != NULL);
-    
-    /* use methods for a blocked 2D array */
-    A2Methods_T methods = uarray2_methods_blocked;
+    bool fixed_point = opts != NULL && opts->fixed_point;
+    if (opts != NULL && opts->pipelined) {
+        compress_pipelined(input, opts);
+        return;
+    }
+    if (opts != NULL && opts->streaming) {
+        compress_streaming(input, opts);
+        return;
+    }
+    unsigned threads = opts != NULL ? opts->threads : 1;
+    bool fused = opts != NULL && (opts->fused || fixed_point || threads > 1);
 
-    /* store the pixels in a blocked 2D array with a blocksize of 2 (new method
-       of uarray2_methods_blocked defaults to 2 instead of the maximum size) */
+    /* the fused kernel reads whole scanlines, so it needs a row-major array;
+       otherwise store the pixels in a blocked 2D array with a blocksize of 2
+       (new method of uarray2_methods_blocked defaults to 2 instead of the
+       maximum size), unless the options name another suite */
+    A2Methods_T methods = uarray2_methods_blocked;
+    if (fused) {
+        methods = uarray2_methods_plain;
+    } else if (opts != NULL && opts->methods != NULL) {
+        methods = opts->methods;
+    }
     Pnm_ppm image = Pnm_ppmread(input, methods);
     assert(image != NULL && image->pixels != NULL);
 
-    /* create the compressed image unboxed 2D array */
-    UArray2_T compressed = UArray2_new(image->width / 2, image->height / 2,
-                                       sizeof(uint32_t));
-
-    /* map across each 2x2 block and compress/store each block */
-    float y_vals[4];
-    struct Compression_Info c_info = {compressed, y_vals, 0, 0,
-                                      image->denominator, image->width,
-                                      image->height};
-    methods->map_block_major(image->pixels, compress_cb, &c_info);
+    UArray2_T compressed = fused ? compress_fused(image, opts)
+                                 : compress_mapped(image, opts);
 
-    /* write the compressed image to stdout and free heap-allocated memory */
-    write_compressed(compressed);
+    /* write the compressed image and free heap-allocated memory */
+    write_compressed(compressed, Codec40_output(opts));
     UArray2_free(&compressed);
     Pnm_ppmfree(&image);
 }
+
+/*
+ *  Function:  uses_row_kernels
+ *  Arguments: Codec40_opts opts - compression options, or NULL
+ *  Does:      Tells whether compress40_opts would compress with the fused
+ *             row kernels under these options, rather than by mapping over
+ *             a pixmap.
+ *  Return:    bool - true for the fused, fixed-point, threaded, streaming
+ *             and pipelined paths
+ */
+static bool uses_row_kernels(Codec40_opts opts)
+{
+    return opts != NULL && (opts->fused || opts->fixed_point ||
+                            opts->threads > 1 || opts->streaming ||
+                            opts->pipelined);
+}
+
+/*
+ *  Function:  compress40_inplace
+ *  Arguments: const unsigned char *data - a whole PPM file held in memory,
+ *                                         such as a mapped file
+ *             size_t size - the number of bytes in data
+ *             Codec40_opts opts - options selecting how the image is
+ *                                 compressed, or NULL for the defaults
+ *  Does:      Compresses a binary PPM straight from its raster in memory,
+ *             with no intermediate pixmap, and writes the compressed PPM to
+ *             stdout, or opts->output. With one thread each row of words
+ *             is written as soon as it is compressed; with more, bands of
+ *             rows are compressed in parallel into an array which is then
+ *             written. The output is the same as compress40_opts would
+ *             write for the same file and options. Only the fused row
+ *             kernels work in place, so options that choose the
+ *             callback-based path (the defaults, or an A2Methods suite
+ *             without fused) are left to compress40_opts. Nothing is
+ *             written unless the whole file is a valid binary PPM of at
+ *             least 2x2 pixels.
+ *  Return:    bool - false if data could not be compressed in place, in
+ *             which case the caller should use compress40_opts, which
+ *             handles every other format and option and reports errors
+ */
+bool compress40_inplace(const unsigned char *data, size_t size,
+                        Codec40_opts opts)
+{
+    assert(data != NULL);
+    unsigned pixels, lines, denominator;
+    const unsigned char *raster;
+    if (!uses_row_kernels(opts) ||
+        !Ppmreader_raster(data, size, &pixels, &lines, &denominator,
+                          &raster) || pixels < 2 || lines < 2) {
+        return false;
+    }
+    unsigned width = pixels / 2;
+    unsigned height = lines / 2;
+    size_t scanline = (size_t)pixels * 3 * (denominator > 255 ? 2 : 1);
+    unsigned threads = opts != NULL ? opts->threads : 1;
+    bool fixed_point = opts != NULL && opts->fixed_point;
+    FILE *output = Codec40_output(opts);
+
+    if (threads > 1) {
+        UArray2_T compressed = Codec40_array(opts, width, height,
+                                             sizeof(uint32_t));
+        struct Band whole = { NULL, raster, scanline, denominator,
+                              compressed, 0, height, fixed_point };
+        compress_bands(whole, threads);
+        write_compressed(compressed, output);
+        UArray2_free(&compressed);
+        return true;
+    }
+
+    uint32_t *words = Codec40_alloc(opts, width * sizeof(*words));
+    assert(words != NULL);
+    fprintf(output, "COMP40 Compressed image format 2\n%u %u\n", width,
+            height);
+    for (unsigned row = 0; row < height; row++) {
+        const unsigned char *top = &raster[scanline * 2 * row];
+        (fixed_point ? compress_row_raw_fixed : compress_row_raw)(
+            top, top + scanline, width, denominator, words);
+        write_words(output, words, width);
+    }
+    Codec40_release(opts, words);
+    return true;
+}
@@ -0,0 +1,589 @@
+/******************************************************************************
+ *
+ *                               compressrow.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the compressrow.h interface, a fused compression kernel
+ *     which converts two scanlines of a PPM image into one row of bitpacked
+ *     words in a single pass. Scaling, the component-video transform, the
+ *     DCT, quantization and bitpacking are all done in one loop over the
+ *     2x2 pixel groups, with no per-pixel callbacks.
+ *
+ *     The arithmetic mirrors compressmath.c operation for operation (same
+ *     constants, same precision, same order of evaluation), so that the
+ *     words produced here are identical to the ones produced by mapping
+ *     compress_cb over a blocked array.
+ *
+ *     On x86 processors with AVX2, compress_row handles 8 pixel groups per
+ *     iteration in structure-of-arrays form. Because compressmath.c does the
+ *     color transform with double-precision constants, the vector code does
+ *     it in double-precision lanes too, and rounds half away from zero the
+ *     way round() does, so it stays bit-exact with the scalar reference.
+ *     Groups outside the vector loop are computed a chunk at a time and
+ *     packed with the bulk Bitpack40_pack_n.
+ *
+ *     Scanlines may be given either as arrays of Pnm_rgb structs or as the
+ *     raw bytes of a binary PPM raster (one byte per sample when the
+ *     denominator is below 256, two big endian bytes otherwise), so that a
+ *     memory-mapped file can be compressed in place.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "assert.h"
+
+#include "bitpack40.h"
+#include "chroma40.h"
+#include "compressinfo.h"
+#include "compressrow.h"
+#include "cpufeatures.h"
+#include "cvtable40.h"
+#include "scanline.h"
+
+/* Number of pixel groups whose fields are packed with one bulk call */
+#define BULK_GROUPS 64
+
+/* Static function declarations */
+static inline void pixel_to_cv(const void *row, size_t pixel,
+                               Sample_format format, float denom,
+                               const Cvtable40 *table, float *y, float *pb,
+                               float *pr);
+static inline int quantize_dct_val(float dct_val);
+static inline Bitpack40_fields compress_block(const void *top,
+                                              const void *bottom, size_t col,
+                                              Sample_format format,
+                                              float denom,
+                                              const Cvtable40 *table,
+                                              const Chroma40_tables *chroma);
+static void compress_groups(const void *top, const void *bottom,
+                            unsigned first, unsigned end,
+                            Sample_format format, float denom,
+                            const Cvtable40 *table, uint32_t *words);
+static void compress_row_format(const void *top, const void *bottom,
+                                unsigned width, unsigned denominator,
+                                uint32_t *words, Sample_format format);
+
+/*
+ *  Function:  pixel_to_cv
+ *  Arguments: const void *row - the scanline containing the pixel
+ *             size_t pixel - the column of the pixel
+ *             Sample_format format - how the scanline is stored
+ *             float denom - the denominator of the source image as a float
+ *             const Cvtable40 *table - the color transform table of the
+ *                                      denominator, or NULL if it has none
+ *             float *y, *pb, *pr - filled in with the component-video values
+ *                                  of the pixel
+ *  Does:      Scales a pixel into the range [0, 1] and transforms it to
+ *             component-video space, exactly as scale_rgb followed by
+ *             rgb_to_cv would. With a table, a pixel whose samples all fit
+ *             in 8 bits (every one, in a valid image) is looked up instead.
+ *  Return:    void
+ */
+static inline void pixel_to_cv(const void *row, size_t pixel,
+                               Sample_format format, float denom,
+                               const Cvtable40 *table, float *y, float *pb,
+                               float *pr)
+{
+    unsigned r = get_sample(row, 3 * pixel, format);
+    unsigned g = get_sample(row, 3 * pixel + 1, format);
+    unsigned b = get_sample(row, 3 * pixel + 2, format);
+    if (table != NULL && (r | g | b) < CVTABLE40_SAMPLES) {
+        Cvtable40_cv(table, r, g, b, y, pb, pr);
+        return;
+    }
+
+    float red = r / denom;
+    float green = g / denom;
+    float blue = b / denom;
+
+    *y = 0.299 * red + 0.587 * green + 0.114 * blue;
+    *pb = -0.168736 * red - 0.331264 * green + 0.5 * blue;
+    *pr = 0.5 * red - 0.418688 * green - 0.081312 * blue;
+}
+
+/*
+ *  Function:  quantize_dct_val
+ *  Arguments: float dct_val - a DCT value to be quantized
+ *  Does:      Same quantization as quantize_dct in compressmath.c, without
+ *             the overhead of an external call.
+ *  Return:    int - the quantized DCT value in the set {−15, −14,... , 15}
+ */
+static inline int quantize_dct_val(float dct_val)
+{
+    if (dct_val <= -0.3) {
+        return -15;
+    } else if (dct_val >= 0.3) {
+        return 15;
+    }
+    return round(dct_val * 50);
+}
+
+/*
+ *  Function:  compress_block
+ *  Arguments: const void *top - the upper scanline of a row of pixel groups
+ *             const void *bottom - the lower scanline
+ *             size_t col - the column of the pixel group; its pixels are in
+ *                          columns 2 * col and 2 * col + 1 of the scanlines
+ *             Sample_format format - how the scanlines are stored
+ *             float denom - the denominator of the source image as a float
+ *             const Cvtable40 *table - the color transform table, or NULL
+ *             const Chroma40_tables *chroma - the chroma quantization table
+ *  Does:      Compresses one 2x2 pixel group into the quantized fields
+ *             of its word. Chroma values are summed in the same order that
+ *             UArray2b_map visits the cells of a block (top-left,
+ *             bottom-left, top-right, bottom-right) so that the float sums
+ *             match bit for bit.
+ *  Return:    Bitpack40_fields - the fields of the pixel group's word
+ */
+static inline Bitpack40_fields compress_block(const void *top,
+                                              const void *bottom, size_t col,
+                                              Sample_format format,
+                                              float denom,
+                                              const Cvtable40 *table,
+                                              const Chroma40_tables *chroma)
+{
+    float y_vals[4], pb[4], pr[4];
+    pixel_to_cv(top, 2 * col, format, denom, table, &y_vals[0], &pb[0],
+                &pr[0]);
+    pixel_to_cv(top, 2 * col + 1, format, denom, table, &y_vals[1], &pb[1],
+                &pr[1]);
+    pixel_to_cv(bottom, 2 * col, format, denom, table, &y_vals[2], &pb[2],
+                &pr[2]);
+    pixel_to_cv(bottom, 2 * col + 1, format, denom, table, &y_vals[3],
+                &pb[3], &pr[3]);
+
+    /* DCT of the four brightness values */
+    float a = (y_vals[3] + y_vals[2] + y_vals[1] + y_vals[0]) / 4.0;
+    float b = (y_vals[3] + y_vals[2] - y_vals[1] - y_vals[0]) / 4.0;
+    float c = (y_vals[3] - y_vals[2] + y_vals[1] - y_vals[0]) / 4.0;
+    float d = (y_vals[3] - y_vals[2] - y_vals[1] + y_vals[0]) / 4.0;
+
+    /* average chroma, accumulated in block-major visiting order */
+    float sum_pb = 0;
+    float sum_pr = 0;
+    sum_pb += pb[0];
+    sum_pr += pr[0];
+    sum_pb += pb[2];
+    sum_pr += pr[2];
+    sum_pb += pb[1];
+    sum_pr += pr[1];
+    sum_pb += pb[3];
+    sum_pr += pr[3];
+    float avg_pb = sum_pb / 4.0;
+    float avg_pr = sum_pr / 4.0;
+
+    Bitpack40_fields fields = {
+        (unsigned)round(a * 63), quantize_dct_val(b), quantize_dct_val(c),
+        quantize_dct_val(d), Chroma40_index(chroma, avg_pb),
+        Chroma40_index(chroma, avg_pr)
+    };
+    return fields;
+}
+
+/*
+ *  Function:  compress_groups
+ *  Arguments: const void *top, *bottom - the scanlines of a row of pixel
+ *                                        groups
+ *             unsigned first, end - the range of pixel groups to compress
+ *             Sample_format format - how the scanlines are stored
+ *             float denom - the denominator of the source image as a float
+ *             const Cvtable40 *table - the color transform table, or NULL
+ *             uint32_t *words - the row of words; words first to end - 1 are
+ *                               filled in
+ *  Does:      Compresses a range of pixel groups a chunk at a time: the
+ *             fields of up to BULK_GROUPS groups are gathered into columns
+ *             and packed with one call to the bulk Bitpack40_pack_n.
+ *  Return:    void
+ */
+static void compress_groups(const void *top, const void *bottom,
+                            unsigned first, unsigned end,
+                            Sample_format format, float denom,
+                            const Cvtable40 *table, uint32_t *words)
+{
+    unsigned a[BULK_GROUPS], pb[BULK_GROUPS], pr[BULK_GROUPS];
+    int b[BULK_GROUPS], c[BULK_GROUPS], d[BULK_GROUPS];
+    Bitpack40_columns columns = { a, b, c, d, pb, pr };
+    const Chroma40_tables *chroma = Chroma40_get();
+
+    for (unsigned col = first; col < end; col += BULK_GROUPS) {
+        unsigned n = end - col < BULK_GROUPS ? end - col : BULK_GROUPS;
+        for (unsigned i = 0; i < n; i++) {
+            Bitpack40_fields fields = compress_block(top, bottom, col + i,
+                                                     format, denom, table,
+                                                     chroma);
+            a[i] = fields.a;
+            b[i] = fields.b;
+            c[i] = fields.c;
+            d[i] = fields.d;
+            pb[i] = fields.pb;
+            pr[i] = fields.pr;
+        }
+        Bitpack40_pack_n(n, columns, &words[col]);
+    }
+}
+
+/*
+ *  Function:  compress_row_scalar
+ *  Arguments: const struct Pnm_rgb *top - a scanline of at least 2 * width
+ *                                         pixels (an even-numbered row of
+ *                                         the source image)
+ *             const struct Pnm_rgb *bottom - the scanline directly below top
+ *             unsigned width - the number of 2x2 pixel groups in the row,
+ *                              which is also the number of words produced
+ *             unsigned denominator - the denominator of the source image
+ *             uint32_t *words - an array of at least width words to be
+ *                               filled with the compressed row
+ *  Does:      Compresses two scanlines of a PPM image into one row of
+ *             bitpacked words, one pixel group at a time. This is the
+ *             portable reference for the SIMD kernel.
+ *  Return:    void
+ */
+void compress_row_scalar(const struct Pnm_rgb *top,
+                         const struct Pnm_rgb *bottom, unsigned width,
+                         unsigned denominator, uint32_t *words)
+{
+    assert(top != NULL && bottom != NULL && words != NULL);
+    float denom = (float)denominator;
+    const Cvtable40 *table = Cvtable40_get(denominator);
+    const Chroma40_tables *chroma = Chroma40_get();
+
+    for (unsigned col = 0; col < width; col++) {
+        Bitpack40_fields fields = compress_block(top, bottom, col,
+                                                 SAMPLES_RGB, denom, table,
+                                                 chroma);
+        words[col] = Bitpack40_pack(fields.a, fields.b, fields.c, fields.d,
+                                    fields.pb, fields.pr);
+    }
+}
+
+#ifdef CPUFEATURES_X86
+
+/* Number of pixel groups compressed per iteration of the AVX2 kernel */
+#define AVX2_BLOCKS 8
+
+/*
+ *  Function:  load_channel_avx2
+ *  Arguments: const void *row - a scanline
+ *             __m256i samples - indices within the scanline of 8 samples of
+ *                               one channel (see get_sample)
+ *             Sample_format format - how the scanline is stored
+ *             __m256 denom - the image denominator in every lane
+ *  Does:      Gathers one channel of 8 pixels and scales it to [0, 1] with
+ *             the same float division that scale_rgb uses. Raw samples are
+ *             gathered as whole 32-bit lanes and masked, so up to 3 bytes
+ *             past the last sample may be read.
+ *  Return:    __m256 - the 8 scaled channel values
+ */
+TARGET_AVX2
+static inline __m256 load_channel_avx2(const void *row, __m256i samples,
+                                       Sample_format format, __m256 denom)
+{
+    __m256i raw;
+    __m256i low_byte = _mm256_set1_epi32(0xff);
+    switch (format) {
+    case SAMPLES_RGB:
+        raw = _mm256_i32gather_epi32((const int *)row, samples, 4);
+        break;
+    case SAMPLES_RAW8:
+        raw = _mm256_and_si256(
+            _mm256_i32gather_epi32((const int *)row, samples, 1), low_byte);
+        break;
+    default:
+        raw = _mm256_i32gather_epi32((const int *)row, samples, 2);
+        raw = _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(raw, low_byte), 8),
+            _mm256_and_si256(_mm256_srli_epi32(raw, 8), low_byte));
+        break;
+    }
+    return _mm256_div_ps(_mm256_cvtepi32_ps(raw), denom);
+}
+
+/*
+ *  Function:  cv_half_avx2
+ *  Arguments: __m128 red, green, blue - 4 scaled pixels in float
+ *             __m128 *y, *pb, *pr - filled in with the component-video
+ *                                   values of the 4 pixels
+ *  Does:      Performs rgb_to_cv on 4 pixels, widening to double precision
+ *             and evaluating each sum in the same order as compressmath.c.
+ *  Return:    void
+ */
+TARGET_AVX2
+static inline void cv_half_avx2(__m128 red, __m128 green, __m128 blue,
+                                __m128 *y, __m128 *pb, __m128 *pr)
+{
+    __m256d r = _mm256_cvtps_pd(red);
+    __m256d g = _mm256_cvtps_pd(green);
+    __m256d b = _mm256_cvtps_pd(blue);
+
+    __m256d yd = _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(0.299), r),
+                      _mm256_mul_pd(_mm256_set1_pd(0.587), g)),
+        _mm256_mul_pd(_mm256_set1_pd(0.114), b));
+    __m256d pbd = _mm256_add_pd(
+        _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(-0.168736), r),
+                      _mm256_mul_pd(_mm256_set1_pd(0.331264), g)),
+        _mm256_mul_pd(_mm256_set1_pd(0.5), b));
+    __m256d prd = _mm256_sub_pd(
+        _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), r),
+                      _mm256_mul_pd(_mm256_set1_pd(0.418688), g)),
+        _mm256_mul_pd(_mm256_set1_pd(0.081312), b));
+
+    *y = _mm256_cvtpd_ps(yd);
+    *pb = _mm256_cvtpd_ps(pbd);
+    *pr = _mm256_cvtpd_ps(prd);
+}
+
+/*
+ *  Function:  pixels_to_cv_avx2
+ *  Arguments: const void *row - the scanline containing the pixels
+ *             __m256i samples - indices within the scanline of the red
+ *                               samples of the 8 pixels
+ *             Sample_format format - how the scanline is stored
+ *             __m256 denom - the image denominator in every lane
+ *             __m256 *y, *pb, *pr - filled in with the component-video
+ *                                   values of the 8 pixels
+ *  Does:      Loads 8 pixels into structure-of-arrays form, scales them and
+ *             transforms them to component-video space.
+ *  Return:    void
+ */
+TARGET_AVX2
+static inline void pixels_to_cv_avx2(const void *row, __m256i samples,
+                                     Sample_format format, __m256 denom,
+                                     __m256 *y, __m256 *pb, __m256 *pr)
+{
+    __m256i one = _mm256_set1_epi32(1);
+    __m256 red = load_channel_avx2(row, samples, format, denom);
+    samples = _mm256_add_epi32(samples, one);
+    __m256 green = load_channel_avx2(row, samples, format, denom);
+    samples = _mm256_add_epi32(samples, one);
+    __m256 blue = load_channel_avx2(row, samples, format, denom);
+
+    __m128 y_lo, y_hi, pb_lo, pb_hi, pr_lo, pr_hi;
+    cv_half_avx2(_mm256_castps256_ps128(red), _mm256_castps256_ps128(green),
+                 _mm256_castps256_ps128(blue), &y_lo, &pb_lo, &pr_lo);
+    cv_half_avx2(_mm256_extractf128_ps(red, 1),
+                 _mm256_extractf128_ps(green, 1),
+                 _mm256_extractf128_ps(blue, 1), &y_hi, &pb_hi, &pr_hi);
+
+    *y = _mm256_insertf128_ps(_mm256_castps128_ps256(y_lo), y_hi, 1);
+    *pb = _mm256_insertf128_ps(_mm256_castps128_ps256(pb_lo), pb_hi, 1);
+    *pr = _mm256_insertf128_ps(_mm256_castps128_ps256(pr_lo), pr_hi, 1);
+}
+
+/*
+ *  Function:  round_avx2
+ *  Arguments: __m256 x - 8 floats to be rounded
+ *  Does:      Rounds each lane to the nearest integer, with halfway cases
+ *             rounded away from zero like round(). The fractional part
+ *             x - trunc(x) is exact in float, so no precision is lost.
+ *  Return:    __m256i - the rounded values as 32-bit integers
+ */
+TARGET_AVX2
+static inline __m256i round_avx2(__m256 x)
+{
+    __m256 whole = _mm256_round_ps(x, _MM_FROUND_TO_ZERO |
+                                      _MM_FROUND_NO_EXC);
+    __m256 frac = _mm256_sub_ps(x, whole);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 up = _mm256_and_ps(_mm256_cmp_ps(frac, _mm256_set1_ps(0.5f),
+                                            _CMP_GE_OQ), one);
+    __m256 down = _mm256_and_ps(_mm256_cmp_ps(frac, _mm256_set1_ps(-0.5f),
+                                              _CMP_LE_OQ), one);
+    return _mm256_cvttps_epi32(_mm256_sub_ps(_mm256_add_ps(whole, up),
+                                             down));
+}
+
+/*
+ *  Function:  quantize_dct_avx2
+ *  Arguments: __m256 dct_vals - 8 DCT values to be quantized
+ *  Does:      Vector version of quantize_dct. Comparing a float against the
+ *             double 0.3 gives the same answer as comparing it against
+ *             (float)0.3, since no float lies between the two.
+ *  Return:    __m256i - the quantized values in the set {−15, −14,... , 15}
+ */
+TARGET_AVX2
+static inline __m256i quantize_dct_avx2(__m256 dct_vals)
+{
+    __m256i quantized = round_avx2(_mm256_mul_ps(dct_vals,
+                                                 _mm256_set1_ps(50.0f)));
+    __m256i low = _mm256_castps_si256(
+        _mm256_cmp_ps(dct_vals, _mm256_set1_ps(-0.3f), _CMP_LE_OQ));
+    __m256i high = _mm256_castps_si256(
+        _mm256_cmp_ps(dct_vals, _mm256_set1_ps(0.3f), _CMP_GE_OQ));
+    quantized = _mm256_blendv_epi8(quantized, _mm256_set1_epi32(-15), low);
+    return _mm256_blendv_epi8(quantized, _mm256_set1_epi32(15), high);
+}
+
+/*
+ *  Function:  compress_blocks_avx2
+ *  Arguments: const void *top - the upper scanline of a row of pixel groups
+ *             const void *bottom - the lower scanline
+ *             unsigned col - the column of the first of 8 consecutive pixel
+ *                            groups
+ *             Sample_format format - how the scanlines are stored
+ *             __m256 denom - the image denominator in every lane
+ *             const Chroma40_tables *chroma - the chroma quantization table
+ *             uint32_t *words - filled in with the 8 bitpacked words
+ *  Does:      Compresses 8 consecutive 2x2 pixel groups at once, including
+ *             the quantization of their chroma values.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void compress_blocks_avx2(const void *top, const void *bottom,
+                                 unsigned col, Sample_format format,
+                                 __m256 denom, const Chroma40_tables *chroma,
+                                 uint32_t *words)
+{
+    /* each group is two pixels wide, so its left pixel's red sample is 6
+       samples after the previous group's and its right pixel's is 3 after
+       its left pixel's */
+    __m256i left = _mm256_add_epi32(
+        _mm256_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42),
+        _mm256_set1_epi32(6 * col));
+    __m256i right = _mm256_add_epi32(left, _mm256_set1_epi32(3));
+
+    __m256 y0, y1, y2, y3, pb0, pb1, pb2, pb3, pr0, pr1, pr2, pr3;
+    pixels_to_cv_avx2(top, left, format, denom, &y0, &pb0, &pr0);
+    pixels_to_cv_avx2(top, right, format, denom, &y1, &pb1, &pr1);
+    pixels_to_cv_avx2(bottom, left, format, denom, &y2, &pb2, &pr2);
+    pixels_to_cv_avx2(bottom, right, format, denom, &y3, &pb3, &pr3);
+
+    /* DCT; dividing by 4 is exact, so multiplying by 0.25 is equivalent */
+    __m256 quarter = _mm256_set1_ps(0.25f);
+    __m256 a = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_add_ps(y3, y2), y1), y0), quarter);
+    __m256 b = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(
+        _mm256_add_ps(y3, y2), y1), y0), quarter);
+    __m256 c = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(
+        _mm256_sub_ps(y3, y2), y1), y0), quarter);
+    __m256 d = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(
+        _mm256_sub_ps(y3, y2), y1), y0), quarter);
+
+    /* average chroma, summed in block-major visiting order */
+    __m256 zero = _mm256_setzero_ps();
+    __m256 avg_pb = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(zero, pb0), pb2), pb1), pb3), quarter);
+    __m256 avg_pr = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(zero, pr0), pr2), pr1), pr3), quarter);
+
+    __m256i word = Bitpack40_pack_avx2(
+        round_avx2(_mm256_mul_ps(a, _mm256_set1_ps(63.0f))),
+        quantize_dct_avx2(b), quantize_dct_avx2(c), quantize_dct_avx2(d),
+        Chroma40_index_avx2(chroma, avg_pb),
+        Chroma40_index_avx2(chroma, avg_pr));
+    _mm256_storeu_si256((__m256i *)words, word);
+}
+
+/*
+ *  Function:  compress_row_avx2
+ *  Arguments: see compress_row_format
+ *  Does:      Compresses two scanlines 8 pixel groups at a time, finishing
+ *             any leftover groups with compress_groups. The color transform
+ *             is computed rather than looked up in a Cvtable40: gathering
+ *             nine table entries per pixel takes about twice as long as the
+ *             vector arithmetic, and the few leftover groups are not worth
+ *             building a table for. Raw scanlines may end right at the
+ *             end of a mapped file, so for them the last group is always
+ *             left to compress_groups, which keeps the over-reads of
+ *             load_channel_avx2 inside the scanline.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void compress_row_avx2(const void *top, const void *bottom,
+                              unsigned width, unsigned denominator,
+                              uint32_t *words, Sample_format format)
+{
+    float denom = (float)denominator;
+    __m256 denoms = _mm256_set1_ps(denom);
+    const Chroma40_tables *chroma = Chroma40_get();
+    unsigned vector_end = width;
+    if (format != SAMPLES_RGB) {
+        vector_end = width > AVX2_BLOCKS ? width - 1 : 0;
+    }
+    unsigned col = 0;
+
+    for (; col + AVX2_BLOCKS <= vector_end; col += AVX2_BLOCKS) {
+        compress_blocks_avx2(top, bottom, col, format, denoms, chroma,
+                             &words[col]);
+    }
+    compress_groups(top, bottom, col, width, format, denom, NULL, words);
+}
+
+#endif
+
+/*
+ *  Function:  compress_row_format
+ *  Arguments: const void *top - the upper scanline (an even-numbered row of
+ *                               the source image) of at least 2 * width
+ *                               pixels
+ *             const void *bottom - the scanline directly below top
+ *             unsigned width - the number of 2x2 pixel groups in the row
+ *             unsigned denominator - the denominator of the source image
+ *             uint32_t *words - an array of at least width words to be
+ *                               filled with the compressed row
+ *             Sample_format format - how the scanlines are stored
+ *  Does:      Compresses two scanlines with the fastest kernel the
+ *             processor supports.
+ *  Return:    void
+ */
+static void compress_row_format(const void *top, const void *bottom,
+                                unsigned width, unsigned denominator,
+                                uint32_t *words, Sample_format format)
+{
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        compress_row_avx2(top, bottom, width, denominator, words, format);
+        return;
+    }
+#endif
+    compress_groups(top, bottom, 0, width, format, (float)denominator,
+                    Cvtable40_get(denominator), words);
+}
+
+/*
+ *  Function:  compress_row
+ *  Arguments: see compress_row_scalar
+ *  Does:      Compresses two scanlines of a PPM image into one row of
+ *             bitpacked words with the fastest kernel the processor
+ *             supports. Produces exactly the words that the callback-based
+ *             path in compress40.c would.
+ *  Return:    void
+ */
+void compress_row(const struct Pnm_rgb *top, const struct Pnm_rgb *bottom,
+                  unsigned width, unsigned denominator, uint32_t *words)
+{
+    assert(top != NULL && bottom != NULL && words != NULL);
+    compress_row_format(top, bottom, width, denominator, words, SAMPLES_RGB);
+}
+
+/*
+ *  Function:  compress_row_raw
+ *  Arguments: const unsigned char *top - the raster bytes of a scanline of a
+ *                                        binary PPM image (an even-numbered
+ *                                        row) of at least 2 * width pixels
+ *             const unsigned char *bottom - the raster bytes of the
+ *                                           scanline directly below top
+ *             unsigned width - the number of 2x2 pixel groups in the row
+ *             unsigned denominator - the denominator of the source image,
+ *                                    which determines whether samples are
+ *                                    one or two bytes wide
+ *             uint32_t *words - an array of at least width words to be
+ *                               filled with the compressed row
+ *  Does:      Compresses two scanlines of a binary PPM raster in place,
+ *             without decoding them into Pnm_rgb structs first. Produces
+ *             the same words as compress_row. Samples are not checked
+ *             against the denominator.
+ *  Return:    void
+ */
+void compress_row_raw(const unsigned char *top, const unsigned char *bottom,
+                      unsigned width, unsigned denominator, uint32_t *words)
+{
+    assert(top != NULL && bottom != NULL && words != NULL);
+    compress_row_format(top, bottom, width, denominator, words,
+                        denominator > 255 ? SAMPLES_RAW16 : SAMPLES_RAW8);
+}
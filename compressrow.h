@@ -0,0 +1,32 @@
+/******************************************************************************
+ *
+ *                               compressrow.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for the fused compression kernel, which turns two scanlines
+ *     of a PPM image into one row of bitpacked 32-bit words. (See the
+ *     implementation file compressrow.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+
+#include "pnm.h"
+
+#ifndef COMPRESSROW_H
+#define COMPRESSROW_H
+
+extern void compress_row(const struct Pnm_rgb *top,
+                         const struct Pnm_rgb *bottom, unsigned width,
+                         unsigned denominator, uint32_t *words);
+extern void compress_row_scalar(const struct Pnm_rgb *top,
+                                const struct Pnm_rgb *bottom, unsigned width,
+                                unsigned denominator, uint32_t *words);
+extern void compress_row_raw(const unsigned char *top,
+                             const unsigned char *bottom, unsigned width,
+                             unsigned denominator, uint32_t *words);
+
+#endif
@@ -0,0 +1,309 @@
+/******************************************************************************
+ *
+ *                                context40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the context40.h interface on top of buffer40.h. A buffer
+ *     that is too small is replaced by one of exactly the size needed (its
+ *     old contents are never needed again, so it is freed and allocated
+ *     rather than reallocated, which would copy them); frames of one size
+ *     therefore cost one allocation per buffer in all. Decompressed pixels
+ *     are stored tightly, 6 * width bytes per scanline.
+ *
+ *     Allocation failures are returned as BUFFER40_NO_MEMORY rather than
+ *     raised, except in Context40_new, which allocates with mem.h as the
+ *     other constructors do.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "context40.h"
+
+#define T Context40_T
+
+struct T {
+    bool fixed_point;
+    Rgbtable40_T table;      /* NULL unless decoding through a table */
+    uint32_t *words;         /* compressed words of the last frame */
+    size_t word_bytes;       /* capacity of words */
+    unsigned char *pixels;   /* decompressed scanlines of the last frame */
+    size_t pixel_bytes;      /* capacity of pixels */
+    uint64_t calls, allocations;
+};
+
+/* Static function declarations */
+static void *reserve(T context, void *buffer, size_t *capacity,
+                     size_t needed);
+static Buffer40_status decode(T context, const void *words, bool big_endian,
+                              unsigned width, unsigned height,
+                              const unsigned char **pixels);
+
+/*
+ *  Function:  Context40_new
+ *  Arguments: bool fixed_point - whether to use the fixed-point kernels
+ *             bool rgb_table - whether to decode through a direct-to-RGB
+ *                              table (ignored with fixed_point, as for
+ *                              Codec40_opts)
+ *  Does:      Creates a context with no buffers yet, and its table if it
+ *             is to have one.
+ *  Return:    Context40_T - the new context, freed with Context40_free
+ */
+T Context40_new(bool fixed_point, bool rgb_table)
+{
+    T context;
+    NEW(context);
+    context->fixed_point = fixed_point;
+    context->table = NULL;
+    context->words = NULL;
+    context->word_bytes = 0;
+    context->pixels = NULL;
+    context->pixel_bytes = 0;
+    context->calls = context->allocations = 0;
+    if (rgb_table && !fixed_point) {
+        context->table = Rgbtable40_new();
+        context->allocations++;
+    }
+    return context;
+}
+
+/*
+ *  Function:  Context40_free
+ *  Arguments: Context40_T *context - pointer to the context to free
+ *  Does:      Frees a context and everything it owns, including the
+ *             buffers returned by its last calls, and sets *context to
+ *             NULL.
+ *  Return:    void
+ */
+void Context40_free(T *context)
+{
+    assert(context != NULL && *context != NULL);
+    if ((*context)->table != NULL) {
+        Rgbtable40_free(&(*context)->table);
+    }
+    free((*context)->words);
+    free((*context)->pixels);
+    FREE(*context);
+}
+
+/*
+ *  Function:  reserve
+ *  Arguments: Context40_T context - the context owning the buffer
+ *             void *buffer - the buffer, or NULL if there is none yet
+ *             size_t *capacity - its size in bytes
+ *             size_t needed - the size in bytes the next frame needs
+ *  Does:      Replaces the buffer with one of needed bytes if it holds
+ *             fewer, freeing it and counting the allocation.
+ *  Return:    void * - the buffer to use, or NULL if it had to be replaced
+ *             and could not be, in which case the old one is kept
+ */
+static void *reserve(T context, void *buffer, size_t *capacity,
+                     size_t needed)
+{
+    if (needed <= *capacity) {
+        return buffer;
+    }
+    void *bigger = malloc(needed);
+    if (bigger == NULL) {
+        return NULL;
+    }
+    free(buffer);
+    *capacity = needed;
+    context->allocations++;
+    return bigger;
+}
+
+/*
+ *  Function:  Context40_compress
+ *  Arguments: Context40_T context - the context
+ *             const unsigned char *pixels, size_t stride, size_t size,
+ *             unsigned width, height, denominator - the frame, as for
+ *                                                   Buffer40_compress
+ *             const uint32_t **words - set to the (width / 2) *
+ *                                      (height / 2) compressed words,
+ *                                      row-major, which the context owns
+ *                                      and keeps until its next compress
+ *  Does:      Compresses a frame into the context's word buffer, growing
+ *             it first if need be.
+ *  Return:    Buffer40_status - BUFFER40_OK, or why nothing was done
+ */
+Buffer40_status Context40_compress(T context, const unsigned char *pixels,
+                                   size_t stride, size_t size,
+                                   unsigned width, unsigned height,
+                                   unsigned denominator,
+                                   const uint32_t **words)
+{
+    assert(context != NULL);
+    if (pixels == NULL || words == NULL) {
+        return BUFFER40_NULL_ARGUMENT;
+    }
+    if (width < 2 || height < 2 ||
+        (size_t)(width / 2) > SIZE_MAX / sizeof(uint32_t) / (height / 2)) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    size_t count = (size_t)(width / 2) * (height / 2);
+    uint32_t *buffer = reserve(context, context->words, &context->word_bytes,
+                               count * sizeof(uint32_t));
+    if (buffer == NULL) {
+        return BUFFER40_NO_MEMORY;
+    }
+    context->words = buffer;
+    Buffer40_status status = Buffer40_compress(pixels, stride, size, width,
+                                               height, denominator,
+                                               context->fixed_point,
+                                               context->words, count);
+    if (status == BUFFER40_OK) {
+        context->calls++;
+        *words = context->words;
+    }
+    return status;
+}
+
+/*
+ *  Function:  decode
+ *  Arguments: Context40_T context - the context
+ *             const void *words - width * height words, native or big
+ *                                 endian
+ *             bool big_endian - which
+ *             unsigned width, height - the compressed frame's size in
+ *                                      words
+ *             const unsigned char **pixels - set to the decoded raster
+ *  Does:      Decompresses a frame into the context's pixel buffer,
+ *             growing it first if need be, through the table if the
+ *             context has one.
+ *  Return:    Buffer40_status - BUFFER40_OK, or why nothing was done
+ */
+static Buffer40_status decode(T context, const void *words, bool big_endian,
+                              unsigned width, unsigned height,
+                              const unsigned char **pixels)
+{
+    if (words == NULL || pixels == NULL) {
+        return BUFFER40_NULL_ARGUMENT;
+    }
+    if (width == 0 || height == 0 || width > UINT_MAX / 2 ||
+        height > UINT_MAX / 2 || width > SIZE_MAX / 12 / height) {
+        return BUFFER40_BAD_DIMENSIONS;
+    }
+    size_t scanline = (size_t)width * 6;
+    size_t needed = scanline * 2 * height;
+    unsigned char *buffer = reserve(context, context->pixels,
+                                    &context->pixel_bytes, needed);
+    if (buffer == NULL) {
+        return BUFFER40_NO_MEMORY;
+    }
+    context->pixels = buffer;
+
+    Buffer40_status status = BUFFER40_OK;
+    if (context->table != NULL) {
+        const unsigned char *bytes = words;
+        const uint32_t *native = words;
+        for (unsigned row = 0; row < height; row++) {
+            unsigned char *top = &context->pixels[scanline * 2 * row];
+            size_t first = (size_t)row * width;
+            if (big_endian) {
+                Rgbtable40_decode_row_be(context->table, &bytes[first * 4],
+                                         width, top, top + scanline);
+            } else {
+                Rgbtable40_decode_row(context->table, &native[first], width,
+                                      top, top + scanline);
+            }
+        }
+    } else if (big_endian) {
+        status = Buffer40_decompress_be(words, width, height,
+                                        context->fixed_point,
+                                        context->pixels, scanline, needed);
+    } else {
+        status = Buffer40_decompress(words, width, height,
+                                     context->fixed_point, context->pixels,
+                                     scanline, needed);
+    }
+    if (status == BUFFER40_OK) {
+        context->calls++;
+        *pixels = context->pixels;
+    }
+    return status;
+}
+
+/*
+ *  Function:  Context40_decompress
+ *  Arguments: Context40_T context - the context
+ *             const uint32_t *words - width * height words, row-major
+ *             unsigned width, height - the compressed frame's size in words
+ *             const unsigned char **pixels - set to the 8-bit raster of the
+ *                                            (2 * width) x (2 * height)
+ *                                            frame, 6 * width bytes per
+ *                                            scanline, which the context
+ *                                            owns and keeps until its next
+ *                                            decompress
+ *  Does:      Decompresses a frame of native words.
+ *  Return:    Buffer40_status - BUFFER40_OK, or why nothing was done
+ */
+Buffer40_status Context40_decompress(T context, const uint32_t *words,
+                                     unsigned width, unsigned height,
+                                     const unsigned char **pixels)
+{
+    assert(context != NULL);
+    return decode(context, words, false, width, height, pixels);
+}
+
+/*
+ *  Function:  Context40_decompress_file
+ *  Arguments: Context40_T context - the context
+ *             const unsigned char *data, size_t size - a whole compressed
+ *                                                      image file
+ *             unsigned *width, *height - set to the frame's size in words
+ *             const unsigned char **pixels - as for Context40_decompress
+ *  Does:      Decompresses a compressed file held in memory, decoding its
+ *             words in place.
+ *  Return:    Buffer40_status - BUFFER40_OK, or why nothing was done, as
+ *             from Buffer40_parse or Context40_decompress
+ */
+Buffer40_status Context40_decompress_file(T context,
+                                          const unsigned char *data,
+                                          size_t size, unsigned *width,
+                                          unsigned *height,
+                                          const unsigned char **pixels)
+{
+    assert(context != NULL);
+    const unsigned char *words;
+    unsigned w, h;
+    Buffer40_status status = Buffer40_parse(data, size, &w, &h, &words);
+    if (status == BUFFER40_OK && (width == NULL || height == NULL)) {
+        status = BUFFER40_NULL_ARGUMENT;
+    }
+    if (status == BUFFER40_OK) {
+        status = decode(context, words, true, w, h, pixels);
+    }
+    if (status == BUFFER40_OK) {
+        *width = w;
+        *height = h;
+    }
+    return status;
+}
+
+/*
+ *  Function:  Context40_stats_get
+ *  Arguments: Context40_T context - the context
+ *  Does:      Collects the context's counts.
+ *  Return:    Context40_stats - the counts since the context was created
+ */
+Context40_stats Context40_stats_get(T context)
+{
+    assert(context != NULL);
+    Context40_stats stats = { .calls = context->calls,
+                              .allocations = context->allocations };
+    stats.bytes = context->word_bytes + context->pixel_bytes;
+    if (context->table != NULL) {
+        Rgbtable40_add_stats(context->table, &stats.table);
+        stats.bytes += stats.table.bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,72 @@
+/******************************************************************************
+ *
+ *                                context40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for a reusable codec context, for coding many frames of the
+ *     same size. A context owns the buffer it compresses words into, the
+ *     buffer it decompresses pixels into and, if asked for, a direct-to-RGB
+ *     decoding table (rgbtable40.h), and keeps them from one call to the
+ *     next. A buffer is only reallocated when a frame needs more than it
+ *     holds, so once the largest frame has been seen every call is free of
+ *     allocation, and the table stays warm. Context40_stats counts the
+ *     allocations so that this can be checked.
+ *
+ *     Frames are given and returned as for buffer40.h, whose statuses
+ *     report every error; BUFFER40_NO_MEMORY means a buffer could not be
+ *     grown, in which case the context is left as it was. A context is not
+ *     thread-safe; give each thread its own. It is a checked run-time error
+ *     to pass a NULL Context40_T to any function in this interface.
+ *     (See the implementation file context40.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "buffer40.h"
+#include "rgbtable40.h"
+
+#ifndef CONTEXT40_H
+#define CONTEXT40_H
+
+#define T Context40_T
+typedef struct T *T;
+
+typedef struct Context40_stats {
+    uint64_t calls;       /* frames compressed or decompressed */
+    uint64_t allocations; /* buffers allocated, including the table */
+    size_t bytes;         /* bytes of buffers held now, including the
+                             address space of the table */
+    Rgbtable40_stats table; /* use of the table, if there is one */
+} Context40_stats;
+
+extern T               Context40_new            (bool fixed_point,
+                                                 bool rgb_table);
+extern void            Context40_free           (T *context);
+extern Buffer40_status Context40_compress       (T context,
+                                                 const unsigned char *pixels,
+                                                 size_t stride, size_t size,
+                                                 unsigned width,
+                                                 unsigned height,
+                                                 unsigned denominator,
+                                                 const uint32_t **words);
+extern Buffer40_status Context40_decompress     (T context,
+                                                 const uint32_t *words,
+                                                 unsigned width,
+                                                 unsigned height,
+                                                 const unsigned char **pixels);
+extern Buffer40_status Context40_decompress_file(T context,
+                                                 const unsigned char *data,
+                                                 size_t size,
+                                                 unsigned *width,
+                                                 unsigned *height,
+                                                 const unsigned char **pixels);
+extern Context40_stats Context40_stats_get      (T context);
+
+#undef T
+#endif
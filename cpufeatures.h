@@ -0,0 +1,69 @@
+/******************************************************************************
+ *
+ *                              cpufeatures.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Helpers for kernels that have a SIMD implementation alongside their
+ *     portable scalar one. When compiling with GCC or Clang for x86,
+ *     CPUFEATURES_X86 is defined, the intrinsics headers are included, and
+ *     individual functions can be compiled for AVX2 with TARGET_AVX2 even
+ *     though the rest of the program is built for the baseline ISA. Callers
+ *     must check cpu_has_avx2() before calling such a function. The same
+ *     goes for TARGET_BMI2 and cpu_has_bmi2().
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#define CPUFEATURES_X86 1
+#include <immintrin.h>
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_BMI2 __attribute__((target("bmi2")))
+
+/*
+ *  Function:  cpu_has_avx2
+ *  Arguments: none
+ *  Does:      Queries (via CPUID, cached by the compiler runtime) whether the
+ *             processor running the program supports AVX2.
+ *  Return:    bool - true if AVX2 kernels may be called
+ */
+static inline bool cpu_has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+/*
+ *  Function:  cpu_has_bmi2
+ *  Arguments: none
+ *  Does:      Queries whether the processor supports BMI2 (pdep/pext).
+ *  Return:    bool - true if BMI2 functions may be called
+ */
+static inline bool cpu_has_bmi2(void)
+{
+    return __builtin_cpu_supports("bmi2");
+}
+
+#else
+
+static inline bool cpu_has_avx2(void)
+{
+    return false;
+}
+
+static inline bool cpu_has_bmi2(void)
+{
+    return false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+/******************************************************************************
+ *
+ *                                cvtable40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the cvtable40.h interface. A table is built the first time
+ *     Cvtable40_get is called for its denominator and kept for the rest of
+ *     the process, so an image costs one table of 24 KB however many rows
+ *     or threads compress it. A mutex guards the building; a table is
+ *     read-only once it has been returned.
+ *
+ *     rgb_to_cv evaluates, for instance, pb as
+ *
+ *         (-0.168736 * red - 0.331264 * green) + 0.5 * blue
+ *
+ *     in double precision. Negating a product is exact, and subtracting a
+ *     double is the same operation as adding its negation, so storing
+ *     -0.331264 * green and adding it gives the same bits.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "assert.h"
+
+#include "cvtable40.h"
+
+static const Cvtable40 *tables[CVTABLE40_MAX_DENOMINATOR + 1];
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Static function declarations */
+static Cvtable40 *build_table(unsigned denominator);
+
+/*
+ *  Function:  build_table
+ *  Arguments: unsigned denominator - an image denominator, from 1 to
+ *                                    CVTABLE40_MAX_DENOMINATOR
+ *  Does:      Allocates and fills in the table of a denominator. Each
+ *             sample is scaled exactly as scale_rgb scales it.
+ *  Return:    Cvtable40 * - the new table
+ */
+static Cvtable40 *build_table(unsigned denominator)
+{
+    Cvtable40 *table;
+    int failed = posix_memalign((void **)&table, 64, sizeof(*table));
+    assert(!failed);
+
+    float denom = (float)denominator;
+    for (unsigned s = 0; s < CVTABLE40_SAMPLES; s++) {
+        float scaled = s / denom;
+        double *red = table->red[s];
+        double *green = table->green[s];
+        double *blue = table->blue[s];
+
+        red[0] = 0.299 * scaled;
+        red[1] = -0.168736 * scaled;
+        red[2] = 0.5 * scaled;
+        green[0] = 0.587 * scaled;
+        green[1] = -(0.331264 * scaled);
+        green[2] = -(0.418688 * scaled);
+        blue[0] = 0.114 * scaled;
+        blue[1] = 0.5 * scaled;
+        blue[2] = -(0.081312 * scaled);
+        red[3] = green[3] = blue[3] = 0;
+    }
+    return table;
+}
+
+/*
+ *  Function:  Cvtable40_get
+ *  Arguments: unsigned denominator - an image denominator
+ *  Does:      Returns the table of a denominator, building it on first use.
+ *             Thread-safe.
+ *  Return:    const Cvtable40 * - the table, valid for the rest of the
+ *             process, or NULL if the denominator is 0 or more than
+ *             CVTABLE40_MAX_DENOMINATOR
+ */
+const Cvtable40 *Cvtable40_get(unsigned denominator)
+{
+    if (denominator == 0 || denominator > CVTABLE40_MAX_DENOMINATOR) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tables_lock);
+    const Cvtable40 *table = tables[denominator];
+    if (table == NULL) {
+        table = tables[denominator] = build_table(denominator);
+    }
+    pthread_mutex_unlock(&tables_lock);
+    return table;
+}
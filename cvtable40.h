@@ -0,0 +1,67 @@
+/******************************************************************************
+ *
+ *                                cvtable40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Lookup tables for the color transform of images with a denominator of
+ *     at most 255, the common 8-bit case. Each of the nine products that
+ *     rgb_to_cv forms from a scaled sample depends on that sample alone, so
+ *     for every sample value the three products of its channel are kept in
+ *     a table, and a pixel is converted to component-video space with
+ *     three lookups and six additions: no division to scale the samples
+ *     and no multiplications.
+ *
+ *     The products are stored in double precision, as rgb_to_cv forms
+ *     them, with the signs of the subtracted ones folded in; the lookups
+ *     are summed in the same order and rounded to float at the end, so the
+ *     results are exactly those of scale_rgb followed by rgb_to_cv.
+ *     (See the implementation file cvtable40.c for more information)
+ *
+ *****************************************************************************/
+
+#ifndef CVTABLE40_H
+#define CVTABLE40_H
+
+/* Number of entries in each channel's table: one per 8-bit sample */
+#define CVTABLE40_SAMPLES 256
+
+/* Largest denominator the tables are built for */
+#define CVTABLE40_MAX_DENOMINATOR 255
+
+typedef struct Cvtable40 {
+    /* each entry holds the channel's terms of y, pb and pr for one sample
+       value, then a zero so that an entry is 32 bytes */
+    double red[CVTABLE40_SAMPLES][4];
+    double green[CVTABLE40_SAMPLES][4];
+    double blue[CVTABLE40_SAMPLES][4];
+} Cvtable40;
+
+extern const Cvtable40 *Cvtable40_get(unsigned denominator);
+
+/*
+ *  Function:  Cvtable40_cv
+ *  Arguments: const Cvtable40 *table - a table from Cvtable40_get
+ *             unsigned red, green, blue - the samples of a pixel, each less
+ *                                         than CVTABLE40_SAMPLES
+ *             float *y, *pb, *pr - filled in with the component-video
+ *                                  values of the pixel
+ *  Does:      Transforms a pixel to component-video space with the table of
+ *             its image's denominator.
+ *  Return:    void
+ */
+static inline void Cvtable40_cv(const Cvtable40 *table, unsigned red,
+                                unsigned green, unsigned blue, float *y,
+                                float *pb, float *pr)
+{
+    const double *r = table->red[red];
+    const double *g = table->green[green];
+    const double *b = table->blue[blue];
+    *y = r[0] + g[0] + b[0];
+    *pb = r[1] + g[1] + b[1];
+    *pr = r[2] + g[2] + b[2];
+}
+
+#endif
@@ -14,32 +14,113 @@
  *
  *****************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 #include "assert.h"
 
 #include "pnm.h"
 #include "a2methods.h"
-#include "arith40.h"
 #include "compress40.h"
 
 #include "a2blocked.h"
 #include "a2plain.h"
 #include "uarray2.h"
 #include "uarray2b.h"
-#include "bitpack.h"
+#include "bitpack40.h"
+#include "buffer40.h"
+#include "chroma40.h"
+#include "codec40.h"
 #include "decompressmath.h"
+#include "decompressrow.h"
+#include "fixedrow.h"
+#include "rgbtable40.h"
 #include "compressinfo.h"
+#include "threadpool.h"
+#include "wordio.h"
+
+/* Target size in bytes of the decoded pixels of one band when decompressing
+   with several threads */
+#define BAND_BYTES (1 << 20)
+
+/* Number of bands that may be in flight (read, decoding, or waiting to be
+   written) per worker thread */
+#define BANDS_PER_THREAD 2
+
+/* Target size in bytes of the decoded pixels of one chunk of rows, and the
+   number of chunks in the ring, of a pipelined decompression */
+#define CHUNK_BYTES (1 << 20)
+#define PIPELINE_SLOTS 4
+
+/* The row kernel the fused paths decode with: the floating-point one of
+   decompressrow.h, the fixed-point one of fixedrow.h, or a direct-to-RGB
+   table, which gives the same pixels as the floating-point one */
+struct Row_decoder {
+    bool fixed_point;
+    Rgbtable40_T table; /* if not NULL, decode through this table */
+};
+
+/* A band of rows of words and its decoded scanlines. Bands in flight live in
+   a fixed ring of slots, which bounds memory use regardless of image size */
+struct Band {
+    uint32_t *words;
+    const unsigned char *raw; /* if not NULL, the band's words as stored in
+                                 a compressed file held in memory, which are
+                                 decoded in place instead of words */
+    unsigned char *pixels;   /* two scanlines per row of words */
+    unsigned width;          /* words per row */
+    unsigned rows;           /* rows of words in this band */
+    struct Row_decoder decoder; /* private to the slot, as a table must
+                                   not be shared between threads */
+    bool done;               /* set by the worker when pixels is ready */
+    pthread_mutex_t *lock;   /* shared by all bands of one image */
+    pthread_cond_t *decoded; /* signaled whenever a band is done */
+};
+
+/* A pipelined decompression, shared by its stages. A chunk is chunk_rows
+   rows of words (the last may have fewer) */
+struct Pipelined {
+    FILE *input, *output;
+    unsigned width;      /* words per row */
+    unsigned height;     /* rows of words */
+    unsigned chunk_rows;
+    struct Row_decoder decoder; /* used by the compute stage only */
+};
 
 /* Static function declarations */
-static void decompress_cb(int col, int row, UArray2_T image,
-                          void *elem, void *cl);
-static UArray2_T read_compressed(FILE *input);
+static void decompress_group(uint32_t word, Pnm_ppm pixmap, int col,
+                             int row, const Chroma40_tables *chroma);
+static UArray2_T read_compressed(FILE *input, Codec40_opts opts);
 static void trim_normalized_rgbs(float normalized_rgbs[3]);
 static void decompress_pixel(float avg_pb, float avg_pr, float y_vals[4],
                              Pnm_ppm pixmap, int col, int row);
+static void decompress_mapped(UArray2_T compressed, A2Methods_T methods,
+                              FILE *output);
+static struct Row_decoder decoder_new(Codec40_opts opts);
+static void decoder_free(struct Row_decoder *decoder, Codec40_opts opts);
+static void decode_row(struct Row_decoder *decoder, const void *words,
+                       bool big_endian, unsigned width, unsigned char *top,
+                       unsigned char *bottom);
+static void decompress_fused(UArray2_T compressed, Codec40_opts opts);
+static void decompress_banded(FILE *input, const unsigned char *raw,
+                              unsigned width, unsigned height,
+                              Codec40_opts opts);
+static void decompress_streaming(FILE *input, Codec40_opts opts);
+static void decompress_band(void *cl);
+static void read_header(FILE *input, unsigned *width, unsigned *height);
+static void read_word_rows(FILE *input, uint32_t *words, unsigned width,
+                           unsigned rows);
+static unsigned rows_in_chunk(struct Pipelined *pipelined, unsigned chunk);
+static bool read_chunk(void *cl, unsigned chunk, void *in, void *out);
+static bool decompress_chunk(void *cl, unsigned chunk, void *in, void *out);
+static bool write_chunk(void *cl, unsigned chunk, void *in, void *out);
+static void decompress_pipelined(FILE *input, Codec40_opts opts);
+static bool uses_row_kernels(Codec40_opts opts);
     
 /*
  *  Function:  decompress40
@@ -50,11 +131,554 @@ static void decompress_pixel(float avg_pb, float avg_pr, float y_vals[4],
  *  Return:    void
  */
 void decompress40(FILE *input)
+{
+    decompress40_opts(input, NULL);
+}
+
+/*
+ *  Function:  decompress40_opts
+ *  Arguments: FILE *input - a non-null pointer to an opened, compressed PPM
+ *                           image file
+ *             Codec40_opts opts - options selecting how the image is
+ *                                 decompressed, or NULL for the defaults
+ *  Does:      Decompresses a compressed PPM file and writes that new PPM
+ *             to stdout, or opts->output. The output depends only on
+ *             opts->fixed_point. Does not close the provided FILE pointer.
+ *  Return:    void
+ */
+void decompress40_opts(FILE *input, Codec40_opts opts)
 {
     assert(input != NULL);
-    UArray2_T compressed = read_compressed(input);
+    if (opts != NULL && opts->pipelined) {
+        decompress_pipelined(input, opts);
+        return;
+    }
+    if (opts != NULL && opts->streaming) {
+        decompress_streaming(input, opts);
+        return;
+    }
+    if (opts != NULL && opts->threads > 1) {
+        unsigned width, height;
+        read_header(input, &width, &height);
+        decompress_banded(input, NULL, width, height, opts);
+        return;
+    }
+    UArray2_T compressed = read_compressed(input, opts);
+
+    if (opts != NULL && (opts->fused || opts->fixed_point ||
+                         opts->rgb_table)) {
+        decompress_fused(compressed, opts);
+    } else {
+        decompress_mapped(compressed, opts != NULL && opts->methods != NULL
+                                      ? opts->methods
+                                      : uarray2_methods_blocked,
+                          Codec40_output(opts));
+    }
+    UArray2_free(&compressed);
+}
+
+/*
+ *  Function:  decoder_new
+ *  Arguments: Codec40_opts opts - the decompression options, or NULL
+ *  Does:      Sets up the row kernel the options select, allocating a
+ *             table if they ask for one (and not for fixed point, which
+ *             takes precedence).
+ *  Return:    struct Row_decoder - the decoder, to be released with
+ *             decoder_free
+ */
+static struct Row_decoder decoder_new(Codec40_opts opts)
+{
+    struct Row_decoder decoder = { opts != NULL && opts->fixed_point, NULL };
+    if (opts != NULL && opts->rgb_table && !decoder.fixed_point) {
+        decoder.table = Rgbtable40_new();
+    }
+    return decoder;
+}
+
+/*
+ *  Function:  decoder_free
+ *  Arguments: struct Row_decoder *decoder - a decoder from decoder_new
+ *             Codec40_opts opts - the options it was made from
+ *  Does:      Frees the decoder's table, if it has one, first adding its
+ *             statistics to opts->table_stats if that is not NULL.
+ *  Return:    void
+ */
+static void decoder_free(struct Row_decoder *decoder, Codec40_opts opts)
+{
+    if (decoder->table == NULL) {
+        return;
+    }
+    if (opts->table_stats != NULL) {
+        Rgbtable40_add_stats(decoder->table, opts->table_stats);
+    }
+    Rgbtable40_free(&decoder->table);
+}
+
+/*
+ *  Function:  decode_row
+ *  Arguments: struct Row_decoder *decoder - the row kernel to use
+ *             const void *words - a row of words
+ *             bool big_endian - whether the row holds the big endian bytes
+ *                               of a compressed file rather than native
+ *                               uint32_ts
+ *             unsigned width - the number of words in the row
+ *             unsigned char *top, *bottom - the row's two scanlines
+ *  Does:      Decodes one row of words with the decoder's kernel. A
+ *             word with a coefficient out of range is a checked run-time
+ *             error, as it is on the callback-based path; the kernels
+ *             themselves would decode it without complaint.
+ *  Return:    void
+ */
+static void decode_row(struct Row_decoder *decoder, const void *words,
+                       bool big_endian, unsigned width, unsigned char *top,
+                       unsigned char *bottom)
+{
+    assert(Bitpack40_valid_row(words, width, big_endian));
+    if (decoder->table != NULL && big_endian) {
+        Rgbtable40_decode_row_be(decoder->table, words, width, top, bottom);
+    } else if (decoder->table != NULL) {
+        Rgbtable40_decode_row(decoder->table, words, width, top, bottom);
+    } else if (decoder->fixed_point && big_endian) {
+        decompress_row_be_fixed(words, width, top, bottom);
+    } else if (decoder->fixed_point) {
+        decompress_row_fixed(words, width, top, bottom);
+    } else if (big_endian) {
+        decompress_row_be(words, width, top, bottom);
+    } else {
+        decompress_row(words, width, top, bottom);
+    }
+}
+
+/*
+ *  Function:  decompress_fused
+ *  Arguments: UArray2_T compressed - the array of bitpacked pixel groups
+ *             Codec40_opts opts - options selecting the row kernel
+ *  Does:      Decompresses the image one row of words at a time with the
+ *             fused row kernel, writing each pair of decoded scanlines to
+ *             the output as soon as it is ready. The header and raster are
+ *             the same bytes that Pnm_ppmwrite produces for a denominator
+ *             of 255, so no pixmap is ever built. Every word is checked
+ *             before anything is written, so a corrupt file gives no
+ *             output, as on the callback-based path.
+ *  Return:    void
+ */
+static void decompress_fused(UArray2_T compressed, Codec40_opts opts)
+{
+    assert(compressed != NULL);
+    unsigned width = UArray2_width(compressed);
+    unsigned height = UArray2_height(compressed);
+    for (unsigned row = 0; row < height; row++) {
+        assert(Bitpack40_valid_row(UArray2_row(compressed, row), width,
+                                   false));
+    }
+    size_t scanline = (size_t)width * 2 * 3;
+    unsigned char *top = Codec40_alloc(opts, scanline);
+    unsigned char *bottom = Codec40_alloc(opts, scanline);
+    assert(top != NULL && bottom != NULL);
+    struct Row_decoder decoder = decoder_new(opts);
+    FILE *output = Codec40_output(opts);
+
+    fprintf(output, "P6\n%u %u\n%u\n", width * 2, height * 2,
+            DECOMPRESS_DENOMINATOR);
+    for (unsigned row = 0; row < height; row++) {
+        decode_row(&decoder, UArray2_row(compressed, row), false, width,
+                   top, bottom);
+        fwrite(top, 1, scanline, output);
+        fwrite(bottom, 1, scanline, output);
+    }
+    decoder_free(&decoder, opts);
+    Codec40_release(opts, top);
+    Codec40_release(opts, bottom);
+}
+
+/*
+ *  Function:  decompress_streaming
+ *  Arguments: FILE *input - a non-null pointer to an opened, compressed PPM
+ *                           image file
+ *             Codec40_opts opts - options selecting the row kernel
+ *  Does:      Decompresses the image without ever holding it in memory: the
+ *             PPM header is written as soon as the compressed header has
+ *             been read, then each row of words is read, decoded into two
+ *             scanlines with the fused row kernel, and written immediately.
+ *             Memory use is proportional to the width of the image and
+ *             independent of its height. An invalid file is only detected
+ *             after the rows before the error have been written.
+ *  Return:    void
+ */
+static void decompress_streaming(FILE *input, Codec40_opts opts)
+{
+    unsigned width, height;
+    read_header(input, &width, &height);
+    size_t scanline = (size_t)width * 2 * 3;
+    uint32_t *words = Codec40_alloc(opts, width * sizeof(*words));
+    unsigned char *top = Codec40_alloc(opts, scanline);
+    unsigned char *bottom = Codec40_alloc(opts, scanline);
+    assert(words != NULL && top != NULL && bottom != NULL);
+    struct Row_decoder decoder = decoder_new(opts);
+    FILE *output = Codec40_output(opts);
+
+    fprintf(output, "P6\n%u %u\n%u\n", width * 2, height * 2,
+            DECOMPRESS_DENOMINATOR);
+    for (unsigned row = 0; row < height; row++) {
+        read_word_rows(input, words, width, 1);
+        decode_row(&decoder, words, false, width, top, bottom);
+        fwrite(top, 1, scanline, output);
+        fwrite(bottom, 1, scanline, output);
+    }
+    decoder_free(&decoder, opts);
+    Codec40_release(opts, words);
+    Codec40_release(opts, top);
+    Codec40_release(opts, bottom);
+}
+
+/*
+ *  Function:  rows_in_chunk
+ *  Arguments: struct Pipelined *pipelined - the decompression
+ *             unsigned chunk - the number of a chunk
+ *  Does:      Counts the rows of words in a chunk.
+ *  Return:    unsigned - chunk_rows, or fewer for the last chunk
+ */
+static unsigned rows_in_chunk(struct Pipelined *pipelined, unsigned chunk)
+{
+    unsigned first = chunk * pipelined->chunk_rows;
+    unsigned left = pipelined->height - first;
+    return left < pipelined->chunk_rows ? left : pipelined->chunk_rows;
+}
+
+/*
+ *  Function:  read_chunk
+ *  Arguments: void *cl - the struct Pipelined
+ *             unsigned chunk - the number of the chunk
+ *             void *in - filled with the chunk's rows of words
+ *             void *out - unused
+ *  Does:      The read stage of a pipelined decompression: reads the next
+ *             rows of words. It runs on the reader thread, so a short file
+ *             is reported to the pipeline rather than ending the process.
+ *  Return:    bool - false if the file ends early
+ */
+static bool read_chunk(void *cl, unsigned chunk, void *in, void *out)
+{
+    struct Pipelined *pipelined = cl;
+    (void)out;
+    size_t count = (size_t)pipelined->width *
+                   rows_in_chunk(pipelined, chunk);
+    return read_words(pipelined->input, in, count) == count;
+}
+
+/*
+ *  Function:  decompress_chunk
+ *  Arguments: void *cl - the struct Pipelined
+ *             unsigned chunk - the number of the chunk
+ *             void *in - the chunk's rows of words
+ *             void *out - filled with two scanlines per row of words
+ *  Does:      The compute stage of a pipelined decompression: decodes each
+ *             row of words with the decoder the options chose.
+ *  Return:    bool - always true
+ */
+static bool decompress_chunk(void *cl, unsigned chunk, void *in, void *out)
+{
+    struct Pipelined *pipelined = cl;
+    const uint32_t *words = in;
+    unsigned char *pixels = out;
+    unsigned width = pipelined->width;
+    size_t scanline = (size_t)width * 2 * 3;
+    unsigned rows = rows_in_chunk(pipelined, chunk);
+    for (unsigned row = 0; row < rows; row++) {
+        unsigned char *top = &pixels[scanline * 2 * row];
+        decode_row(&pipelined->decoder, &words[(size_t)row * width], false,
+                   width, top, top + scanline);
+    }
+    return true;
+}
 
-    A2Methods_T methods = uarray2_methods_blocked;
+/*
+ *  Function:  write_chunk
+ *  Arguments: void *cl - the struct Pipelined
+ *             unsigned chunk - the number of the chunk
+ *             void *in - unused
+ *             void *out - the chunk's decoded scanlines
+ *  Does:      The write stage of a pipelined decompression: writes the
+ *             chunk's scanlines.
+ *  Return:    bool - always true
+ */
+static bool write_chunk(void *cl, unsigned chunk, void *in, void *out)
+{
+    struct Pipelined *pipelined = cl;
+    (void)in;
+    size_t scanline = (size_t)pipelined->width * 2 * 3;
+    fwrite(out, 1, scanline * 2 * rows_in_chunk(pipelined, chunk),
+           pipelined->output);
+    return true;
+}
+
+/*
+ *  Function:  decompress_pipelined
+ *  Arguments: FILE *input - a non-null pointer to an opened, compressed PPM
+ *                           image file
+ *             Codec40_opts opts - options selecting the row kernel, the
+ *                                 output and where to add the stage times
+ *  Does:      Decompresses the image as decompress_streaming does, with the
+ *             same output, but in chunks of rows that pass through a
+ *             pipeline (see pipeline40.h): while one chunk is decoded, the
+ *             next is read and the one before is written. An invalid file
+ *             is only detected after the chunks before the error have been
+ *             written; a short one is reported, and the process ended, on
+ *             the calling thread once the pipeline has stopped.
+ *  Return:    void
+ */
+static void decompress_pipelined(FILE *input, Codec40_opts opts)
+{
+    unsigned width, height;
+    read_header(input, &width, &height);
+    size_t scanline = (size_t)width * 2 * 3;
+    struct Pipelined pipelined = { .input = input,
+                                   .output = Codec40_output(opts),
+                                   .width = width, .height = height,
+                                   .decoder = decoder_new(opts) };
+    size_t rows = CHUNK_BYTES / (scanline * 2);
+    rows = rows == 0 ? 1 : rows;
+    pipelined.chunk_rows = rows > height ? height : rows;
+    unsigned chunks = (height + pipelined.chunk_rows - 1) /
+                      pipelined.chunk_rows;
+
+    fprintf(pipelined.output, "P6\n%u %u\n%u\n", width * 2, height * 2,
+            DECOMPRESS_DENOMINATOR);
+    bool complete = Pipeline40_run(chunks, PIPELINE_SLOTS,
+                                   (size_t)pipelined.chunk_rows * width *
+                                   sizeof(uint32_t),
+                                   scanline * 2 * pipelined.chunk_rows,
+                                   read_chunk, decompress_chunk, write_chunk,
+                                   &pipelined, opts->pipeline_stats);
+    decoder_free(&pipelined.decoder, opts);
+    if (!complete) {
+        fprintf(stderr, "Invalid compressed image file.\n");
+        fclose(input);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ *  Function:  decompress_band
+ *  Arguments: void *cl - a struct Band whose words have been read
+ *  Does:      Decodes every row of words in a band into its two scanlines,
+ *             then marks the band done and wakes the writer.
+ *  Return:    void
+ */
+static void decompress_band(void *cl)
+{
+    struct Band *band = cl;
+    assert(band != NULL);
+    size_t scanline = (size_t)band->width * 2 * 3;
+
+    for (unsigned row = 0; row < band->rows; row++) {
+        size_t first = (size_t)row * band->width;
+        unsigned char *top = &band->pixels[scanline * 2 * row];
+        if (band->raw != NULL) {
+            decode_row(&band->decoder, &band->raw[first * 4], true,
+                       band->width, top, top + scanline);
+        } else {
+            decode_row(&band->decoder, &band->words[first], false,
+                       band->width, top, top + scanline);
+        }
+    }
+
+    pthread_mutex_lock(band->lock);
+    band->done = true;
+    pthread_cond_broadcast(band->decoded);
+    pthread_mutex_unlock(band->lock);
+}
+
+/*
+ *  Function:  decompress_banded
+ *  Arguments: FILE *input - a non-null pointer to an opened, compressed PPM
+ *                           image file whose header has been read, or NULL
+ *                           if raw is used
+ *             const unsigned char *raw - if input is NULL, all of the words
+ *                                        of the image as stored in a
+ *                                        compressed file held in memory
+ *             unsigned width, height - dimensions of the compressed image
+ *             Codec40_opts opts - options with more than 1 thread, which
+ *                                 also select the row kernel
+ *  Does:      Decompresses the image in bands of rows on a pool of worker
+ *             threads. The calling thread reads each band's words into a
+ *             free slot of a fixed ring (or points the slot at them, when
+ *             they are already in memory) and hands the band to the pool;
+ *             finished bands are written to the output strictly in order,
+ *             as soon as the oldest one is done, so writing overlaps
+ *             decoding.
+ *             At most threads * BANDS_PER_THREAD bands are held in memory
+ *             at once. Because output starts before all input is read, an
+ *             invalid file is only detected after part of the image has
+ *             been written.
+ *  Return:    void
+ */
+static void decompress_banded(FILE *input, const unsigned char *raw,
+                              unsigned width, unsigned height,
+                              Codec40_opts opts)
+{
+    unsigned threads = opts->threads;
+    FILE *output = Codec40_output(opts);
+    size_t scanline = (size_t)width * 2 * 3;
+    unsigned band_rows = BAND_BYTES / (scanline * 2);
+    band_rows = band_rows == 0 ? 1 : band_rows;
+    unsigned nbands = (height + band_rows - 1) / band_rows;
+    unsigned nslots = threads * BANDS_PER_THREAD;
+    nslots = nslots > nbands ? nbands : nslots;
+
+    pthread_mutex_t lock;
+    pthread_cond_t decoded;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&decoded, NULL);
+    struct Band *slots = Codec40_alloc(opts, nslots * sizeof(*slots));
+    assert(slots != NULL);
+    for (unsigned i = 0; i < nslots; i++) {
+        slots[i].words = input == NULL ? NULL
+            : Codec40_alloc(opts,
+                            (size_t)band_rows * width * sizeof(uint32_t));
+        slots[i].raw = NULL;
+        slots[i].pixels = Codec40_alloc(opts, scanline * 2 * band_rows);
+        assert(slots[i].pixels != NULL);
+        assert(input == NULL || slots[i].words != NULL);
+        slots[i].width = width;
+        slots[i].decoder = decoder_new(opts);
+        slots[i].lock = &lock;
+        slots[i].decoded = &decoded;
+    }
+
+    fprintf(output, "P6\n%u %u\n%u\n", width * 2, height * 2,
+            DECOMPRESS_DENOMINATOR);
+    Threadpool_T pool = Threadpool_new(threads);
+    unsigned next_read = 0;
+    for (unsigned next_write = 0; next_write < nbands; next_write++) {
+        /* refill every free slot with the next unread band */
+        while (next_read < nbands && next_read - next_write < nslots) {
+            struct Band *band = &slots[next_read % nslots];
+            unsigned first_row = next_read * band_rows;
+            band->rows = height - first_row < band_rows ? height - first_row
+                                                        : band_rows;
+            band->done = false;
+            if (input == NULL) {
+                band->raw = &raw[(size_t)first_row * width * 4];
+            } else {
+                read_word_rows(input, band->words, width, band->rows);
+            }
+            Threadpool_submit(pool, decompress_band, band);
+            next_read++;
+        }
+
+        /* write the oldest band once it is decoded, freeing its slot */
+        struct Band *band = &slots[next_write % nslots];
+        pthread_mutex_lock(&lock);
+        while (!band->done) {
+            pthread_cond_wait(&decoded, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+        fwrite(band->pixels, 1, scanline * 2 * band->rows, output);
+    }
+    Threadpool_free(&pool);
+
+    for (unsigned i = 0; i < nslots; i++) {
+        decoder_free(&slots[i].decoder, opts);
+        Codec40_release(opts, slots[i].words);
+        Codec40_release(opts, slots[i].pixels);
+    }
+    Codec40_release(opts, slots);
+    pthread_cond_destroy(&decoded);
+    pthread_mutex_destroy(&lock);
+}
+
+/*
+ *  Function:  uses_row_kernels
+ *  Arguments: Codec40_opts opts - decompression options, or NULL
+ *  Does:      Tells whether decompress40_opts would decode with the fused
+ *             row kernels (or a table) under these options, rather than
+ *             into a pixmap.
+ *  Return:    bool - true for the fused, fixed-point, table, threaded,
+ *             streaming and pipelined paths
+ */
+static bool uses_row_kernels(Codec40_opts opts)
+{
+    return opts != NULL && (opts->fused || opts->fixed_point ||
+                            opts->rgb_table || opts->threads > 1 ||
+                            opts->streaming || opts->pipelined);
+}
+
+/*
+ *  Function:  decompress40_inplace
+ *  Arguments: const unsigned char *data - a whole compressed image file held
+ *                                         in memory, such as a mapped file
+ *             size_t size - the number of bytes in data
+ *             Codec40_opts opts - options selecting how the image is
+ *                                 decompressed, or NULL for the defaults
+ *  Does:      Decompresses the image straight from data, decoding each row
+ *             of big endian words in place with no intermediate copy, and
+ *             writes the PPM to stdout, or opts->output. With more than one
+ *             thread, bands of rows are decoded in parallel as in
+ *             decompress_banded. The output is the same as
+ *             decompress40_opts would write for the same file and options.
+ *             Only the fused row kernels work in place, so options that
+ *             choose the callback-based path (the defaults, or an A2Methods
+ *             suite without fused) are left to decompress40_opts. Nothing
+ *             is written unless the header is valid and every word is
+ *             present; a word out of range is a checked run-time error,
+ *             also found before anything is written.
+ *  Return:    bool - false if data could not be decompressed in place, in
+ *             which case the caller should use decompress40_opts, which
+ *             handles every option and reports the error
+ */
+bool decompress40_inplace(const unsigned char *data, size_t size,
+                          Codec40_opts opts)
+{
+    assert(data != NULL);
+    unsigned width, height;
+    const unsigned char *raw;
+    if (!uses_row_kernels(opts) ||
+        Buffer40_parse(data, size, &width, &height, &raw) != BUFFER40_OK) {
+        return false;
+    }
+    /* every word is at hand, so a corrupt one stops the process before
+       anything is written */
+    assert(Bitpack40_valid_row(raw, (size_t)width * height, true));
+    if (opts != NULL && opts->threads > 1) {
+        decompress_banded(NULL, raw, width, height, opts);
+        return true;
+    }
+
+    size_t scanline = (size_t)width * 2 * 3;
+    unsigned char *top = Codec40_alloc(opts, scanline);
+    unsigned char *bottom = Codec40_alloc(opts, scanline);
+    assert(top != NULL && bottom != NULL);
+    struct Row_decoder decoder = decoder_new(opts);
+    FILE *output = Codec40_output(opts);
+    fprintf(output, "P6\n%u %u\n%u\n", width * 2, height * 2,
+            DECOMPRESS_DENOMINATOR);
+    for (unsigned row = 0; row < height; row++) {
+        decode_row(&decoder, &raw[(size_t)row * width * 4], true, width, top,
+                   bottom);
+        fwrite(top, 1, scanline, output);
+        fwrite(bottom, 1, scanline, output);
+    }
+    decoder_free(&decoder, opts);
+    Codec40_release(opts, top);
+    Codec40_release(opts, bottom);
+    return true;
+}
+
+/*
+ *  Function:  decompress_mapped
+ *  Arguments: UArray2_T compressed - the array of bitpacked pixel groups
+ *             A2Methods_T methods - the suite to store the pixmap with
+ *             FILE *output - the stream to write to
+ *  Does:      Decompresses the image by looping over the rows of words,
+ *             decompressing every word into a pixmap (blocked, unless the
+ *             options chose another suite), then writes the pixmap to
+ *             output.
+ *  Return:    void
+ */
+static void decompress_mapped(UArray2_T compressed, A2Methods_T methods,
+                              FILE *output)
+{
+    assert(compressed != NULL && methods != NULL);
     Pnm_rgb temp;
     A2Methods_UArray2 pixels = methods->new(UArray2_width(compressed) * 2,
                                             UArray2_height(compressed) * 2,
@@ -68,15 +692,22 @@ void decompress40(FILE *input)
                             };
     Pnm_ppm pixmap_p = &pixmap;
     
-    /* map over compressed PPM and decompress it into pixmap_p */
-    UArray2_map_row_major(compressed, decompress_cb, pixmap_p);
+    /* decompress each row of words into pixmap_p */
+    int width = UArray2_width(compressed);
+    int height = UArray2_height(compressed);
+    const Chroma40_tables *chroma = Chroma40_get();
+    for (int row = 0; row < height; row++) {
+        const uint32_t *words = UArray2_row(compressed, row);
+        for (int col = 0; col < width; col++) {
+            decompress_group(words[col], pixmap_p, col, row, chroma);
+        }
+    }
     
-    /* write decompressed PPM to stdout */
-    Pnm_ppmwrite(stdout, pixmap_p);
+    /* write decompressed PPM */
+    Pnm_ppmwrite(output, pixmap_p);
 
     /* free heap allocated memory (except *input) */
     methods->free(&pixels);
-    UArray2_free(&compressed);
 }
 
 /*
@@ -136,38 +767,34 @@ static void decompress_pixel(float avg_pb, float avg_pr, float y_vals[4],
 }
 
 /*
- * Function:  decompress_cb
- * Arguments: int col - the column index of a bitpacked pixel group in the
- *                      specified 2D array
- *            int row - the row index of a bitpacked pixel group in the
- *                      specified 2D array
- *            UArray2_T image - a pointer to an existing 2D array containing
- *                              each bitpacked pixel group from the
- *                              compressed image.
- *            void *elem - a void pointer to the current bitpacked pixel group
- *            void *cl - a void pointer to a Pnm_ppm struct representing the
- *                       decompressed destination image
- * Does:      Callback function that maps a bitpacked pixel group to a set of
- *            four pixels in a destination image array.
+ * Function:  decompress_group
+ * Arguments: uint32_t word - a bitpacked pixel group
+ *            Pnm_ppm pixmap - a pointer to the decompressed ppm
+ *            int col - the column index of the bitpacked pixel group in the
+ *                      compressed image
+ *            int row - the row index of the bitpacked pixel group in the
+ *                      compressed image
+ *            const Chroma40_tables *chroma - the chroma dequantization table
+ * Does:      Decompresses a bitpacked pixel group into its set of four
+ *            pixels in the destination image array.
  * Return:    void
  */
-static void decompress_cb(int col, int row, UArray2_T image, void *elem,
-                          void *cl) 
+static void decompress_group(uint32_t word, Pnm_ppm pixmap, int col, int row,
+                             const Chroma40_tables *chroma)
 {
-    assert(image != NULL && elem != NULL && cl != NULL);
-    uint32_t word = *(uint32_t *)elem;
-    Pnm_ppm pixmap = (Pnm_ppm)cl;
+    assert(pixmap != NULL);
     assert(pixmap->pixels != NULL && pixmap->methods != NULL);
     
     /* unbitpack and dequantize pixel data */
-    float dq_a = dequantize_avg_brightness(Bitpack_getu(word, A_WIDTH, a_lsb));
-    float dq_b = dequantize_dct(Bitpack_gets(word, B_WIDTH, b_lsb));
-    float dq_c = dequantize_dct(Bitpack_gets(word, C_WIDTH, c_lsb));
-    float dq_d = dequantize_dct(Bitpack_gets(word, D_WIDTH, d_lsb));
-    unsigned pb_index = Bitpack_getu(word, PB_WIDTH, pb_lsb);
-    unsigned pr_index = Bitpack_getu(word, PR_WIDTH, pr_lsb);
-    float avg_pb = Arith40_chroma_of_index(pb_index);
-    float avg_pr = Arith40_chroma_of_index(pr_index);
+    Bitpack40_fields fields = Bitpack40_unpack(word);
+    float dq_a = dequantize_avg_brightness(fields.a);
+    float dq_b = dequantize_dct(fields.b);
+    float dq_c = dequantize_dct(fields.c);
+    float dq_d = dequantize_dct(fields.d);
+    unsigned pb_index = fields.pb;
+    unsigned pr_index = fields.pr;
+    float avg_pb = Chroma40_chroma(chroma, pb_index);
+    float avg_pr = Chroma40_chroma(chroma, pr_index);
  
     /* transform DCT space to brighness values */
     float dcts[4] = {dq_a, dq_b, dq_c, dq_d};
@@ -196,8 +823,7 @@ static void read_header(FILE *input, unsigned *width, unsigned *height)
 {
     assert(input != NULL && width != NULL && height != NULL);
     /* check for a direct match of the specified phrase, store width/height */
-    int read = fscanf(input, "COMP40 Compressed image format 2\n%u %u", width,
-                      height);
+    int read = fscanf(input, BUFFER40_MAGIC "\n%u %u", width, height);
     assert(read == 2);
     /* error case if width or height is nonpositive */
     if (*width == 0 || *height == 0) {
@@ -209,44 +835,61 @@ static void read_header(FILE *input, unsigned *width, unsigned *height)
     assert(c == '\n');
 }
 
+/*
+ *  Function:  read_word_rows
+ *  Arguments: FILE *input - a non-null pointer to an opened, compressed PPM
+ *                           image file, positioned within the words
+ *             uint32_t *words - an array of at least width * rows words to
+ *                               be filled in row-major order
+ *             unsigned width - the number of words in each row
+ *             unsigned rows - the number of rows to read
+ *  Does:      Reads the next rows of big endian words from the compressed
+ *             file. Exits with an error message if the file ends early.
+ *  Return:    void
+ */
+static void read_word_rows(FILE *input, uint32_t *words, unsigned width,
+                           unsigned rows)
+{
+    size_t count = (size_t)width * rows;
+    if (read_words(input, words, count) != count) {
+        fprintf(stderr, "Invalid compressed image file.\n");
+        fclose(input);
+        exit(EXIT_FAILURE);
+    }
+}
+
 /*
  *  Function:  read_compressed
  *  Arguments: FILE *input - a non-null pointer to an opened, compressed PPM
  *                           image file
- *  Does:      Reads compressed data from the specified image file, storing each
- *             word in an unboxed 2D array. A pointer to this array is returned
- *             to the client, which must be manually freed by the client before
- *             program termination.
+ *             Codec40_opts opts - the options, or NULL, whose region (if
+ *                                 any) holds the array
+ *  Does:      Reads compressed data from the specified image file,
+ *             storing each word in an unboxed 2D array. A pointer to this
+ *             array is returned to the client, which must be manually freed
+ *             by the client before program termination.
  *  Return:    UArray2_T - the array containing the compressed words.
  */
-static UArray2_T read_compressed(FILE *input)
+static UArray2_T read_compressed(FILE *input, Codec40_opts opts)
 {
     /* read width and height from header */
     unsigned height, width;
     read_header(input, &width, &height);
     
     /* create 2D array to store bitpacked pixel groups */
-    UArray2_T compressed = UArray2_new(width, height, sizeof(uint32_t));
+    UArray2_T compressed = Codec40_array(opts, width, height,
+                                         sizeof(uint32_t));
 
-    /* loop over expected size of image store each word in compressed */
-    int c = getc(input);
+    /* read the words of each row straight into the row's storage, which
+       is contiguous */
     for (unsigned row = 0; row < height; row++) {
-        for (unsigned col = 0; col < width; col++) {
-            uint32_t word = 0;
-            /* obtain each byte accounting for big endianness */
-            for(int byte = 3; byte >= 0 && !feof(input); c = getc(input)) {
-                word = Bitpack_newu(word, 8, byte * 8, c);
-                byte--;
-            }
-            /* error case if there were not enough pixels provided */
-            if (feof(input) && !(row == height - 1 && col == width - 1)) {
-                fprintf(stderr, "Invalid compressed image file.\n");
-                fclose(input);
-                UArray2_free(&compressed);
-                exit(EXIT_FAILURE);
-            }
-            /* store bitpacked word in compressed */
-            *(uint32_t *)UArray2_at(compressed, col, row) = word;
+        uint32_t *words = UArray2_row(compressed, row);
+        /* error case if there were not enough pixels provided */
+        if (read_words(input, words, width) != width) {
+            fprintf(stderr, "Invalid compressed image file.\n");
+            fclose(input);
+            UArray2_free(&compressed);
+            exit(EXIT_FAILURE);
         }
     }
     return compressed;
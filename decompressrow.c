@@ -0,0 +1,492 @@
+/******************************************************************************
+ *
+ *                              decompressrow.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the decompressrow.h interface, a fused decompression kernel
+ *     which converts one row of bitpacked words into two scanlines of a
+ *     PPM image with a denominator of 255. Each pixel is written as three
+ *     bytes (red, green, blue), which is exactly the raster format of a
+ *     binary PPM, so the scanlines can be written out as they are.
+ *
+ *     The arithmetic mirrors decompressmath.c and decompress40.c operation
+ *     for operation (same constants, same precision, same order of
+ *     evaluation), so that the pixels produced here are identical to the
+ *     ones produced by mapping decompress_cb over the compressed array.
+ *
+ *     Without AVX2, words are unpacked a chunk at a time with the bulk
+ *     Bitpack40_unpack_n before being decoded. On x86 processors with AVX2,
+ *     decompress_row unpacks 8 words per iteration with the vector
+ *     Bitpack40 field extractors, and performs the inverse DCT
+ *     and color transform in vector registers. As in compressrow.c, the
+ *     color transform uses double-precision lanes to stay bit-exact.
+ *
+ *     decompress_row_be takes its words as the big endian bytes of the
+ *     compressed file format instead, so that a memory-mapped file can be
+ *     decompressed in place; the vector kernel byte-swaps 8 words with one
+ *     shuffle.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "assert.h"
+
+#include "bitpack40.h"
+#include "chroma40.h"
+#include "compressinfo.h"
+#include "cpufeatures.h"
+#include "decompressrow.h"
+#include "wordio.h"
+
+/* Number of words unpacked with one bulk call */
+#define BULK_WORDS 64
+
+/* Static function declarations */
+static inline float clamp_unit(float val);
+static inline void cv_to_bytes(float y, float pb, float pr,
+                               unsigned char *pixel);
+static inline void decompress_word(Bitpack40_fields fields,
+                                   const float *chromas,
+                                   unsigned char *top, unsigned char *bottom);
+static void decompress_groups(const void *words, unsigned first,
+                              unsigned end, bool big_endian,
+                              const float *chromas,
+                              unsigned char *top, unsigned char *bottom);
+static void decompress_row_order(const void *words, unsigned width,
+                                 unsigned char *top, unsigned char *bottom,
+                                 bool big_endian);
+
+/*
+ *  Function:  clamp_unit
+ *  Arguments: float val - a normalized RGB value
+ *  Does:      Trims a value to the range [0, 1], like trim_normalized_rgbs.
+ *  Return:    float - the trimmed value
+ */
+static inline float clamp_unit(float val)
+{
+    val = val < 0 ? 0 : val;
+    return val > 1 ? 1 : val;
+}
+
+/*
+ *  Function:  cv_to_bytes
+ *  Arguments: float y, pb, pr - the component-video values of a pixel
+ *             unsigned char *pixel - the three bytes of the pixel in the
+ *                                    output scanline
+ *  Does:      Transforms a pixel to RGB exactly as cv_to_rgb,
+ *             trim_normalized_rgbs and unscale_rgb do, and stores it.
+ *  Return:    void
+ */
+static inline void cv_to_bytes(float y, float pb, float pr,
+                               unsigned char *pixel)
+{
+    float red = 1.0 * y + 0.0 * pb + 1.402 * pr;
+    float green = 1.0 * y - 0.344136 * pb - 0.714136 * pr;
+    float blue = 1.0 * y + 1.772 * pb + 0.0 * pr;
+
+    pixel[0] = (unsigned)(clamp_unit(red) * DECOMPRESS_DENOMINATOR);
+    pixel[1] = (unsigned)(clamp_unit(green) * DECOMPRESS_DENOMINATOR);
+    pixel[2] = (unsigned)(clamp_unit(blue) * DECOMPRESS_DENOMINATOR);
+}
+
+/*
+ *  Function:  decompress_cv_bytes
+ *  Arguments: float y, pb, pr - the component-video values of a pixel
+ *             unsigned char *pixel - where the pixel's three bytes go
+ *  Does:      Exported cv_to_bytes, for code that decodes pixels by other
+ *             means but must agree with the kernels bit for bit (see
+ *             rgbtable40.c).
+ *  Return:    void
+ */
+void decompress_cv_bytes(float y, float pb, float pr, unsigned char *pixel)
+{
+    assert(pixel != NULL);
+    cv_to_bytes(y, pb, pr, pixel);
+}
+
+/*
+ *  Function:  decompress_word
+ *  Arguments: Bitpack40_fields fields - the fields of a bitpacked pixel
+ *                                       group
+ *             const float *chromas - the chroma value of every index
+ *             unsigned char *top - where the top-left pixel of the group
+ *                                  goes; the top-right pixel follows it
+ *             unsigned char *bottom - where the bottom-left pixel goes; the
+ *                                     bottom-right pixel follows it
+ *  Does:      Decompresses one word into its 2x2 pixel group.
+ *  Return:    void
+ */
+static inline void decompress_word(Bitpack40_fields fields,
+                                   const float *chromas,
+                                   unsigned char *top, unsigned char *bottom)
+{
+    float a = fields.a / 63.0;
+    float b = fields.b / 50.0;
+    float c = fields.c / 50.0;
+    float d = fields.d / 50.0;
+    float pb = chromas[fields.pb];
+    float pr = chromas[fields.pr];
+
+    /* inverse DCT, as in dct_to_brightness */
+    cv_to_bytes(a - b - c + d, pb, pr, &top[0]);
+    cv_to_bytes(a - b + c - d, pb, pr, &top[3]);
+    cv_to_bytes(a + b - c - d, pb, pr, &bottom[0]);
+    cv_to_bytes(a + b + c + d, pb, pr, &bottom[3]);
+}
+
+/*
+ *  Function:  decompress_groups
+ *  Arguments: const void *words - a row of words
+ *             unsigned first, end - the range of words to decompress
+ *             bool big_endian - whether the row holds big endian bytes
+ *                               rather than native uint32_ts
+ *             const float *chromas - the chroma value of every index
+ *             unsigned char *top, *bottom - the scanlines of the row
+ *  Does:      Decompresses a range of words a chunk at a time: up to
+ *             BULK_WORDS words are unpacked into columns with one call to
+ *             the bulk Bitpack40_unpack_n, then decoded into pixels.
+ *  Return:    void
+ */
+static void decompress_groups(const void *words, unsigned first,
+                              unsigned end, bool big_endian,
+                              const float *chromas,
+                              unsigned char *top, unsigned char *bottom)
+{
+    uint32_t native[BULK_WORDS];
+    unsigned a[BULK_WORDS], pb[BULK_WORDS], pr[BULK_WORDS];
+    int b[BULK_WORDS], c[BULK_WORDS], d[BULK_WORDS];
+    Bitpack40_columns columns = { a, b, c, d, pb, pr };
+
+    for (unsigned col = first; col < end; col += BULK_WORDS) {
+        unsigned n = end - col < BULK_WORDS ? end - col : BULK_WORDS;
+        for (unsigned i = 0; i < n; i++) {
+            native[i] = load_word(words, col + i, big_endian);
+        }
+        Bitpack40_unpack_n(n, native, columns);
+        for (unsigned i = 0; i < n; i++) {
+            Bitpack40_fields fields = { a[i], b[i], c[i], d[i], pb[i],
+                                        pr[i] };
+            decompress_word(fields, chromas, &top[6 * (col + i)],
+                            &bottom[6 * (col + i)]);
+        }
+    }
+}
+
+/*
+ *  Function:  decompress_row_scalar
+ *  Arguments: const uint32_t *words - a row of width bitpacked words
+ *             unsigned width - the number of words in the row
+ *             unsigned char *top - a scanline of at least 6 * width bytes to
+ *                                  be filled with the upper pixel of every
+ *                                  group
+ *             unsigned char *bottom - a scanline of the same size to be
+ *                                     filled with the lower pixels
+ *  Does:      Decompresses one row of words into two scanlines of 8-bit RGB
+ *             pixels, one word at a time. This is the portable reference
+ *             for the SIMD kernel.
+ *  Return:    void
+ */
+void decompress_row_scalar(const uint32_t *words, unsigned width,
+                           unsigned char *top, unsigned char *bottom)
+{
+    assert(words != NULL && top != NULL && bottom != NULL);
+    const float *chromas = Chroma40_get()->chroma;
+
+    for (unsigned col = 0; col < width; col++) {
+        decompress_word(Bitpack40_unpack(words[col]), chromas, &top[6 * col],
+                        &bottom[6 * col]);
+    }
+}
+
+#ifdef CPUFEATURES_X86
+
+/* Number of words decompressed per iteration of the AVX2 kernel */
+#define AVX2_WORDS 8
+
+/*
+ *  Function:  dequantize_avx2
+ *  Arguments: __m256i quantized - 8 quantized integers
+ *             double step - the quantization denominator (63 or 50)
+ *  Does:      Divides each value by step in double precision and rounds
+ *             the quotient to float, like the dequantize functions in
+ *             decompressmath.c.
+ *  Return:    __m256 - the 8 dequantized values
+ */
+TARGET_AVX2
+static inline __m256 dequantize_avx2(__m256i quantized, double step)
+{
+    __m256d steps = _mm256_set1_pd(step);
+    __m128 lo = _mm256_cvtpd_ps(_mm256_div_pd(
+        _mm256_cvtepi32_pd(_mm256_castsi256_si128(quantized)), steps));
+    __m128 hi = _mm256_cvtpd_ps(_mm256_div_pd(
+        _mm256_cvtepi32_pd(_mm256_extracti128_si256(quantized, 1)), steps));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+/*
+ *  Function:  dequantize_chroma_avx2
+ *  Arguments: __m256 chromas_lo, chromas_hi - the chroma values of indices
+ *                                             0 to 7 and 8 to 15
+ *             __m256i index - 8 chroma indices
+ *  Does:      Looks up 8 chroma values in the 16-entry table held in two
+ *             registers: each half is permuted by the low three bits of
+ *             the index, and bit 3, shifted into the sign bit, picks the
+ *             half. This avoids a gather from memory.
+ *  Return:    __m256 - the 8 chroma values
+ */
+TARGET_AVX2
+static inline __m256 dequantize_chroma_avx2(__m256 chromas_lo,
+                                            __m256 chromas_hi, __m256i index)
+{
+    __m256 from_lo = _mm256_permutevar8x32_ps(chromas_lo, index);
+    __m256 from_hi = _mm256_permutevar8x32_ps(chromas_hi, index);
+    return _mm256_blendv_ps(from_lo, from_hi,
+                            _mm256_castsi256_ps(_mm256_slli_epi32(index, 28)));
+}
+
+/*
+ *  Function:  widen_avx2
+ *  Arguments: __m256 vals - 8 floats
+ *             __m256d *lo, *hi - filled in with the low and high 4 values
+ *                                converted to double
+ *  Does:      Splits a float vector into two double vectors.
+ *  Return:    void
+ */
+TARGET_AVX2
+static inline void widen_avx2(__m256 vals, __m256d *lo, __m256d *hi)
+{
+    *lo = _mm256_cvtps_pd(_mm256_castps256_ps128(vals));
+    *hi = _mm256_cvtps_pd(_mm256_extractf128_ps(vals, 1));
+}
+
+/*
+ *  Function:  narrow_to_channel_avx2
+ *  Arguments: __m256d lo, hi - 8 normalized RGB values of one channel
+ *  Does:      Rounds the values to float, trims them to [0, 1] and upscales
+ *             them by the denominator, truncating like unscale_rgb.
+ *  Return:    __m256i - the 8 channel values in the range [0, 255]
+ */
+TARGET_AVX2
+static inline __m256i narrow_to_channel_avx2(__m256d lo, __m256d hi)
+{
+    __m256 vals = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+    vals = _mm256_min_ps(_mm256_max_ps(vals, _mm256_setzero_ps()),
+                         _mm256_set1_ps(1.0f));
+    return _mm256_cvttps_epi32(_mm256_mul_ps(
+        vals, _mm256_set1_ps((float)DECOMPRESS_DENOMINATOR)));
+}
+
+/*
+ *  Function:  cv_to_pixels_avx2
+ *  Arguments: __m256 y - brightness of one pixel from each of 8 groups
+ *             __m256d pb_lo, pb_hi, pr_lo, pr_hi - chroma of the 8 groups
+ *             uint32_t pixels[AVX2_WORDS] - filled in with each pixel's red,
+ *                                           green and blue values in its
+ *                                           three low bytes
+ *  Does:      Vector version of cv_to_bytes for 8 pixels. The terms that
+ *             are multiplied by 0.0 in cv_to_rgb are left out, since adding
+ *             zero does not change a nonzero sum and the sign of a zero sum
+ *             is lost in the conversion to an integer.
+ *  Return:    void
+ */
+TARGET_AVX2
+static inline void cv_to_pixels_avx2(__m256 y, __m256d pb_lo, __m256d pb_hi,
+                                     __m256d pr_lo, __m256d pr_hi,
+                                     uint32_t pixels[AVX2_WORDS])
+{
+    __m256d y_lo, y_hi;
+    widen_avx2(y, &y_lo, &y_hi);
+    __m256d k_r_pr = _mm256_set1_pd(1.402);
+    __m256d k_g_pb = _mm256_set1_pd(0.344136);
+    __m256d k_g_pr = _mm256_set1_pd(0.714136);
+    __m256d k_b_pb = _mm256_set1_pd(1.772);
+
+    __m256i red = narrow_to_channel_avx2(
+        _mm256_add_pd(y_lo, _mm256_mul_pd(k_r_pr, pr_lo)),
+        _mm256_add_pd(y_hi, _mm256_mul_pd(k_r_pr, pr_hi)));
+    __m256i green = narrow_to_channel_avx2(
+        _mm256_sub_pd(_mm256_sub_pd(y_lo, _mm256_mul_pd(k_g_pb, pb_lo)),
+                      _mm256_mul_pd(k_g_pr, pr_lo)),
+        _mm256_sub_pd(_mm256_sub_pd(y_hi, _mm256_mul_pd(k_g_pb, pb_hi)),
+                      _mm256_mul_pd(k_g_pr, pr_hi)));
+    __m256i blue = narrow_to_channel_avx2(
+        _mm256_add_pd(y_lo, _mm256_mul_pd(k_b_pb, pb_lo)),
+        _mm256_add_pd(y_hi, _mm256_mul_pd(k_b_pb, pb_hi)));
+
+    __m256i packed = _mm256_or_si256(red, _mm256_or_si256(
+        _mm256_slli_epi32(green, 8), _mm256_slli_epi32(blue, 16)));
+    _mm256_storeu_si256((__m256i *)pixels, packed);
+}
+
+/*
+ *  Function:  store_pixels
+ *  Arguments: const uint32_t pixels[AVX2_WORDS] - 8 packed pixels, one from
+ *                                                 each of 8 groups
+ *             unsigned char *dest - where the first pixel goes; each later
+ *                                   pixel goes 6 bytes (one group) further
+ *  Does:      Writes the three low bytes of each packed pixel into a
+ *             scanline.
+ *  Return:    void
+ */
+static inline void store_pixels(const uint32_t pixels[AVX2_WORDS],
+                                unsigned char *dest)
+{
+    for (int i = 0; i < AVX2_WORDS; i++) {
+        dest[6 * i] = pixels[i];
+        dest[6 * i + 1] = pixels[i] >> 8;
+        dest[6 * i + 2] = pixels[i] >> 16;
+    }
+}
+
+/*
+ *  Function:  decompress_words_avx2
+ *  Arguments: const void *words - 8 consecutive bitpacked words
+ *             bool big_endian - whether the words are big endian bytes
+ *                               rather than native uint32_ts
+ *             const float *chromas - the chroma value of every index
+ *             unsigned char *top, *bottom - where the upper and lower pixels
+ *                                           of the first group go
+ *  Does:      Decompresses 8 consecutive words into their pixel groups.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void decompress_words_avx2(const void *words, bool big_endian,
+                                  const float *chromas,
+                                  unsigned char *top, unsigned char *bottom)
+{
+    __m256i packed = _mm256_loadu_si256((const __m256i *)words);
+    if (big_endian) {
+        packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+    }
+    __m256 a = dequantize_avx2(
+        Bitpack40_get_unsigned_avx2(packed, A_WIDTH, a_lsb), 63.0);
+    __m256 b = dequantize_avx2(
+        Bitpack40_get_signed_avx2(packed, B_WIDTH, b_lsb), 50.0);
+    __m256 c = dequantize_avx2(
+        Bitpack40_get_signed_avx2(packed, C_WIDTH, c_lsb), 50.0);
+    __m256 d = dequantize_avx2(
+        Bitpack40_get_signed_avx2(packed, D_WIDTH, d_lsb), 50.0);
+    __m256 chromas_lo = _mm256_loadu_ps(chromas);
+    __m256 chromas_hi = _mm256_loadu_ps(&chromas[8]);
+    __m256 pb = dequantize_chroma_avx2(
+        chromas_lo, chromas_hi,
+        Bitpack40_get_unsigned_avx2(packed, PB_WIDTH, pb_lsb));
+    __m256 pr = dequantize_chroma_avx2(
+        chromas_lo, chromas_hi,
+        Bitpack40_get_unsigned_avx2(packed, PR_WIDTH, pr_lsb));
+    __m256d pb_lo, pb_hi, pr_lo, pr_hi;
+    widen_avx2(pb, &pb_lo, &pb_hi);
+    widen_avx2(pr, &pr_lo, &pr_hi);
+
+    /* inverse DCT, as in dct_to_brightness */
+    __m256 a_minus_b = _mm256_sub_ps(a, b);
+    __m256 a_plus_b = _mm256_add_ps(a, b);
+    __m256 y_vals[4] = {
+        _mm256_add_ps(_mm256_sub_ps(a_minus_b, c), d),
+        _mm256_sub_ps(_mm256_add_ps(a_minus_b, c), d),
+        _mm256_sub_ps(_mm256_sub_ps(a_plus_b, c), d),
+        _mm256_add_ps(_mm256_add_ps(a_plus_b, c), d)
+    };
+
+    uint32_t pixels[AVX2_WORDS];
+    for (int i = 0; i < 4; i++) {
+        cv_to_pixels_avx2(y_vals[i], pb_lo, pb_hi, pr_lo, pr_hi, pixels);
+        unsigned char *dest = i < 2 ? top : bottom;
+        store_pixels(pixels, &dest[3 * (i % 2)]);
+    }
+}
+
+/*
+ *  Function:  decompress_row_avx2
+ *  Arguments: see decompress_row_order
+ *  Does:      Decompresses a row of words 8 at a time, finishing any
+ *             leftover words with decompress_groups.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void decompress_row_avx2(const void *words, unsigned width,
+                                unsigned char *top, unsigned char *bottom,
+                                bool big_endian)
+{
+    const float *chromas = Chroma40_get()->chroma;
+    const unsigned char *bytes = words;
+    unsigned col = 0;
+
+    for (; col + AVX2_WORDS <= width; col += AVX2_WORDS) {
+        decompress_words_avx2(&bytes[4 * col], big_endian, chromas,
+                              &top[6 * col], &bottom[6 * col]);
+    }
+    decompress_groups(words, col, width, big_endian, chromas, top, bottom);
+}
+
+#endif
+
+/*
+ *  Function:  decompress_row_order
+ *  Arguments: const void *words - a row of width bitpacked words
+ *             unsigned width - the number of words in the row
+ *             unsigned char *top, *bottom - scanlines of at least 6 * width
+ *                                           bytes, as for
+ *                                           decompress_row_scalar
+ *             bool big_endian - whether the words are big endian bytes
+ *                               rather than native uint32_ts
+ *  Does:      Decompresses one row of words with the fastest kernel the
+ *             processor supports.
+ *  Return:    void
+ */
+static void decompress_row_order(const void *words, unsigned width,
+                                 unsigned char *top, unsigned char *bottom,
+                                 bool big_endian)
+{
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        decompress_row_avx2(words, width, top, bottom, big_endian);
+        return;
+    }
+#endif
+    const float *chromas = Chroma40_get()->chroma;
+    decompress_groups(words, 0, width, big_endian, chromas, top, bottom);
+}
+
+/*
+ *  Function:  decompress_row
+ *  Arguments: see decompress_row_scalar
+ *  Does:      Decompresses one row of words into two scanlines of 8-bit RGB
+ *             pixels with the fastest kernel the processor supports.
+ *             Produces exactly the pixels that the callback-based path in
+ *             decompress40.c would.
+ *  Return:    void
+ */
+void decompress_row(const uint32_t *words, unsigned width,
+                    unsigned char *top, unsigned char *bottom)
+{
+    assert(words != NULL && top != NULL && bottom != NULL);
+    decompress_row_order(words, width, top, bottom, false);
+}
+
+/*
+ *  Function:  decompress_row_be
+ *  Arguments: const unsigned char *bytes - a row of width words stored as
+ *                                          in a compressed file, 4 big
+ *                                          endian bytes each
+ *             unsigned width, unsigned char *top, *bottom - as for
+ *                                                          decompress_row
+ *  Does:      Decompresses one row of a compressed file in place, without
+ *             converting its words to native byte order first. Produces the
+ *             same pixels as decompress_row.
+ *  Return:    void
+ */
+void decompress_row_be(const unsigned char *bytes, unsigned width,
+                       unsigned char *top, unsigned char *bottom)
+{
+    assert(bytes != NULL && top != NULL && bottom != NULL);
+    decompress_row_order(bytes, width, top, bottom, true);
+}
@@ -0,0 +1,34 @@
+/******************************************************************************
+ *
+ *                              decompressrow.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for the fused decompression kernel, which turns one row of
+ *     bitpacked 32-bit words into two scanlines of 8-bit RGB pixels. (See
+ *     the implementation file decompressrow.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+
+#ifndef DECOMPRESSROW_H
+#define DECOMPRESSROW_H
+
+/* Denominator of every image produced by the decompressor */
+#define DECOMPRESS_DENOMINATOR 255
+
+extern void decompress_row(const uint32_t *words, unsigned width,
+                           unsigned char *top, unsigned char *bottom);
+extern void decompress_row_be(const unsigned char *bytes, unsigned width,
+                              unsigned char *top, unsigned char *bottom);
+extern void decompress_row_scalar(const uint32_t *words, unsigned width,
+                                  unsigned char *top, unsigned char *bottom);
+
+/* The color transform of the kernels above for a single pixel */
+extern void decompress_cv_bytes(float y, float pb, float pr,
+                                unsigned char *pixel);
+
+#endif
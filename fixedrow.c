@@ -0,0 +1,765 @@
+/******************************************************************************
+ *
+ *                                fixedrow.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the fixedrow.h interface. The kernels are laid out like
+ *     the floating-point ones in compressrow.c and decompressrow.c: a
+ *     scalar function per pixel group or word, and on x86 processors with
+ *     AVX2 a kernel that handles 8 of them per iteration in 32-bit integer
+ *     lanes, with the scalar code finishing each row. Every intermediate
+ *     value fits in 31 bits (the bounds are noted where they are tight),
+ *     and the vector kernels perform exactly the scalar arithmetic.
+ *
+ *     Negative values are only ever shifted right through descale, which
+ *     biases them to be non-negative first, because C leaves the right
+ *     shift of a negative number implementation-defined. The AVX2 kernels
+ *     use arithmetic shifts, which give the same results.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "assert.h"
+
+#include "bitpack40.h"
+#include "chroma40.h"
+#include "compressinfo.h"
+#include "cpufeatures.h"
+#include "decompressrow.h"
+#include "fixedrow.h"
+#include "scanline.h"
+#include "wordio.h"
+
+/* Fixed-point formats: values in Q16, color-transform coefficients in Q14 */
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define COEF_SHIFT 14
+
+/* Color-transform coefficients of rgb_to_cv and cv_to_rgb in Q14, rounded
+   so that each row of the forward transform sums to 1 or 0 exactly */
+#define Y_R 4899
+#define Y_G 9617
+#define Y_B 1868
+#define PB_R (-2765)
+#define PB_G (-5427)
+#define PB_B 8192
+#define PR_R 8192
+#define PR_G (-6860)
+#define PR_B (-1332)
+#define R_PR 22970
+#define G_PB 5638
+#define G_PR 11700
+#define B_PB 29032
+
+/* Dequantization steps 1/63 and 1/50 in Q30 (a Q16 value times a Q14
+   multiplier); the quantized values are so small that both give the Q16
+   quotient rounded to nearest */
+#define A_STEP 17043521
+#define BCD_STEP 21474836
+
+/* Largest quantized DCT coefficient, as in quantize_dct */
+#define MAX_BCD 15
+
+/* Number of pixel groups (words) handled per iteration of the AVX2 kernels */
+#define AVX2_GROUPS 8
+
+/* Static function declarations */
+static inline int32_t descale(int32_t x, int shift);
+static inline uint32_t sample_scale(unsigned denominator);
+static inline Bitpack40_fields compress_group(const void *top,
+                                              const void *bottom, size_t col,
+                                              Sample_format format,
+                                              uint32_t scale,
+                                              const Chroma40_tables *chroma);
+static void compress_groups(const void *top, const void *bottom,
+                            unsigned first, unsigned end,
+                            Sample_format format, uint32_t scale,
+                            uint32_t *words);
+static void compress_row_format(const void *top, const void *bottom,
+                                unsigned width, unsigned denominator,
+                                uint32_t *words, Sample_format format);
+static inline void decompress_word(uint32_t word,
+                                   const Chroma40_tables *chroma,
+                                   unsigned char *top, unsigned char *bottom);
+static void decompress_row_order(const void *words, unsigned width,
+                                 unsigned char *top, unsigned char *bottom,
+                                 bool big_endian);
+
+/*
+ *  Function:  descale
+ *  Arguments: int32_t x - a fixed-point value of at least -2^30
+ *             int shift - the number of fraction bits to drop
+ *  Does:      Divides x by 2^shift, rounding to nearest with halves rounded
+ *             upward. Adding 2^30 first keeps the shifted value
+ *             non-negative.
+ *  Return:    int32_t - the rounded quotient
+ */
+static inline int32_t descale(int32_t x, int shift)
+{
+    uint32_t biased = (uint32_t)x + (1u << 30) + (1u << (shift - 1));
+    return (int32_t)(biased >> shift) - (1 << (30 - shift));
+}
+
+/*
+ *  Function:  sample_scale
+ *  Arguments: unsigned denominator - the denominator of the source image
+ *  Does:      Computes the multiplier m = round(2^31 / denominator) that
+ *             scales a sample s to Q16 as (s * m + 2^14) >> 15. Since s is
+ *             at most denominator, s * m + 2^14 is at most 2^31 + 2^15 +
+ *             2^14 and fits in 32 bits.
+ *  Return:    uint32_t - the multiplier
+ */
+static inline uint32_t sample_scale(unsigned denominator)
+{
+    return (uint32_t)(((1ull << 32) / denominator + 1) / 2);
+}
+
+/*
+ *  Function:  pixel_to_cv
+ *  Arguments: const void *row - the scanline containing the pixel
+ *             size_t pixel - the column of the pixel
+ *             Sample_format format - how the scanline is stored
+ *             uint32_t scale - the multiplier from sample_scale
+ *             int32_t *y, *pb, *pr - filled in with the component-video
+ *                                    values of the pixel in Q16
+ *  Does:      Fixed-point version of scale_rgb followed by rgb_to_cv. Each
+ *             channel is at most 2^16 + 1, so no sum of products exceeds
+ *             2^30 + 2^14 in magnitude.
+ *  Return:    void
+ */
+static inline void pixel_to_cv(const void *row, size_t pixel,
+                               Sample_format format, uint32_t scale,
+                               int32_t *y, int32_t *pb, int32_t *pr)
+{
+    int32_t red = (get_sample(row, 3 * pixel, format) * scale + (1u << 14))
+                  >> 15;
+    int32_t green = (get_sample(row, 3 * pixel + 1, format) * scale +
+                     (1u << 14)) >> 15;
+    int32_t blue = (get_sample(row, 3 * pixel + 2, format) * scale +
+                    (1u << 14)) >> 15;
+
+    *y = descale(Y_R * red + Y_G * green + Y_B * blue, COEF_SHIFT);
+    *pb = descale(PB_R * red + PB_G * green + PB_B * blue, COEF_SHIFT);
+    *pr = descale(PR_R * red + PR_G * green + PR_B * blue, COEF_SHIFT);
+}
+
+/*
+ *  Function:  quantize_a / quantize_bcd
+ *  Arguments: int32_t sum - a DCT coefficient times 4, in Q16 (that is, the
+ *                           coefficient in Q18)
+ *  Does:      Quantizes a coefficient as round(a * 63), or as
+ *             round(b * 50) clamped to [-15, 15], rounding halves away
+ *             from zero as round() does. |sum| is at most 2^18 + 4, so the
+ *             products stay below 2^24.
+ *  Return:    unsigned / int - the quantized coefficient
+ */
+static inline unsigned quantize_a(int32_t sum)
+{
+    unsigned a = ((uint32_t)sum * 63 + (1u << 17)) >> 18;
+    return a > 63 ? 63 : a;
+}
+
+static inline int quantize_bcd(int32_t sum)
+{
+    uint32_t magnitude = sum < 0 ? -(uint32_t)sum : (uint32_t)sum;
+    int q = (magnitude * 50 + (1u << 17)) >> 18;
+    q = q > MAX_BCD ? MAX_BCD : q;
+    return sum < 0 ? -q : q;
+}
+
+/*
+ *  Function:  compress_group
+ *  Arguments: const void *top - the upper scanline of a row of pixel groups
+ *             const void *bottom - the lower scanline
+ *             size_t col - the column of the pixel group
+ *             Sample_format format - how the scanlines are stored
+ *             uint32_t scale - the multiplier from sample_scale
+ *             const Chroma40_tables *chroma - the chroma quantization table
+ *  Does:      Compresses one 2x2 pixel group into the fields of its word.
+ *             Integer sums do not depend on the order of the terms, so the
+ *             DCT and chroma sums are formed directly.
+ *  Return:    Bitpack40_fields - the fields of the pixel group's word
+ */
+static inline Bitpack40_fields compress_group(const void *top,
+                                              const void *bottom, size_t col,
+                                              Sample_format format,
+                                              uint32_t scale,
+                                              const Chroma40_tables *chroma)
+{
+    int32_t y[4], pb[4], pr[4];
+    pixel_to_cv(top, 2 * col, format, scale, &y[0], &pb[0], &pr[0]);
+    pixel_to_cv(top, 2 * col + 1, format, scale, &y[1], &pb[1], &pr[1]);
+    pixel_to_cv(bottom, 2 * col, format, scale, &y[2], &pb[2], &pr[2]);
+    pixel_to_cv(bottom, 2 * col + 1, format, scale, &y[3], &pb[3], &pr[3]);
+
+    Bitpack40_fields fields = {
+        quantize_a(y[3] + y[2] + y[1] + y[0]),
+        quantize_bcd(y[3] + y[2] - y[1] - y[0]),
+        quantize_bcd(y[3] - y[2] + y[1] - y[0]),
+        quantize_bcd(y[3] - y[2] - y[1] + y[0]),
+        Chroma40_index_fixed(chroma, pb[0] + pb[1] + pb[2] + pb[3]),
+        Chroma40_index_fixed(chroma, pr[0] + pr[1] + pr[2] + pr[3])
+    };
+    return fields;
+}
+
+/*
+ *  Function:  compress_groups
+ *  Arguments: const void *top, *bottom - the scanlines of a row of pixel
+ *                                        groups
+ *             unsigned first, end - the range of pixel groups to compress
+ *             Sample_format format - how the scanlines are stored
+ *             uint32_t scale - the multiplier from sample_scale
+ *             uint32_t *words - the row of words; words first to end - 1 are
+ *                               filled in
+ *  Does:      Compresses a range of pixel groups one at a time.
+ *  Return:    void
+ */
+static void compress_groups(const void *top, const void *bottom,
+                            unsigned first, unsigned end,
+                            Sample_format format, uint32_t scale,
+                            uint32_t *words)
+{
+    const Chroma40_tables *chroma = Chroma40_get();
+    for (unsigned col = first; col < end; col++) {
+        Bitpack40_fields fields = compress_group(top, bottom, col, format,
+                                                 scale, chroma);
+        words[col] = Bitpack40_pack(fields.a, fields.b, fields.c, fields.d,
+                                    fields.pb, fields.pr);
+    }
+}
+
+#ifdef CPUFEATURES_X86
+
+/*
+ *  Function:  descale_avx2
+ *  Arguments: __m256i x - 8 fixed-point values
+ *             int shift - the number of fraction bits to drop
+ *  Does:      Vector version of descale, with an arithmetic shift.
+ *  Return:    __m256i - the 8 rounded quotients
+ */
+TARGET_AVX2
+static inline __m256i descale_avx2(__m256i x, int shift)
+{
+    return _mm256_srai_epi32(
+        _mm256_add_epi32(x, _mm256_set1_epi32(1 << (shift - 1))), shift);
+}
+
+/*
+ *  Function:  load_channel_avx2
+ *  Arguments: const void *row - a scanline
+ *             __m256i samples - indices within the scanline of 8 samples of
+ *                               one channel (see get_sample)
+ *             Sample_format format - how the scanline is stored
+ *             __m256i scale - the multiplier from sample_scale in every lane
+ *  Does:      Gathers one channel of 8 pixels and scales it to Q16. Raw
+ *             samples are gathered as whole 32-bit lanes and masked, so up
+ *             to 3 bytes past the last sample may be read.
+ *  Return:    __m256i - the 8 channel values in Q16
+ */
+TARGET_AVX2
+static inline __m256i load_channel_avx2(const void *row, __m256i samples,
+                                        Sample_format format, __m256i scale)
+{
+    __m256i raw;
+    __m256i low_byte = _mm256_set1_epi32(0xff);
+    switch (format) {
+    case SAMPLES_RGB:
+        raw = _mm256_i32gather_epi32((const int *)row, samples, 4);
+        break;
+    case SAMPLES_RAW8:
+        raw = _mm256_and_si256(
+            _mm256_i32gather_epi32((const int *)row, samples, 1), low_byte);
+        break;
+    default:
+        raw = _mm256_i32gather_epi32((const int *)row, samples, 2);
+        raw = _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(raw, low_byte), 8),
+            _mm256_and_si256(_mm256_srli_epi32(raw, 8), low_byte));
+        break;
+    }
+    return _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(raw, scale),
+                                              _mm256_set1_epi32(1 << 14)),
+                             15);
+}
+
+/*
+ *  Function:  transform_avx2
+ *  Arguments: __m256i red, green, blue - 8 pixels in Q16
+ *             int32_t k_r, k_g, k_b - Q14 coefficients
+ *  Does:      Computes one component of the color transform for 8 pixels.
+ *  Return:    __m256i - the component in Q16
+ */
+TARGET_AVX2
+static inline __m256i transform_avx2(__m256i red, __m256i green,
+                                     __m256i blue, int32_t k_r, int32_t k_g,
+                                     int32_t k_b)
+{
+    __m256i sum = _mm256_add_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(red, _mm256_set1_epi32(k_r)),
+                         _mm256_mullo_epi32(green, _mm256_set1_epi32(k_g))),
+        _mm256_mullo_epi32(blue, _mm256_set1_epi32(k_b)));
+    return descale_avx2(sum, COEF_SHIFT);
+}
+
+/*
+ *  Function:  pixels_to_cv_avx2
+ *  Arguments: const void *row - the scanline containing the pixels
+ *             __m256i samples - indices within the scanline of the red
+ *                               samples of the 8 pixels
+ *             Sample_format format - how the scanline is stored
+ *             __m256i scale - the multiplier from sample_scale in every lane
+ *             __m256i *y, *pb, *pr - filled in with the component-video
+ *                                    values of the 8 pixels in Q16
+ *  Does:      Vector version of pixel_to_cv.
+ *  Return:    void
+ */
+TARGET_AVX2
+static inline void pixels_to_cv_avx2(const void *row, __m256i samples,
+                                     Sample_format format, __m256i scale,
+                                     __m256i *y, __m256i *pb, __m256i *pr)
+{
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i red = load_channel_avx2(row, samples, format, scale);
+    samples = _mm256_add_epi32(samples, one);
+    __m256i green = load_channel_avx2(row, samples, format, scale);
+    samples = _mm256_add_epi32(samples, one);
+    __m256i blue = load_channel_avx2(row, samples, format, scale);
+
+    *y = transform_avx2(red, green, blue, Y_R, Y_G, Y_B);
+    *pb = transform_avx2(red, green, blue, PB_R, PB_G, PB_B);
+    *pr = transform_avx2(red, green, blue, PR_R, PR_G, PR_B);
+}
+
+/*
+ *  Function:  quantize_bcd_avx2
+ *  Arguments: __m256i sum - 8 DCT coefficients in Q18
+ *  Does:      Vector version of quantize_bcd.
+ *  Return:    __m256i - the quantized coefficients
+ */
+TARGET_AVX2
+static inline __m256i quantize_bcd_avx2(__m256i sum)
+{
+    __m256i q = _mm256_srli_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(_mm256_abs_epi32(sum),
+                                            _mm256_set1_epi32(50)),
+                         _mm256_set1_epi32(1 << 17)),
+        18);
+    q = _mm256_min_epi32(q, _mm256_set1_epi32(MAX_BCD));
+    return _mm256_sign_epi32(q, sum);
+}
+
+/*
+ *  Function:  compress_groups_avx2
+ *  Arguments: const void *top, *bottom - the scanlines of a row of pixel
+ *                                        groups
+ *             unsigned col - the column of the first of 8 consecutive pixel
+ *                            groups
+ *             Sample_format format - how the scanlines are stored
+ *             __m256i scale - the multiplier from sample_scale in every lane
+ *             const Chroma40_tables *chroma - the chroma quantization table
+ *             uint32_t *words - filled in with the 8 bitpacked words
+ *  Does:      Compresses 8 consecutive pixel groups at once.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void compress_groups_avx2(const void *top, const void *bottom,
+                                 unsigned col, Sample_format format,
+                                 __m256i scale, const Chroma40_tables *chroma,
+                                 uint32_t *words)
+{
+    __m256i left = _mm256_add_epi32(
+        _mm256_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42),
+        _mm256_set1_epi32(6 * col));
+    __m256i right = _mm256_add_epi32(left, _mm256_set1_epi32(3));
+
+    __m256i y0, y1, y2, y3, pb0, pb1, pb2, pb3, pr0, pr1, pr2, pr3;
+    pixels_to_cv_avx2(top, left, format, scale, &y0, &pb0, &pr0);
+    pixels_to_cv_avx2(top, right, format, scale, &y1, &pb1, &pr1);
+    pixels_to_cv_avx2(bottom, left, format, scale, &y2, &pb2, &pr2);
+    pixels_to_cv_avx2(bottom, right, format, scale, &y3, &pb3, &pr3);
+
+    __m256i upper = _mm256_add_epi32(y3, y2);
+    __m256i lower = _mm256_add_epi32(y1, y0);
+    __m256i a = _mm256_add_epi32(upper, lower);
+    __m256i b = _mm256_sub_epi32(upper, lower);
+    __m256i c = _mm256_add_epi32(_mm256_sub_epi32(y3, y2),
+                                 _mm256_sub_epi32(y1, y0));
+    __m256i d = _mm256_sub_epi32(_mm256_sub_epi32(y3, y2),
+                                 _mm256_sub_epi32(y1, y0));
+    a = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(
+            a, _mm256_set1_epi32(63)), _mm256_set1_epi32(1 << 17)), 18);
+    a = _mm256_min_epi32(a, _mm256_set1_epi32(63));
+
+    __m256i pb = _mm256_add_epi32(_mm256_add_epi32(pb0, pb1),
+                                  _mm256_add_epi32(pb2, pb3));
+    __m256i pr = _mm256_add_epi32(_mm256_add_epi32(pr0, pr1),
+                                  _mm256_add_epi32(pr2, pr3));
+
+    __m256i word = Bitpack40_pack_avx2(
+        a, quantize_bcd_avx2(b), quantize_bcd_avx2(c), quantize_bcd_avx2(d),
+        Chroma40_index_fixed_avx2(chroma, pb),
+        Chroma40_index_fixed_avx2(chroma, pr));
+    _mm256_storeu_si256((__m256i *)words, word);
+}
+
+/*
+ *  Function:  compress_row_avx2
+ *  Arguments: see compress_row_format
+ *  Does:      Compresses two scanlines 8 pixel groups at a time, finishing
+ *             any leftover groups with compress_groups. As in compressrow.c,
+ *             the last group of raw scanlines is always left to
+ *             compress_groups, so that gathers stay inside the scanline.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void compress_row_avx2(const void *top, const void *bottom,
+                              unsigned width, unsigned denominator,
+                              uint32_t *words, Sample_format format)
+{
+    uint32_t scale = sample_scale(denominator);
+    __m256i scales = _mm256_set1_epi32(scale);
+    const Chroma40_tables *chroma = Chroma40_get();
+    unsigned vector_end = width;
+    if (format != SAMPLES_RGB) {
+        vector_end = width > AVX2_GROUPS ? width - 1 : 0;
+    }
+    unsigned col = 0;
+
+    for (; col + AVX2_GROUPS <= vector_end; col += AVX2_GROUPS) {
+        compress_groups_avx2(top, bottom, col, format, scales, chroma,
+                             &words[col]);
+    }
+    compress_groups(top, bottom, col, width, format, scale, words);
+}
+
+#endif
+
+/*
+ *  Function:  compress_row_format
+ *  Arguments: const void *top - the upper scanline (an even-numbered row of
+ *                               the source image) of at least 2 * width
+ *                               pixels
+ *             const void *bottom - the scanline directly below top
+ *             unsigned width - the number of 2x2 pixel groups in the row
+ *             unsigned denominator - the denominator of the source image
+ *             uint32_t *words - an array of at least width words to be
+ *                               filled with the compressed row
+ *             Sample_format format - how the scanlines are stored
+ *  Does:      Compresses two scanlines with the fastest fixed-point kernel
+ *             the processor supports.
+ *  Return:    void
+ */
+static void compress_row_format(const void *top, const void *bottom,
+                                unsigned width, unsigned denominator,
+                                uint32_t *words, Sample_format format)
+{
+    assert(denominator > 0);
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        compress_row_avx2(top, bottom, width, denominator, words, format);
+        return;
+    }
+#endif
+    compress_groups(top, bottom, 0, width, format, sample_scale(denominator),
+                    words);
+}
+
+/*
+ *  Function:  compress_row_fixed
+ *  Arguments: see compress_row in compressrow.c
+ *  Does:      Compresses two scanlines of Pnm_rgb structs in fixed point.
+ *  Return:    void
+ */
+void compress_row_fixed(const struct Pnm_rgb *top,
+                        const struct Pnm_rgb *bottom, unsigned width,
+                        unsigned denominator, uint32_t *words)
+{
+    assert(top != NULL && bottom != NULL && words != NULL);
+    compress_row_format(top, bottom, width, denominator, words, SAMPLES_RGB);
+}
+
+/*
+ *  Function:  compress_row_raw_fixed
+ *  Arguments: see compress_row_raw in compressrow.c
+ *  Does:      Compresses two scanlines of a binary PPM raster in place, in
+ *             fixed point. Produces the same words as compress_row_fixed.
+ *  Return:    void
+ */
+void compress_row_raw_fixed(const unsigned char *top,
+                            const unsigned char *bottom, unsigned width,
+                            unsigned denominator, uint32_t *words)
+{
+    assert(top != NULL && bottom != NULL && words != NULL);
+    compress_row_format(top, bottom, width, denominator, words,
+                        denominator > 255 ? SAMPLES_RAW16 : SAMPLES_RAW8);
+}
+
+/*
+ *  Function:  channel_to_byte
+ *  Arguments: int32_t value - a color channel in Q16
+ *  Does:      Trims the channel to [0, 1] and scales it to [0, 255],
+ *             truncating like unscale_rgb.
+ *  Return:    unsigned char - the channel's byte
+ */
+static inline unsigned char channel_to_byte(int32_t value)
+{
+    value = value < 0 ? 0 : value > FIXED_ONE ? FIXED_ONE : value;
+    return (value * DECOMPRESS_DENOMINATOR) >> FIXED_SHIFT;
+}
+
+/*
+ *  Function:  cv_to_bytes
+ *  Arguments: int32_t y, pb, pr - the component-video values of a pixel in
+ *                                 Q16
+ *             unsigned char *pixel - the three bytes of the pixel in the
+ *                                    output scanline
+ *  Does:      Fixed-point version of cv_to_rgb followed by
+ *             trim_normalized_rgbs and unscale_rgb. The chroma values are at
+ *             most 0.35 in magnitude, so the products stay below 2^30.
+ *  Return:    void
+ */
+static inline void cv_to_bytes(int32_t y, int32_t pb, int32_t pr,
+                               unsigned char *pixel)
+{
+    pixel[0] = channel_to_byte(y + descale(R_PR * pr, COEF_SHIFT));
+    pixel[1] = channel_to_byte(y - descale(G_PB * pb + G_PR * pr,
+                                           COEF_SHIFT));
+    pixel[2] = channel_to_byte(y + descale(B_PB * pb, COEF_SHIFT));
+}
+
+/*
+ *  Function:  decompress_word
+ *  Arguments: uint32_t word - a bitpacked pixel group
+ *             const Chroma40_tables *chroma - the chroma dequantization
+ *                                             table
+ *             unsigned char *top - where the top-left pixel of the group
+ *                                  goes; the top-right pixel follows it
+ *             unsigned char *bottom - where the bottom-left pixel goes; the
+ *                                     bottom-right pixel follows it
+ *  Does:      Decompresses one word into its 2x2 pixel group.
+ *  Return:    void
+ */
+static inline void decompress_word(uint32_t word,
+                                   const Chroma40_tables *chroma,
+                                   unsigned char *top, unsigned char *bottom)
+{
+    Bitpack40_fields fields = Bitpack40_unpack(word);
+    int32_t a = descale((int32_t)fields.a * A_STEP, COEF_SHIFT);
+    int32_t b = descale(fields.b * BCD_STEP, COEF_SHIFT);
+    int32_t c = descale(fields.c * BCD_STEP, COEF_SHIFT);
+    int32_t d = descale(fields.d * BCD_STEP, COEF_SHIFT);
+    int32_t pb = Chroma40_chroma_fixed(chroma, fields.pb);
+    int32_t pr = Chroma40_chroma_fixed(chroma, fields.pr);
+
+    cv_to_bytes(a - b - c + d, pb, pr, &top[0]);
+    cv_to_bytes(a - b + c - d, pb, pr, &top[3]);
+    cv_to_bytes(a + b - c - d, pb, pr, &bottom[0]);
+    cv_to_bytes(a + b + c + d, pb, pr, &bottom[3]);
+}
+
+#ifdef CPUFEATURES_X86
+
+/*
+ *  Function:  channel_avx2
+ *  Arguments: __m256i value - 8 color channels in Q16
+ *  Does:      Vector version of channel_to_byte.
+ *  Return:    __m256i - the 8 channel bytes, one per lane
+ */
+TARGET_AVX2
+static inline __m256i channel_avx2(__m256i value)
+{
+    value = _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()),
+                             _mm256_set1_epi32(FIXED_ONE));
+    return _mm256_srli_epi32(
+        _mm256_mullo_epi32(value, _mm256_set1_epi32(DECOMPRESS_DENOMINATOR)),
+        FIXED_SHIFT);
+}
+
+/*
+ *  Function:  store_pixels_avx2
+ *  Arguments: __m256i y - brightness of one pixel from each of 8 groups
+ *             __m256i red_chroma - the chroma term of red for the 8 groups
+ *             __m256i green_chroma, blue_chroma - likewise for green and
+ *                                                 blue
+ *             unsigned char *dest - where the first pixel goes; each later
+ *                                   pixel goes 6 bytes (one group) further
+ *  Does:      Converts 8 pixels to bytes and writes them to a scanline.
+ *  Return:    void
+ */
+TARGET_AVX2
+static inline void store_pixels_avx2(__m256i y, __m256i red_chroma,
+                                     __m256i green_chroma,
+                                     __m256i blue_chroma, unsigned char *dest)
+{
+    __m256i red = channel_avx2(_mm256_add_epi32(y, red_chroma));
+    __m256i green = channel_avx2(_mm256_sub_epi32(y, green_chroma));
+    __m256i blue = channel_avx2(_mm256_add_epi32(y, blue_chroma));
+    uint32_t pixels[AVX2_GROUPS];
+    _mm256_storeu_si256((__m256i *)pixels, _mm256_or_si256(red,
+        _mm256_or_si256(_mm256_slli_epi32(green, 8),
+                        _mm256_slli_epi32(blue, 16))));
+    for (int i = 0; i < AVX2_GROUPS; i++) {
+        dest[6 * i] = pixels[i];
+        dest[6 * i + 1] = pixels[i] >> 8;
+        dest[6 * i + 2] = pixels[i] >> 16;
+    }
+}
+
+/*
+ *  Function:  chroma_avx2
+ *  Arguments: __m256i chromas_lo, chromas_hi - the Q16 chroma values of
+ *                                              indices 0 to 7 and 8 to 15
+ *             __m256i index - 8 chroma indices
+ *  Does:      Looks up 8 chroma values in the 16-entry table held in two
+ *             registers, as dequantize_chroma_avx2 in decompressrow.c does.
+ *  Return:    __m256i - the 8 chroma values
+ */
+TARGET_AVX2
+static inline __m256i chroma_avx2(__m256i chromas_lo, __m256i chromas_hi,
+                                  __m256i index)
+{
+    __m256 from_lo = _mm256_castsi256_ps(
+        _mm256_permutevar8x32_epi32(chromas_lo, index));
+    __m256 from_hi = _mm256_castsi256_ps(
+        _mm256_permutevar8x32_epi32(chromas_hi, index));
+    return _mm256_castps_si256(_mm256_blendv_ps(
+        from_lo, from_hi, _mm256_castsi256_ps(_mm256_slli_epi32(index, 28))));
+}
+
+/*
+ *  Function:  decompress_words_avx2
+ *  Arguments: const void *words - 8 consecutive bitpacked words
+ *             bool big_endian - whether the words are big endian bytes
+ *                               rather than native uint32_ts
+ *             const Chroma40_tables *chroma - the chroma dequantization
+ *                                             table
+ *             unsigned char *top, *bottom - where the upper and lower pixels
+ *                                           of the first group go
+ *  Does:      Decompresses 8 consecutive words into their pixel groups.
+ *  Return:    void
+ */
+TARGET_AVX2
+static void decompress_words_avx2(const void *words, bool big_endian,
+                                  const Chroma40_tables *chroma,
+                                  unsigned char *top, unsigned char *bottom)
+{
+    __m256i packed = _mm256_loadu_si256((const __m256i *)words);
+    if (big_endian) {
+        packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+    }
+    __m256i a_step = _mm256_set1_epi32(A_STEP);
+    __m256i bcd_step = _mm256_set1_epi32(BCD_STEP);
+    __m256i a = descale_avx2(_mm256_mullo_epi32(
+        Bitpack40_get_unsigned_avx2(packed, A_WIDTH, a_lsb), a_step),
+        COEF_SHIFT);
+    __m256i b = descale_avx2(_mm256_mullo_epi32(
+        Bitpack40_get_signed_avx2(packed, B_WIDTH, b_lsb), bcd_step),
+        COEF_SHIFT);
+    __m256i c = descale_avx2(_mm256_mullo_epi32(
+        Bitpack40_get_signed_avx2(packed, C_WIDTH, c_lsb), bcd_step),
+        COEF_SHIFT);
+    __m256i d = descale_avx2(_mm256_mullo_epi32(
+        Bitpack40_get_signed_avx2(packed, D_WIDTH, d_lsb), bcd_step),
+        COEF_SHIFT);
+
+    __m256i chromas_lo = _mm256_loadu_si256(
+        (const __m256i *)chroma->fixed_chroma);
+    __m256i chromas_hi = _mm256_loadu_si256(
+        (const __m256i *)&chroma->fixed_chroma[8]);
+    __m256i pb = chroma_avx2(chromas_lo, chromas_hi,
+        Bitpack40_get_unsigned_avx2(packed, PB_WIDTH, pb_lsb));
+    __m256i pr = chroma_avx2(chromas_lo, chromas_hi,
+        Bitpack40_get_unsigned_avx2(packed, PR_WIDTH, pr_lsb));
+
+    /* the chroma terms are shared by the four pixels of each group */
+    __m256i red = descale_avx2(
+        _mm256_mullo_epi32(pr, _mm256_set1_epi32(R_PR)), COEF_SHIFT);
+    __m256i green = descale_avx2(_mm256_add_epi32(
+        _mm256_mullo_epi32(pb, _mm256_set1_epi32(G_PB)),
+        _mm256_mullo_epi32(pr, _mm256_set1_epi32(G_PR))), COEF_SHIFT);
+    __m256i blue = descale_avx2(
+        _mm256_mullo_epi32(pb, _mm256_set1_epi32(B_PB)), COEF_SHIFT);
+
+    /* inverse DCT, as in decompress_word */
+    __m256i a_minus_b = _mm256_sub_epi32(a, b);
+    __m256i a_plus_b = _mm256_add_epi32(a, b);
+    __m256i c_minus_d = _mm256_sub_epi32(c, d);
+    store_pixels_avx2(_mm256_sub_epi32(a_minus_b, c_minus_d), red, green,
+                      blue, &top[0]);
+    store_pixels_avx2(_mm256_add_epi32(a_minus_b, c_minus_d), red, green,
+                      blue, &top[3]);
+    store_pixels_avx2(_mm256_sub_epi32(a_plus_b, _mm256_add_epi32(c, d)),
+                      red, green, blue, &bottom[0]);
+    store_pixels_avx2(_mm256_add_epi32(a_plus_b, _mm256_add_epi32(c, d)),
+                      red, green, blue, &bottom[3]);
+}
+
+#endif
+
+/*
+ *  Function:  decompress_row_order
+ *  Arguments: const void *words - a row of width bitpacked words
+ *             unsigned width - the number of words in the row
+ *             unsigned char *top, *bottom - scanlines of at least 6 * width
+ *                                           bytes
+ *             bool big_endian - whether the words are big endian bytes
+ *                               rather than native uint32_ts
+ *  Does:      Decompresses one row of words in fixed point, 8 words at a
+ *             time on processors with AVX2 and one at a time otherwise.
+ *  Return:    void
+ */
+static void decompress_row_order(const void *words, unsigned width,
+                                 unsigned char *top, unsigned char *bottom,
+                                 bool big_endian)
+{
+    const Chroma40_tables *chroma = Chroma40_get();
+    unsigned col = 0;
+#ifdef CPUFEATURES_X86
+    if (cpu_has_avx2()) {
+        const unsigned char *bytes = words;
+        for (; col + AVX2_GROUPS <= width; col += AVX2_GROUPS) {
+            decompress_words_avx2(&bytes[4 * col], big_endian, chroma,
+                                  &top[6 * col], &bottom[6 * col]);
+        }
+    }
+#endif
+    for (; col < width; col++) {
+        decompress_word(load_word(words, col, big_endian), chroma,
+                        &top[6 * col], &bottom[6 * col]);
+    }
+}
+
+/*
+ *  Function:  decompress_row_fixed
+ *  Arguments: see decompress_row in decompressrow.c
+ *  Does:      Decompresses one row of native words in fixed point.
+ *  Return:    void
+ */
+void decompress_row_fixed(const uint32_t *words, unsigned width,
+                          unsigned char *top, unsigned char *bottom)
+{
+    assert(words != NULL && top != NULL && bottom != NULL);
+    decompress_row_order(words, width, top, bottom, false);
+}
+
+/*
+ *  Function:  decompress_row_be_fixed
+ *  Arguments: see decompress_row_be in decompressrow.c
+ *  Does:      Decompresses one row of big endian words in place, in fixed
+ *             point.
+ *  Return:    void
+ */
+void decompress_row_be_fixed(const unsigned char *bytes, unsigned width,
+                             unsigned char *top, unsigned char *bottom)
+{
+    assert(bytes != NULL && top != NULL && bottom != NULL);
+    decompress_row_order(bytes, width, top, bottom, true);
+}
@@ -0,0 +1,65 @@
+/******************************************************************************
+ *
+ *                                fixedrow.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for the fixed-point row kernels, an all-integer alternative
+ *     to the floating-point kernels of compressrow.h and decompressrow.h
+ *     with the same signatures. They read and write the same compressed
+ *     format, but do every step of the arithmetic in 32-bit integers, so
+ *     their output is bit-for-bit the same on every compiler and processor
+ *     (and in the scalar and AVX2 kernels).
+ *
+ *     Values in [0, 1] or thereabouts are held in Q16, as round(v * 2^16).
+ *     Rounding, step by step:
+ *
+ *       - a sample s of an image with denominator d is scaled to Q16 as
+ *         (s * m + 2^14) >> 15, with m = round(2^31 / d) computed once per
+ *         row, so it is within 1 unit of s / d in Q16;
+ *       - the color transforms use their coefficients rounded to Q14 (each
+ *         set summing exactly to 1 or 0), and every product is brought back
+ *         to Q16 rounding to nearest, halves upward;
+ *       - the DCT coefficients are kept as sums of four Q16 values and
+ *         quantized with round-half-away-from-zero, as round() does, and
+ *         the chroma averages are quantized with the exact thresholds of
+ *         Arith40_index_of_chroma (see chroma40.h);
+ *       - when decompressing, a / 63 and b, c, d / 50 are formed in Q16
+ *         rounded to nearest, the inverse DCT is exact, and each channel is
+ *         clamped to [0, 1] and scaled to [0, 255] truncating, as the float
+ *         path truncates.
+ *
+ *     Error bound: the Q16 values never differ from the float path's by
+ *     more than 2^-13, so a compressed field only differs when the float
+ *     value lies within that distance of a rounding boundary, and then by
+ *     one step: a, b, c and d by at most 1, and a chroma index by at most
+ *     one position. Decompressing the same word, every output sample is
+ *     within 1 of the float path's.
+ *
+ *****************************************************************************/
+
+#include <stdint.h>
+
+#include "pnm.h"
+
+#ifndef FIXEDROW_H
+#define FIXEDROW_H
+
+extern void compress_row_fixed    (const struct Pnm_rgb *top,
+                                   const struct Pnm_rgb *bottom,
+                                   unsigned width, unsigned denominator,
+                                   uint32_t *words);
+extern void compress_row_raw_fixed(const unsigned char *top,
+                                   const unsigned char *bottom,
+                                   unsigned width, unsigned denominator,
+                                   uint32_t *words);
+
+extern void decompress_row_fixed   (const uint32_t *words, unsigned width,
+                                    unsigned char *top, unsigned char *bottom);
+extern void decompress_row_be_fixed(const unsigned char *bytes,
+                                    unsigned width, unsigned char *top,
+                                    unsigned char *bottom);
+
+#endif
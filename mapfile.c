@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ *                                mapfile.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the mapfile.h interface with mmap. Only regular, non-empty
+ *     files can be mapped; for anything else (pipes, terminals, devices, or
+ *     a failed mmap) Mapfile_open returns NULL and the caller is expected to
+ *     fall back to reading the file with stdio. Mappings are advised as
+ *     sequential, since both codecs read their input front to back exactly
+ *     once, which lets the kernel read ahead aggressively and drop pages
+ *     behind the reader.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "mapfile.h"
+
+#define T Mapfile_T
+
+struct T {
+    void *data;
+    size_t size;
+};
+
+/*
+ *  Function:  Mapfile_open
+ *  Arguments: const char *path - path of the file to map
+ *  Does:      Maps the whole file read-only into memory. The descriptor is
+ *             closed right away; the mapping stays valid until
+ *             Mapfile_close.
+ *  Return:    Mapfile_T - the mapped file, or NULL if the file cannot be
+ *             opened or is not a regular, non-empty file that mmap accepts
+ */
+T Mapfile_open(const char *path)
+{
+    assert(path != NULL);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+        info.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = info.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+    T file;
+    NEW(file);
+    file->data = data;
+    file->size = size;
+    return file;
+}
+
+/*
+ *  Function:  Mapfile_close
+ *  Arguments: Mapfile_T *file - pointer to the mapped file to be closed
+ *  Does:      Unmaps the file, frees it and sets *file to NULL.
+ *  Return:    void
+ */
+void Mapfile_close(T *file)
+{
+    assert(file != NULL && *file != NULL);
+    munmap((*file)->data, (*file)->size);
+    FREE(*file);
+}
+
+const unsigned char *Mapfile_data(T file)
+{
+    assert(file != NULL);
+    return file->data;
+}
+
+size_t Mapfile_size(T file)
+{
+    assert(file != NULL);
+    return file->size;
+}
@@ -0,0 +1,32 @@
+/******************************************************************************
+ *
+ *                                mapfile.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for mapping a whole input file read-only into memory, so
+ *     that it can be decoded in place instead of being copied through stdio
+ *     buffers. (See the implementation file mapfile.c for more information)
+ *
+ *     It is a checked run-time error to pass a NULL Mapfile_T or path to any
+ *     function in this interface.
+ *
+ *****************************************************************************/
+
+#include <stddef.h>
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#define T Mapfile_T
+typedef struct T *T;
+
+extern T                    Mapfile_open (const char *path);
+extern void                 Mapfile_close(T *file);
+extern const unsigned char *Mapfile_data (T file);
+extern size_t               Mapfile_size (T file);
+
+#undef T
+#endif
@@ -0,0 +1,245 @@
+/******************************************************************************
+ *
+ *                               pipeline40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the pipeline40.h interface. Every slot of the ring holds
+ *     an input and an output buffer and records which stage its chunk is
+ *     waiting for. Each stage visits the slots in turn, chunk n in slot
+ *     n % slots: it waits until the slot is waiting for it, does its work
+ *     without holding any lock, then hands the slot on to the next stage
+ *     (the writer hands it back to the reader) and signals that stage.
+ *     Each stage has its own condition variable, and only one thread ever
+ *     waits on it. The chunks are large, so the one mutex they share is
+ *     taken twice per chunk per stage and never contended for long.
+ *
+ *     A stage that fails lowers the pipeline's limit to the chunk it
+ *     failed on and wakes every stage; a stage stops at the first chunk at
+ *     or beyond the limit instead of waiting for it, so no thread waits
+ *     for a chunk that will never come.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "pipeline40.h"
+
+struct Slot {
+    void *in, *out;
+    unsigned stage; /* the stage the slot's chunk waits for */
+};
+
+struct Pipeline {
+    unsigned chunks, nslots;
+    unsigned limit; /* chunks allowed through: chunks, or the first chunk
+                       a stage failed on */
+    struct Slot *slots;
+    Pipeline40_stage *work[PIPELINE40_STAGES];
+    void *cl;
+    pthread_mutex_t lock;
+    pthread_cond_t ready[PIPELINE40_STAGES]; /* signaled when a slot is
+                                                handed to the stage */
+    double busy[PIPELINE40_STAGES], waiting[PIPELINE40_STAGES];
+};
+
+/* The argument of a stage's thread */
+struct Stage {
+    struct Pipeline *pipeline;
+    unsigned stage;
+};
+
+/* Names of the stages, for Pipeline40_report */
+static const char *const stage_names[PIPELINE40_STAGES] = {
+    "read", "compute", "write"
+};
+
+/* Static function declarations */
+static double now(void);
+static void *run_stage(void *vstage);
+
+/*
+ *  Function:  now
+ *  Arguments: none
+ *  Does:      Reads the monotonic clock.
+ *  Return:    double - the time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ *  Function:  run_stage
+ *  Arguments: void *vstage - the struct Stage to run
+ *  Does:      Runs one stage over every chunk, in order, timing its work
+ *             and its waits. The body of the reader and writer threads,
+ *             and run on the calling thread for the compute stage.
+ *  Return:    void * - always NULL
+ */
+static void *run_stage(void *vstage)
+{
+    struct Stage *stage = vstage;
+    struct Pipeline *pipeline = stage->pipeline;
+    unsigned s = stage->stage;
+    unsigned next = (s + 1) % PIPELINE40_STAGES;
+
+    for (unsigned chunk = 0; chunk < pipeline->chunks; chunk++) {
+        struct Slot *slot = &pipeline->slots[chunk % pipeline->nslots];
+        double start = now();
+        pthread_mutex_lock(&pipeline->lock);
+        while (slot->stage != s && chunk < pipeline->limit) {
+            pthread_cond_wait(&pipeline->ready[s], &pipeline->lock);
+        }
+        bool stopped = chunk >= pipeline->limit;
+        pthread_mutex_unlock(&pipeline->lock);
+        double started = now();
+        pipeline->waiting[s] += started - start;
+        if (stopped) {
+            break;
+        }
+
+        bool ok = pipeline->work[s](pipeline->cl, chunk, slot->in,
+                                    slot->out);
+        double finished = now();
+        pipeline->busy[s] += finished - started;
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (ok) {
+            slot->stage = next;
+            pthread_cond_signal(&pipeline->ready[next]);
+        } else {
+            if (chunk < pipeline->limit) {
+                pipeline->limit = chunk;
+            }
+            for (unsigned t = 0; t < PIPELINE40_STAGES; t++) {
+                pthread_cond_signal(&pipeline->ready[t]);
+            }
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+        if (!ok) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ *  Function:  Pipeline40_run
+ *  Arguments: unsigned chunks - the number of chunks to pass through
+ *             unsigned slots - the length of the ring, at least 1; more
+ *                              slots than chunks are never allocated
+ *             size_t in_bytes, out_bytes - the sizes of each slot's input
+ *                                          and output buffers, not 0
+ *             Pipeline40_stage *read, *compute, *write - the stages
+ *             void *cl - the closure passed to every stage
+ *             Pipeline40_stats *stats - if not NULL, this run's times are
+ *                                       added to it
+ *  Does:      Runs read on a new thread, compute on the calling thread and
+ *             write on another new thread, each over chunks 0 to chunks - 1
+ *             in order, and returns once every chunk has been written, or
+ *             once every stage has stopped after one of them failed.
+ *  Return:    bool - true if every chunk went through every stage
+ */
+bool Pipeline40_run(unsigned chunks, unsigned slots, size_t in_bytes,
+                    size_t out_bytes, Pipeline40_stage *read,
+                    Pipeline40_stage *compute, Pipeline40_stage *write,
+                    void *cl, Pipeline40_stats *stats)
+{
+    assert(slots > 0 && in_bytes > 0 && out_bytes > 0);
+    assert(read != NULL && compute != NULL && write != NULL);
+    double start = now();
+    struct Pipeline pipeline = { .chunks = chunks, .limit = chunks,
+                                 .cl = cl,
+                                 .work = { read, compute, write } };
+    pipeline.nslots = slots > chunks ? chunks : slots;
+    if (chunks > 0) {
+        pipeline.slots = CALLOC(pipeline.nslots, sizeof(struct Slot));
+        for (unsigned i = 0; i < pipeline.nslots; i++) {
+            pipeline.slots[i].in = ALLOC(in_bytes);
+            pipeline.slots[i].out = ALLOC(out_bytes);
+            pipeline.slots[i].stage = PIPELINE40_READ;
+        }
+        pthread_mutex_init(&pipeline.lock, NULL);
+        struct Stage stages[PIPELINE40_STAGES];
+        pthread_t threads[PIPELINE40_STAGES];
+        for (unsigned s = 0; s < PIPELINE40_STAGES; s++) {
+            pthread_cond_init(&pipeline.ready[s], NULL);
+            stages[s] = (struct Stage){ &pipeline, s };
+        }
+        for (unsigned s = 0; s < PIPELINE40_STAGES; s++) {
+            if (s != PIPELINE40_COMPUTE) {
+                int err = pthread_create(&threads[s], NULL, run_stage,
+                                         &stages[s]);
+                assert(err == 0);
+            }
+        }
+        run_stage(&stages[PIPELINE40_COMPUTE]);
+        for (unsigned s = 0; s < PIPELINE40_STAGES; s++) {
+            if (s != PIPELINE40_COMPUTE) {
+                pthread_join(threads[s], NULL);
+            }
+            pthread_cond_destroy(&pipeline.ready[s]);
+        }
+        pthread_mutex_destroy(&pipeline.lock);
+        for (unsigned i = 0; i < pipeline.nslots; i++) {
+            FREE(pipeline.slots[i].in);
+            FREE(pipeline.slots[i].out);
+        }
+        FREE(pipeline.slots);
+    }
+
+    if (stats != NULL) {
+        stats->runs++;
+        stats->chunks += pipeline.limit;
+        stats->seconds += now() - start;
+        for (unsigned s = 0; s < PIPELINE40_STAGES; s++) {
+            stats->busy[s] += pipeline.busy[s];
+            stats->waiting[s] += pipeline.waiting[s];
+        }
+    }
+    return pipeline.limit == chunks;
+}
+
+/*
+ *  Function:  Pipeline40_report
+ *  Arguments: const Pipeline40_stats *stats - the times to report
+ *             FILE *output - the stream to write the report to
+ *  Does:      Writes the share of the wall-clock time each stage spent
+ *             working and waiting, and names the stage that worked
+ *             longest: the bottleneck, which the others wait for. Writes
+ *             nothing if no chunk has been through the pipeline.
+ *  Return:    void
+ */
+void Pipeline40_report(const Pipeline40_stats *stats, FILE *output)
+{
+    assert(stats != NULL && output != NULL);
+    if (stats->chunks == 0) {
+        return;
+    }
+    double seconds = stats->seconds > 0 ? stats->seconds : 1;
+    unsigned slowest = 0;
+    fprintf(output, "pipeline: %" PRIu64 " chunks in %.3f s\n",
+            stats->chunks, stats->seconds);
+    for (unsigned s = 0; s < PIPELINE40_STAGES; s++) {
+        fprintf(output, "  %-8s %5.1f%% busy, %5.1f%% waiting\n",
+                stage_names[s], 100 * stats->busy[s] / seconds,
+                100 * stats->waiting[s] / seconds);
+        if (stats->busy[s] > stats->busy[slowest]) {
+            slowest = s;
+        }
+    }
+    fprintf(output, "  bottleneck: %s\n", stage_names[slowest]);
+}
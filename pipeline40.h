@@ -0,0 +1,66 @@
+/******************************************************************************
+ *
+ *                               pipeline40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for running work in three overlapped stages: a reader
+ *     thread fills chunks of input, the calling thread computes each chunk
+ *     of output from its input, and a writer thread writes the output
+ *     chunks, in order. The stages are connected by a bounded ring of
+ *     chunk slots, so the reader runs at most a ring's length ahead of the
+ *     writer and memory use does not depend on the number of chunks. The
+ *     codec pipelines its streaming paths through it (Codec40_opts
+ *     pipelined, 40image -p).
+ *
+ *     Pipeline40_stats records how long each stage worked and waited, so
+ *     that the slowest stage, which sets the pace of the others, can be
+ *     found; Pipeline40_report prints them. A stage that fails (on bad
+ *     input, say) returns false rather than ending the process while the
+ *     other stages run: the chunks before the failed one still go through
+ *     every stage, no stage starts a later chunk, and Pipeline40_run
+ *     reports the failure once all three stages have stopped, so that the
+ *     caller can handle it on its own thread.
+ *     (See the implementation file pipeline40.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef PIPELINE40_H
+#define PIPELINE40_H
+
+/* The stages, in order, as indices of Pipeline40_stats' arrays */
+enum { PIPELINE40_READ, PIPELINE40_COMPUTE, PIPELINE40_WRITE,
+       PIPELINE40_STAGES };
+
+typedef struct Pipeline40_stats {
+    uint64_t runs;    /* pipelines run */
+    uint64_t chunks;  /* chunks passed through all three stages */
+    double seconds;   /* wall-clock time of the runs */
+    double busy[PIPELINE40_STAGES];    /* time each stage spent working */
+    double waiting[PIPELINE40_STAGES]; /* time each stage spent waiting for
+                                          the stage before it, or for a
+                                          free slot */
+} Pipeline40_stats;
+
+/* One stage's work on chunk number chunk: read fills in, compute turns in
+   into out, and write writes out. in and out are the slot's buffers, of
+   the sizes given to Pipeline40_run. Returns false if the stage failed,
+   which stops the pipeline at that chunk */
+typedef bool Pipeline40_stage(void *cl, unsigned chunk, void *in, void *out);
+
+extern bool Pipeline40_run   (unsigned chunks, unsigned slots,
+                              size_t in_bytes, size_t out_bytes,
+                              Pipeline40_stage *read,
+                              Pipeline40_stage *compute,
+                              Pipeline40_stage *write, void *cl,
+                              Pipeline40_stats *stats);
+extern void Pipeline40_report(const Pipeline40_stats *stats, FILE *output);
+
+#endif
@@ -0,0 +1,452 @@
+/******************************************************************************
+ *
+ *                               ppmreader.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the ppmreader.h interface. Ppmreader_new parses the PPM
+ *     header (magic number, width, height and maxval, with '#' comments
+ *     allowed between them), after which each call to Ppmreader_read_row
+ *     decodes the next scanline into an array of Pnm_rgb structs. Both the
+ *     binary (P6) and plain (P3) formats are supported; binary samples are
+ *     one byte wide when the maxval is below 256, and two big endian bytes
+ *     wide otherwise. A reader holds one scanline of raw bytes at most, so
+ *     memory use is proportional to the width of the image only.
+ *
+ *     Samples above the maxval are accepted, as Pnm_ppmread accepts them,
+ *     so that every compression path takes the same files; the kernels
+ *     compress such samples the same way whichever reader supplied them.
+ *
+ *     Ppmreader_raster parses a binary PPM that is already in memory (such
+ *     as a mapped file) without copying it, so that its raster can be
+ *     compressed in place.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+
+#include "ppmreader.h"
+
+#define T Ppmreader_T
+
+/* Largest maxval a PPM file may have */
+#define MAX_DENOMINATOR 65535
+
+struct T {
+    FILE *input;
+    bool plain;             /* P3 rather than P6 */
+    unsigned width, height;
+    unsigned denominator;
+    unsigned sample_bytes;  /* bytes per binary sample, 1 or 2 */
+    unsigned rows_read;     /* scanlines read so far */
+    unsigned char *raw;     /* one binary scanline */
+};
+
+/* Static function declarations */
+static bool read_number(FILE *input, unsigned *number);
+static unsigned read_header_number(FILE *input);
+static inline unsigned raw_sample(const unsigned char *raw, unsigned bytes);
+static bool read_row(T reader, struct Pnm_rgb *row);
+static bool parse_number(const unsigned char *data, size_t size, size_t *pos,
+                         unsigned *number);
+static bool parse_header(const unsigned char *data, size_t size,
+                         const char *magic, size_t *pos, unsigned *width,
+                         unsigned *height, unsigned *denominator);
+
+/*
+ *  Function:  read_number
+ *  Arguments: FILE *input - the PPM file being read
+ *             unsigned *number - filled in with the number read
+ *  Does:      Skips whitespace and comments, then reads an unsigned decimal
+ *             number.
+ *  Return:    bool - false if there is no number, or it does not fit in 32
+ *             bits
+ */
+static bool read_number(FILE *input, unsigned *number)
+{
+    int c = getc(input);
+    while (isspace(c) || c == '#') {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = getc(input);
+            }
+        }
+        c = getc(input);
+    }
+    if (!isdigit(c)) {
+        return false;
+    }
+
+    unsigned long value = 0;
+    while (isdigit(c)) {
+        value = value * 10 + (c - '0');
+        if (value > 0xffffffffUL) {
+            return false;
+        }
+        c = getc(input);
+    }
+    ungetc(c, input);
+    *number = value;
+    return true;
+}
+
+/*
+ *  Function:  read_header_number
+ *  Arguments: FILE *input - the PPM file being read
+ *  Does:      Reads one number of the header, raising Pnm_Badformat if
+ *             there is none.
+ *  Return:    unsigned - the number read
+ */
+static unsigned read_header_number(FILE *input)
+{
+    unsigned number;
+    if (!read_number(input, &number)) {
+        RAISE(Pnm_Badformat);
+    }
+    return number;
+}
+
+/*
+ *  Function:  raw_sample
+ *  Arguments: const unsigned char *raw - the first byte of a binary sample
+ *             unsigned bytes - the width of a sample, 1 or 2 bytes
+ *  Does:      Decodes one binary sample, which is big endian if it is two
+ *             bytes wide.
+ *  Return:    unsigned - the sample
+ */
+static inline unsigned raw_sample(const unsigned char *raw, unsigned bytes)
+{
+    return bytes == 1 ? raw[0] : (unsigned)raw[0] << 8 | raw[1];
+}
+
+/*
+ *  Function:  Ppmreader_new
+ *  Arguments: FILE *input - a non-null pointer to an opened PPM file
+ *  Does:      Reads the header of a PPM file, leaving input positioned at
+ *             the first sample of the raster. The reader must be freed with
+ *             Ppmreader_free; it does not close input.
+ *  Return:    Ppmreader_T - a reader for the scanlines of the image
+ */
+T Ppmreader_new(FILE *input)
+{
+    assert(input != NULL);
+    if (getc(input) != 'P') {
+        RAISE(Pnm_Badformat);
+    }
+    int format = getc(input);
+    if (format != '6' && format != '3') {
+        RAISE(Pnm_Badformat);
+    }
+
+    T reader;
+    NEW(reader);
+    reader->input = input;
+    reader->plain = format == '3';
+    reader->width = read_header_number(input);
+    reader->height = read_header_number(input);
+    reader->denominator = read_header_number(input);
+    if (reader->denominator == 0 || reader->denominator > MAX_DENOMINATOR) {
+        FREE(reader);
+        RAISE(Pnm_Badformat);
+    }
+    reader->sample_bytes = reader->denominator > 255 ? 2 : 1;
+    reader->rows_read = 0;
+    reader->raw = NULL;
+
+    /* exactly one whitespace character separates the header from a binary
+       raster */
+    if (!isspace(getc(input))) {
+        FREE(reader);
+        RAISE(Pnm_Badformat);
+    }
+    if (!reader->plain && reader->width > 0) {
+        reader->raw = ALLOC((long)reader->width * 3 * reader->sample_bytes);
+    }
+    return reader;
+}
+
+/*
+ *  Function:  Ppmreader_free
+ *  Arguments: Ppmreader_T *reader - pointer to the reader to be freed
+ *  Does:      Frees the reader and sets *reader to NULL. Does not close the
+ *             input file.
+ *  Return:    void
+ */
+void Ppmreader_free(T *reader)
+{
+    assert(reader != NULL && *reader != NULL);
+    FREE((*reader)->raw);
+    FREE(*reader);
+}
+
+unsigned Ppmreader_width(T reader)
+{
+    assert(reader != NULL);
+    return reader->width;
+}
+
+unsigned Ppmreader_height(T reader)
+{
+    assert(reader != NULL);
+    return reader->height;
+}
+
+unsigned Ppmreader_denominator(T reader)
+{
+    assert(reader != NULL);
+    return reader->denominator;
+}
+
+/*
+ *  Function:  read_row
+ *  Arguments: Ppmreader_T reader - the reader to read from
+ *             struct Pnm_rgb *row - an array of at least width pixels to be
+ *                                   filled with the next scanline, or NULL
+ *                                   to check the scanline and discard it
+ *  Does:      Reads and decodes the next scanline of the image.
+ *  Return:    bool - false if the file ends early or is badly formatted
+ */
+static bool read_row(T reader, struct Pnm_rgb *row)
+{
+    unsigned width = reader->width;
+    if (reader->plain) {
+        for (unsigned col = 0; col < width; col++) {
+            unsigned samples[3];
+            for (int i = 0; i < 3; i++) {
+                if (!read_number(reader->input, &samples[i])) {
+                    return false;
+                }
+            }
+            if (row != NULL) {
+                row[col] = (struct Pnm_rgb){ samples[0], samples[1],
+                                             samples[2] };
+            }
+        }
+        reader->rows_read++;
+        return true;
+    }
+
+    unsigned step = reader->sample_bytes;
+    size_t bytes = (size_t)width * 3 * step;
+    if (fread(reader->raw, 1, bytes, reader->input) != bytes) {
+        return false;
+    }
+    reader->rows_read++;
+    if (row == NULL) {
+        return true;
+    }
+    const unsigned char *raw = reader->raw;
+    for (unsigned col = 0; col < width; col++) {
+        row[col].red = raw_sample(raw, step);
+        row[col].green = raw_sample(raw + step, step);
+        row[col].blue = raw_sample(raw + 2 * step, step);
+        raw += 3 * step;
+    }
+    return true;
+}
+
+/*
+ *  Function:  Ppmreader_read_row / Ppmreader_try_read_row
+ *  Arguments: Ppmreader_T reader - the reader to read from
+ *             struct Pnm_rgb *row - an array of at least width pixels to be
+ *                                   filled with the next scanline
+ *  Does:      Reads and decodes the next scanline of the image. If the
+ *             file ends early or is badly formatted, Ppmreader_read_row
+ *             raises Pnm_Badformat, and Ppmreader_try_read_row returns
+ *             false, for threads that must not raise.
+ *  Return:    void / bool - true if the scanline was read
+ */
+void Ppmreader_read_row(T reader, struct Pnm_rgb *row)
+{
+    assert(reader != NULL && row != NULL);
+    if (!read_row(reader, row)) {
+        RAISE(Pnm_Badformat);
+    }
+}
+
+bool Ppmreader_try_read_row(T reader, struct Pnm_rgb *row)
+{
+    assert(reader != NULL && row != NULL);
+    return read_row(reader, row);
+}
+
+/*
+ *  Function:  Ppmreader_finish
+ *  Arguments: Ppmreader_T reader - the reader to finish
+ *  Does:      Reads and checks every scanline not yet read, such as the odd
+ *             last one that has no pair to be compressed with, so that a
+ *             file is checked in full, as Pnm_ppmread checks it, whichever
+ *             of its scanlines the caller uses. Raises Pnm_Badformat if the
+ *             file ends early or is badly formatted.
+ *  Return:    void
+ */
+void Ppmreader_finish(T reader)
+{
+    assert(reader != NULL);
+    while (reader->rows_read < reader->height) {
+        if (!read_row(reader, NULL)) {
+            RAISE(Pnm_Badformat);
+        }
+    }
+}
+
+/*
+ *  Function:  parse_number
+ *  Arguments: const unsigned char *data - a PPM file held in memory
+ *             size_t size - the number of bytes in data
+ *             size_t *pos - position of the next unparsed byte; advanced
+ *                           past the number
+ *             unsigned *number - filled in with the number parsed
+ *  Does:      In-memory version of read_number: skips whitespace and
+ *             comments, then parses an unsigned decimal number.
+ *  Return:    bool - false if there is no number, or it does not fit in 32
+ *             bits
+ */
+static bool parse_number(const unsigned char *data, size_t size, size_t *pos,
+                         unsigned *number)
+{
+    size_t i = *pos;
+    while (i < size && (isspace(data[i]) || data[i] == '#')) {
+        if (data[i] == '#') {
+            while (i < size && data[i] != '\n') {
+                i++;
+            }
+        }
+        if (i < size) {
+            i++;
+        }
+    }
+    if (i == size || !isdigit(data[i])) {
+        return false;
+    }
+
+    unsigned long value = 0;
+    while (i < size && isdigit(data[i])) {
+        value = value * 10 + (data[i] - '0');
+        if (value > 0xffffffffUL) {
+            return false;
+        }
+        i++;
+    }
+    *pos = i;
+    *number = value;
+    return true;
+}
+
+/*
+ *  Function:  parse_header
+ *  Arguments: const unsigned char *data - a whole PPM file held in memory
+ *             size_t size - the number of bytes in data
+ *             const char *magic - the magic number wanted, "P6" or "P3"
+ *             size_t *pos - set to the position of the first sample
+ *             unsigned *width, *height, *denominator - filled in from the
+ *                                                     header
+ *  Does:      In-memory version of the header parsing of Ppmreader_new,
+ *             accepting exactly the same headers.
+ *  Return:    bool - false if the header is not a valid one
+ */
+static bool parse_header(const unsigned char *data, size_t size,
+                         const char *magic, size_t *pos, unsigned *width,
+                         unsigned *height, unsigned *denominator)
+{
+    *pos = 2;
+    if (size < *pos || memcmp(data, magic, 2) != 0 ||
+        !parse_number(data, size, pos, width) ||
+        !parse_number(data, size, pos, height) ||
+        !parse_number(data, size, pos, denominator)) {
+        return false;
+    }
+    if (*denominator == 0 || *denominator > MAX_DENOMINATOR ||
+        *pos == size || !isspace(data[*pos])) {
+        return false;
+    }
+    (*pos)++;
+    return true;
+}
+
+/*
+ *  Function:  Ppmreader_raster
+ *  Arguments: const unsigned char *data - a whole PPM file held in memory
+ *             size_t size - the number of bytes in data
+ *             unsigned *width, *height, *denominator - filled in from the
+ *                                                     header
+ *             const unsigned char **raster - set to the first byte of the
+ *                                            raster within data
+ *  Does:      Parses the header of a binary (P6) PPM in memory, accepting
+ *             exactly the headers that Ppmreader_new does, and checks that
+ *             the whole raster is present. Nothing is raised; callers fall
+ *             back to a stdio reader, which reports the error, for anything
+ *             this function rejects.
+ *  Return:    bool - true if data holds a complete, valid binary PPM
+ */
+bool Ppmreader_raster(const unsigned char *data, size_t size,
+                      unsigned *width, unsigned *height,
+                      unsigned *denominator, const unsigned char **raster)
+{
+    assert(data != NULL && width != NULL && height != NULL);
+    assert(denominator != NULL && raster != NULL);
+    size_t pos;
+    if (!parse_header(data, size, "P6", &pos, width, height, denominator)) {
+        return false;
+    }
+
+    /* a raster too large to address cannot be in memory; checked by
+       division, as the products could wrap */
+    unsigned sample_bytes = *denominator > 255 ? 2 : 1;
+    if (*height != 0 && *width > SIZE_MAX / 3 / sample_bytes / *height) {
+        return false;
+    }
+    size_t samples = (size_t)*width * *height * 3;
+    size_t bytes = samples * sample_bytes;
+    if (size - pos < bytes) {
+        return false;
+    }
+    *raster = &data[pos];
+    return true;
+}
+
+/*
+ *  Function:  Ppmreader_valid
+ *  Arguments: const unsigned char *data - a whole PPM file held in memory
+ *             size_t size - the number of bytes in data
+ *  Does:      Checks a binary or plain PPM in memory without raising, for
+ *             callers that must know beforehand whether reading it with
+ *             Ppmreader_new or Pnm_ppmread would raise Pnm_Badformat: a
+ *             binary one as Ppmreader_raster does, and a plain one by
+ *             parsing every sample.
+ *  Return:    bool - true if data holds a complete, valid PPM
+ */
+bool Ppmreader_valid(const unsigned char *data, size_t size)
+{
+    assert(data != NULL);
+    unsigned width, height, denominator;
+    const unsigned char *raster;
+    if (Ppmreader_raster(data, size, &width, &height, &denominator,
+                         &raster)) {
+        return true;
+    }
+    size_t pos;
+    if (!parse_header(data, size, "P3", &pos, &width, &height,
+                      &denominator)) {
+        return false;
+    }
+    size_t samples = (size_t)width * height * 3;
+    for (size_t i = 0; i < samples; i++) {
+        unsigned sample;
+        if (!parse_number(data, size, &pos, &sample)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+/******************************************************************************
+ *
+ *                               ppmreader.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for reading a PPM image one scanline at a time, so that an
+ *     image can be processed without ever being held in memory as a whole.
+ *     (See the implementation file ppmreader.c for more information)
+ *
+ *     Badly formatted or truncated input raises Pnm_Badformat, as
+ *     Pnm_ppmread does; Ppmreader_try_read_row, Ppmreader_raster and
+ *     Ppmreader_valid report it by returning false instead. Samples above the maxval are
+ *     accepted, as Pnm_ppmread accepts them. A caller that stops before
+ *     the last scanline calls Ppmreader_finish to check the rest. It is a
+ *     checked run-time error to pass a NULL Ppmreader_T to any function
+ *     in this interface.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "pnm.h"
+
+#ifndef PPMREADER_H
+#define PPMREADER_H
+
+#define T Ppmreader_T
+typedef struct T *T;
+
+extern T        Ppmreader_new         (FILE *input);
+extern void     Ppmreader_free        (T *reader);
+extern unsigned Ppmreader_width       (T reader);
+extern unsigned Ppmreader_height      (T reader);
+extern unsigned Ppmreader_denominator (T reader);
+extern void     Ppmreader_read_row    (T reader, struct Pnm_rgb *row);
+extern bool     Ppmreader_try_read_row(T reader, struct Pnm_rgb *row);
+extern void     Ppmreader_finish      (T reader);
+
+extern bool Ppmreader_raster(const unsigned char *data, size_t size,
+                             unsigned *width, unsigned *height,
+                             unsigned *denominator,
+                             const unsigned char **raster);
+extern bool Ppmreader_valid (const unsigned char *data, size_t size);
+
+#undef T
+#endif
@@ -0,0 +1,262 @@
+/******************************************************************************
+ *
+ *                                region40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the region40.h interface. A region is a list of chunks
+ *     taken from the heap with mem.h; allocations are carved from the
+ *     newest chunk by bumping a pointer, and a chunk is added when the
+ *     newest one cannot hold the next allocation. Region40_reset keeps a
+ *     single chunk: if the region spilled into several, they are replaced
+ *     by one large enough for everything allocated since the last reset,
+ *     so the same sequence of allocations afterwards takes nothing more
+ *     from the heap.
+ *
+ *     Each thread's region from Region40_thread is kept under a pthread
+ *     key and freed when the thread exits.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "region40.h"
+
+#define T Region40_T
+
+/* Usable bytes of a chunk when Region40_new is given 0 */
+#define DEFAULT_CHUNK (64 * 1024)
+
+/* A block from the heap; its usable bytes follow the header, which is
+   padded to REGION40_ALIGN */
+struct Chunk {
+    struct Chunk *next;
+    size_t size; /* usable bytes */
+};
+
+#define HEADER ((sizeof(struct Chunk) + REGION40_ALIGN - 1) \
+                / REGION40_ALIGN * REGION40_ALIGN)
+
+struct T {
+    struct Chunk *chunks; /* newest first; allocations come from it */
+    char *avail, *limit;  /* the free bytes of the newest chunk */
+    size_t chunk;         /* least usable size of a new chunk */
+    size_t used;          /* bytes allocated since the last reset */
+    Region40_stats stats;
+};
+
+/* Key of each thread's region, made once */
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+/* Static function declarations */
+static size_t round_up(size_t nbytes);
+static void add_chunk(T region, size_t size);
+static void free_chunks(T region);
+static void make_thread_key(void);
+static void free_thread_region(void *region);
+
+/*
+ *  Function:  round_up
+ *  Arguments: size_t nbytes - a size in bytes
+ *  Does:      Rounds a size up to a multiple of REGION40_ALIGN.
+ *  Return:    size_t - the rounded size
+ */
+static size_t round_up(size_t nbytes)
+{
+    assert(nbytes <= SIZE_MAX - (REGION40_ALIGN - 1));
+    return (nbytes + REGION40_ALIGN - 1) / REGION40_ALIGN * REGION40_ALIGN;
+}
+
+/*
+ *  Function:  Region40_new
+ *  Arguments: size_t chunk - the least number of bytes to take from the
+ *                            heap at a time, or 0 for a default of 64KB
+ *  Does:      Creates an empty region; nothing is taken from the heap for
+ *             its allocations until the first of them.
+ *  Return:    Region40_T - the new region, freed with Region40_free
+ */
+T Region40_new(size_t chunk)
+{
+    T region;
+    NEW(region);
+    region->chunks = NULL;
+    region->avail = region->limit = NULL;
+    region->chunk = round_up(chunk == 0 ? DEFAULT_CHUNK : chunk);
+    region->used = 0;
+    region->stats = (Region40_stats){ 0, 0, 0, 0, 0 };
+    return region;
+}
+
+/*
+ *  Function:  add_chunk
+ *  Arguments: Region40_T region - the region
+ *             size_t size - the usable bytes needed, a multiple of
+ *                           REGION40_ALIGN
+ *  Does:      Takes a chunk of at least size usable bytes (and at least the
+ *             region's chunk size) from the heap, and allocates from it
+ *             from now on. Whatever was left of the previous chunk is not
+ *             used until the next reset.
+ *  Return:    void
+ */
+static void add_chunk(T region, size_t size)
+{
+    size = size < region->chunk ? region->chunk : size;
+    assert(size <= (size_t)LONG_MAX - HEADER);
+    struct Chunk *chunk = ALLOC((long)(HEADER + size));
+    chunk->next = region->chunks;
+    chunk->size = size;
+    region->chunks = chunk;
+    region->avail = (char *)chunk + HEADER;
+    region->limit = region->avail + size;
+    region->stats.chunks++;
+    region->stats.bytes += HEADER + size;
+}
+
+/*
+ *  Function:  free_chunks
+ *  Arguments: Region40_T region - the region
+ *  Does:      Returns every chunk of the region to the heap.
+ *  Return:    void
+ */
+static void free_chunks(T region)
+{
+    while (region->chunks != NULL) {
+        struct Chunk *next = region->chunks->next;
+        FREE(region->chunks);
+        region->chunks = next;
+    }
+    region->avail = region->limit = NULL;
+    region->stats.bytes = 0;
+}
+
+/*
+ *  Function:  Region40_free
+ *  Arguments: Region40_T *region - pointer to the region to free
+ *  Does:      Frees a region and everything allocated from it, and sets
+ *             *region to NULL.
+ *  Return:    void
+ */
+void Region40_free(T *region)
+{
+    assert(region != NULL && *region != NULL);
+    free_chunks(*region);
+    FREE(*region);
+}
+
+/*
+ *  Function:  Region40_alloc
+ *  Arguments: Region40_T region - the region
+ *             size_t nbytes - the number of bytes wanted, possibly 0
+ *  Does:      Allocates uninitialized bytes from the region, aligned to
+ *             REGION40_ALIGN. They stay valid until the region is reset or
+ *             freed.
+ *  Return:    void * - the bytes; never NULL
+ */
+void *Region40_alloc(T region, size_t nbytes)
+{
+    assert(region != NULL);
+    size_t size = round_up(nbytes);
+    if (region->chunks == NULL ||
+        (size_t)(region->limit - region->avail) < size) {
+        add_chunk(region, size);
+    }
+    void *ptr = region->avail;
+    region->avail += size;
+    region->used += size;
+    if (region->used > region->stats.peak) {
+        region->stats.peak = region->used;
+    }
+    region->stats.allocations++;
+    return ptr;
+}
+
+/*
+ *  Function:  Region40_reset
+ *  Arguments: Region40_T region - the region
+ *  Does:      Releases everything allocated from the region at once,
+ *             keeping one chunk, large enough for all of it, to allocate
+ *             from again.
+ *  Return:    void
+ */
+void Region40_reset(T region)
+{
+    assert(region != NULL);
+    if (region->chunks != NULL && region->chunks->next != NULL) {
+        free_chunks(region);
+        add_chunk(region, region->used);
+    } else if (region->chunks != NULL) {
+        region->avail = (char *)region->chunks + HEADER;
+    }
+    region->used = 0;
+    region->stats.resets++;
+}
+
+/*
+ *  Function:  Region40_stats_get
+ *  Arguments: Region40_T region - the region
+ *  Does:      Collects the region's counts.
+ *  Return:    Region40_stats - the counts since the region was created
+ */
+Region40_stats Region40_stats_get(T region)
+{
+    assert(region != NULL);
+    return region->stats;
+}
+
+/*
+ *  Function:  make_thread_key
+ *  Arguments: none
+ *  Does:      Creates the key under which each thread keeps its region.
+ *  Return:    void
+ */
+static void make_thread_key(void)
+{
+    int err = pthread_key_create(&thread_key, free_thread_region);
+    assert(err == 0);
+}
+
+/*
+ *  Function:  free_thread_region
+ *  Arguments: void *region - the Region40_T of a thread that is exiting
+ *  Does:      Frees the region; the destructor of the thread key.
+ *  Return:    void
+ */
+static void free_thread_region(void *region)
+{
+    T doomed = region;
+    Region40_free(&doomed);
+}
+
+/*
+ *  Function:  Region40_thread
+ *  Arguments: none
+ *  Does:      Finds the calling thread's own region, creating it with the
+ *             default chunk size on the thread's first call. The region is
+ *             freed when the thread exits (except for the main thread,
+ *             whose region lasts until the process ends); the thread
+ *             resets it whenever it likes, but must not free it.
+ *  Return:    Region40_T - the thread's region
+ */
+T Region40_thread(void)
+{
+    int err = pthread_once(&thread_once, make_thread_key);
+    assert(err == 0);
+    T region = pthread_getspecific(thread_key);
+    if (region == NULL) {
+        region = Region40_new(0);
+        err = pthread_setspecific(thread_key, region);
+        assert(err == 0);
+    }
+    return region;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+ *
+ *                                region40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for a region (arena) allocator: a bump allocator whose
+ *     allocations are never freed one by one but all at once, by
+ *     Region40_reset. Everything allocated for one image can come from one
+ *     region, which is reset before the next image, so a program coding
+ *     many images of similar size stops calling malloc and free once the
+ *     region has grown to fit the largest. UArray2_new_in and
+ *     UArray2b_new_in build arrays in a region, and Codec40_opts can name a
+ *     region for the codec's per-image buffers.
+ *
+ *     A region is not thread-safe. Region40_thread gives every thread a
+ *     region of its own, so threads allocating at once never contend for
+ *     the heap or for each other's regions. Allocation failures raise
+ *     Mem_Failed, as mem.h does. It is a checked run-time error to pass a
+ *     NULL Region40_T to any function in this interface.
+ *     (See the implementation file region40.c for more information)
+ *
+ *****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef REGION40_H
+#define REGION40_H
+
+/* Alignment of every allocation, enough for any type and for SIMD loads */
+#define REGION40_ALIGN 16
+
+#define T Region40_T
+typedef struct T *T;
+
+typedef struct Region40_stats {
+    uint64_t allocations; /* calls to Region40_alloc */
+    uint64_t chunks;      /* blocks taken from the heap, ever */
+    uint64_t resets;      /* calls to Region40_reset */
+    size_t bytes;         /* bytes of blocks held now */
+    size_t peak;          /* most bytes in use between two resets */
+} Region40_stats;
+
+extern T              Region40_new  (size_t chunk);
+extern void           Region40_free (T *region);
+extern void          *Region40_alloc(T region, size_t nbytes);
+extern void           Region40_reset(T region);
+extern Region40_stats Region40_stats_get(T region);
+extern T              Region40_thread(void);
+
+#undef T
+#endif
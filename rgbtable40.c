@@ -0,0 +1,292 @@
+/******************************************************************************
+ *
+ *                               rgbtable40.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the rgbtable40.h interface. Each entry is a uint32_t
+ *     holding a pixel's red, green and blue bytes and a flag saying whether
+ *     it is filled and usable. The entries of one (pb, pr) pair are
+ *     contiguous, indexed by q, so the four pixels of a word are found at
+ *     four multiples of 63 from one base. The whole table is one zeroed
+ *     allocation of about 9 MB, of which only the pages an image's pixels
+ *     reach are ever touched.
+ *
+ *     The floating-point decoder does not compute brightness from q itself
+ *     but as (((a / 63) -+ b / 50) -+ c / 50) +- d / 50 in float, whose
+ *     value may differ from q / 3150 by a few rounding errors, so two words
+ *     with the same q may have slightly different brightness. Bounding
+ *     those errors (each quotient is rounded once, each of the three sums
+ *     once, all below 2 in magnitude) gives less than 2^-21 in every case;
+ *     with Y_SLACK twice that, every brightness the decoder can produce for
+ *     q lies between q / 3150 - Y_SLACK and q / 3150 + Y_SLACK. The color
+ *     transform, trimming and truncation are all monotonic in brightness,
+ *     so if both ends of that interval give the same bytes, so does every
+ *     word with that q, and the entry is filled with them. Otherwise (for
+ *     a few entries in a thousand, whose interval straddles a step of a
+ *     channel) the entry is marked ambiguous, and words that need it are
+ *     decoded in floating point, as are words with a DCT coefficient
+ *     outside what the compressor produces. Either way the pixels are
+ *     exactly those of decompress_row.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "bitpack40.h"
+#include "chroma40.h"
+#include "compressinfo.h"
+#include "decompressrow.h"
+#include "rgbtable40.h"
+#include "wordio.h"
+
+#define T Rgbtable40_T
+
+/* Largest magnitude of b, c and d that the compressor produces (see
+   quantize_dct); words with larger ones are not looked up */
+#define MAX_DCT 15
+
+/* q = 50a + 63k, with a in [0, 63] and k = +-b +-c +-d in
+   [-3 * MAX_DCT, 3 * MAX_DCT], is offset by Q_OFFSET to index entries */
+#define Q_OFFSET (63 * 3 * MAX_DCT)
+#define Q_COUNT (50 * 63 + 2 * Q_OFFSET + 1)
+
+/* Number of (pb, pr) pairs */
+#define CHROMA_PAIRS (1 << (PB_WIDTH + PR_WIDTH))
+
+/* Flags of an entry; an entry of 0 has not been filled */
+#define ENTRY_VALID     (1u << 24)
+#define ENTRY_AMBIGUOUS (1u << 25)
+
+/* Half the width of the interval around q / 3150 holding every brightness
+   the floating-point decoder computes for q (see above) */
+#define Y_SLACK 0x1p-20
+
+struct T {
+    uint32_t *entries; /* CHROMA_PAIRS rows of Q_COUNT entries */
+    const float *chromas;
+    uint64_t filled;
+    uint64_t hits, misses, fallbacks;
+};
+
+/* Static function declarations */
+static uint32_t fill_entry(T table, unsigned pb, unsigned pr, int q);
+static inline void store_pixel(uint32_t entry, unsigned char *pixel);
+static void decode_word(T table, uint32_t word, unsigned char *top,
+                        unsigned char *bottom);
+static void decode_row(T table, const void *words, unsigned width,
+                       bool big_endian, unsigned char *top,
+                       unsigned char *bottom);
+
+/*
+ *  Function:  Rgbtable40_new
+ *  Arguments: none
+ *  Does:      Allocates an empty table.
+ *  Return:    Rgbtable40_T - the new table, freed with Rgbtable40_free
+ */
+T Rgbtable40_new(void)
+{
+    T table;
+    NEW(table);
+    table->entries = CALLOC(CHROMA_PAIRS * Q_COUNT, sizeof(uint32_t));
+    table->chromas = Chroma40_get()->chroma;
+    table->filled = 0;
+    table->hits = table->misses = table->fallbacks = 0;
+    return table;
+}
+
+/*
+ *  Function:  Rgbtable40_free
+ *  Arguments: Rgbtable40_T *table - pointer to the table to free
+ *  Does:      Frees a table and sets *table to NULL.
+ *  Return:    void
+ */
+void Rgbtable40_free(T *table)
+{
+    assert(table != NULL && *table != NULL);
+    FREE((*table)->entries);
+    FREE(*table);
+}
+
+/*
+ *  Function:  fill_entry
+ *  Arguments: Rgbtable40_T table - the table
+ *             unsigned pb, pr - chroma indices
+ *             int q - a brightness in units of 1/3150, not offset
+ *  Does:      Computes the entry of (pb, pr, q) from the two ends of its
+ *             brightness interval, as described above.
+ *  Return:    uint32_t - the entry, valid or ambiguous
+ */
+static uint32_t fill_entry(T table, unsigned pb, unsigned pr, int q)
+{
+    double y = q / 3150.0;
+    unsigned char low[3], high[3];
+    decompress_cv_bytes(y - Y_SLACK, table->chromas[pb],
+                        table->chromas[pr], low);
+    decompress_cv_bytes(y + Y_SLACK, table->chromas[pb],
+                        table->chromas[pr], high);
+    if (low[0] != high[0] || low[1] != high[1] || low[2] != high[2]) {
+        return ENTRY_AMBIGUOUS;
+    }
+    return ENTRY_VALID | (uint32_t)low[2] << 16 | (uint32_t)low[1] << 8 |
+           low[0];
+}
+
+/*
+ *  Function:  store_pixel
+ *  Arguments: uint32_t entry - a valid entry
+ *             unsigned char *pixel - where the pixel's three bytes go
+ *  Does:      Writes the red, green and blue bytes of an entry.
+ *  Return:    void
+ */
+static inline void store_pixel(uint32_t entry, unsigned char *pixel)
+{
+    pixel[0] = entry;
+    pixel[1] = entry >> 8;
+    pixel[2] = entry >> 16;
+}
+
+/*
+ *  Function:  decode_word
+ *  Arguments: Rgbtable40_T table - the table
+ *             uint32_t word - a bitpacked pixel group
+ *             unsigned char *top, *bottom - where the group's upper and
+ *                                           lower pixels go, as for
+ *                                           decompress_row
+ *  Does:      Decodes one word through the table, filling its entries if
+ *             need be, or in floating point if an entry is ambiguous or a
+ *             coefficient is out of the table's range. The pixels are in
+ *             the same order as in decompress_word (decompressrow.c).
+ *  Return:    void
+ */
+static void decode_word(T table, uint32_t word, unsigned char *top,
+                        unsigned char *bottom)
+{
+    Bitpack40_fields fields = Bitpack40_unpack(word);
+    int b = fields.b, c = fields.c, d = fields.d;
+    if ((unsigned)(b + MAX_DCT) > 2 * MAX_DCT ||
+        (unsigned)(c + MAX_DCT) > 2 * MAX_DCT ||
+        (unsigned)(d + MAX_DCT) > 2 * MAX_DCT) {
+        decompress_row_scalar(&word, 1, top, bottom);
+        table->fallbacks += 4;
+        return;
+    }
+
+    unsigned pair = fields.pb << PR_WIDTH | fields.pr;
+    int base = 50 * fields.a;
+    uint32_t *row = &table->entries[(size_t)pair * Q_COUNT + Q_OFFSET];
+    int q[4] = { base + 63 * (-b - c + d), base + 63 * (-b + c - d),
+                 base + 63 * (b - c - d), base + 63 * (b + c + d) };
+    uint32_t entry[4] = { row[q[0]], row[q[1]], row[q[2]], row[q[3]] };
+
+    if ((entry[0] & entry[1] & entry[2] & entry[3] & ENTRY_VALID) == 0) {
+        /* reread each entry, since pixels may share one */
+        unsigned hits = 0;
+        for (int i = 0; i < 4; i++) {
+            entry[i] = row[q[i]];
+            if (entry[i] == 0) {
+                entry[i] = row[q[i]] = fill_entry(table, fields.pb,
+                                                  fields.pr, q[i]);
+                table->filled++;
+            } else {
+                hits++;
+            }
+        }
+        if ((entry[0] & entry[1] & entry[2] & entry[3] &
+             ENTRY_VALID) == 0) {
+            decompress_row_scalar(&word, 1, top, bottom);
+            table->fallbacks += 4;
+            return;
+        }
+        table->hits += hits;
+        table->misses += 4 - hits;
+    } else {
+        table->hits += 4;
+    }
+
+    store_pixel(entry[0], &top[0]);
+    store_pixel(entry[1], &top[3]);
+    store_pixel(entry[2], &bottom[0]);
+    store_pixel(entry[3], &bottom[3]);
+}
+
+/*
+ *  Function:  decode_row
+ *  Arguments: Rgbtable40_T table - the table
+ *             const void *words - a row of width words
+ *             unsigned width - the number of words in the row
+ *             bool big_endian - whether the row holds big endian bytes
+ *                               rather than native uint32_ts
+ *             unsigned char *top, *bottom - the row's scanlines
+ *  Does:      Decodes a row of words through the table.
+ *  Return:    void
+ */
+static void decode_row(T table, const void *words, unsigned width,
+                       bool big_endian, unsigned char *top,
+                       unsigned char *bottom)
+{
+    for (unsigned col = 0; col < width; col++) {
+        decode_word(table, load_word(words, col, big_endian),
+                    &top[6 * col], &bottom[6 * col]);
+    }
+}
+
+/*
+ *  Function:  Rgbtable40_decode_row
+ *  Arguments: Rgbtable40_T table - the table
+ *             const uint32_t *words, unsigned width,
+ *             unsigned char *top, *bottom - as for decompress_row
+ *  Does:      Decodes one row of words into two scanlines of 8-bit RGB
+ *             pixels, the same as decompress_row would.
+ *  Return:    void
+ */
+void Rgbtable40_decode_row(T table, const uint32_t *words, unsigned width,
+                           unsigned char *top, unsigned char *bottom)
+{
+    assert(table != NULL && words != NULL && top != NULL && bottom != NULL);
+    decode_row(table, words, width, false, top, bottom);
+}
+
+/*
+ *  Function:  Rgbtable40_decode_row_be
+ *  Arguments: Rgbtable40_T table - the table
+ *             const unsigned char *bytes, unsigned width,
+ *             unsigned char *top, *bottom - as for decompress_row_be
+ *  Does:      Decodes one row of a compressed file in place, the same as
+ *             decompress_row_be would.
+ *  Return:    void
+ */
+void Rgbtable40_decode_row_be(T table, const unsigned char *bytes,
+                              unsigned width, unsigned char *top,
+                              unsigned char *bottom)
+{
+    assert(table != NULL && bytes != NULL && top != NULL && bottom != NULL);
+    decode_row(table, bytes, width, true, top, bottom);
+}
+
+/*
+ *  Function:  Rgbtable40_add_stats
+ *  Arguments: Rgbtable40_T table - the table
+ *             Rgbtable40_stats *stats - the statistics to update
+ *  Does:      Sets the size fields of stats and adds the table's counts to
+ *             the others, so that the statistics of several tables (one per
+ *             thread, say) can be gathered in one struct.
+ *  Return:    void
+ */
+void Rgbtable40_add_stats(T table, Rgbtable40_stats *stats)
+{
+    assert(table != NULL && stats != NULL);
+    stats->entries = (size_t)CHROMA_PAIRS * Q_COUNT;
+    stats->bytes = stats->entries * sizeof(uint32_t);
+    stats->tables++;
+    stats->filled += table->filled;
+    stats->hits += table->hits;
+    stats->misses += table->misses;
+    stats->fallbacks += table->fallbacks;
+}
@@ -0,0 +1,61 @@
+/******************************************************************************
+ *
+ *                               rgbtable40.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for a direct-to-RGB decoding table, an alternative to the
+ *     floating-point color transform of decompressrow.h that gives exactly
+ *     the same pixels. A pixel of a word depends only on its chroma indices
+ *     pb and pr and on its brightness, which the inverse DCT makes
+ *     a / 63 + k / 50 for an integer k = +-b +-c +-d; so it is a function of
+ *     (pb, pr, q) with q = 50a + 63k, the brightness in units of 1/3150.
+ *     The table maps each such triple to the pixel's three bytes, and is
+ *     filled lazily: an entry is computed the first time a pixel needs it.
+ *     (See the implementation file rgbtable40.c for more information)
+ *
+ *     A table spans about 8.6 MB (4-byte entries for 256 chroma pairs
+ *     by 8821 brightnesses), taken zeroed from the heap so that only the
+ *     pages holding filled entries use memory, and starts empty. A table
+ *     is not thread-safe; give each thread its own, at the price of that
+ *     many tables to fill and that much address space per thread. It is
+ *     a checked run-time error to pass a NULL Rgbtable40_T or pointer to
+ *     any function in this interface.
+ *
+ *****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef RGBTABLE40_H
+#define RGBTABLE40_H
+
+#define T Rgbtable40_T
+typedef struct T *T;
+
+typedef struct Rgbtable40_stats {
+    size_t entries;     /* entries in a table */
+    size_t bytes;       /* bytes of address space a table spans; only the
+                           pages holding filled entries are touched */
+    uint64_t tables;    /* tables whose counts were added */
+    uint64_t filled;    /* entries filled so far, in all those tables */
+    uint64_t hits;      /* pixels decoded from an entry already filled */
+    uint64_t misses;    /* pixels whose entry was filled on the spot */
+    uint64_t fallbacks; /* pixels of words decoded in floating point
+                           because an entry was ambiguous */
+} Rgbtable40_stats;
+
+extern T    Rgbtable40_new          (void);
+extern void Rgbtable40_free         (T *table);
+extern void Rgbtable40_decode_row   (T table, const uint32_t *words,
+                                     unsigned width, unsigned char *top,
+                                     unsigned char *bottom);
+extern void Rgbtable40_decode_row_be(T table, const unsigned char *bytes,
+                                     unsigned width, unsigned char *top,
+                                     unsigned char *bottom);
+extern void Rgbtable40_add_stats    (T table, Rgbtable40_stats *stats);
+
+#undef T
+#endif
@@ -0,0 +1,56 @@
+/******************************************************************************
+ *
+ *                                scanline.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     The scanline formats the compression row kernels accept, and an
+ *     inline accessor for their samples. Scanlines may be given either as
+ *     arrays of Pnm_rgb structs or as the raw bytes of a binary PPM raster
+ *     (one byte per sample when the denominator is below 256, two big
+ *     endian bytes otherwise), so that a memory-mapped file can be
+ *     compressed in place.
+ *
+ *****************************************************************************/
+
+#include <stddef.h>
+
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+/* How the samples of a scanline are stored */
+typedef enum Sample_format {
+    SAMPLES_RGB,  /* an array of struct Pnm_rgb, which is three unsigneds */
+    SAMPLES_RAW8, /* one byte per sample */
+    SAMPLES_RAW16 /* two big endian bytes per sample */
+} Sample_format;
+
+/*
+ *  Function:  get_sample
+ *  Arguments: const void *row - a scanline
+ *             size_t index - index of a sample within the scanline (3 times
+ *                            the column of its pixel, plus 0 for red, 1 for
+ *                            green or 2 for blue)
+ *             Sample_format format - how the scanline is stored
+ *  Does:      Fetches one sample of a scanline. A Pnm_rgb struct holds its
+ *             three samples as consecutive unsigneds, so in every format the
+ *             scanline is a flat array of samples.
+ *  Return:    unsigned - the sample
+ */
+static inline unsigned get_sample(const void *row, size_t index,
+                                  Sample_format format)
+{
+    const unsigned char *bytes = row;
+    switch (format) {
+    case SAMPLES_RGB:
+        return ((const unsigned *)row)[index];
+    case SAMPLES_RAW8:
+        return bytes[index];
+    default:
+        return (unsigned)bytes[2 * index] << 8 | bytes[2 * index + 1];
+    }
+}
+
+#endif
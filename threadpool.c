@@ -0,0 +1,188 @@
+/******************************************************************************
+ *
+ *                               threadpool.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the threadpool.h interface. Tasks are kept in a singly
+ *     linked FIFO queue guarded by one mutex; idle workers sleep on a
+ *     condition variable until a task is submitted, and Threadpool_wait
+ *     sleeps on a second one until the queue is empty and every worker is
+ *     idle. Tasks must not call back into the pool they run on.
+ *
+ *****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "threadpool.h"
+
+#define T Threadpool_T
+
+/* a submitted, not yet started task */
+struct Task {
+    Threadpool_task *task;
+    void *cl;
+    struct Task *next;
+};
+
+struct T {
+    unsigned nthreads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready; /* signaled when a task is queued or the
+                                  pool is shutting down */
+    pthread_cond_t all_done;   /* signaled when the pool becomes idle */
+    struct Task *head, *tail;  /* FIFO queue of pending tasks */
+    unsigned active;           /* number of tasks currently running */
+    int shutdown;
+};
+
+/* Static function declarations */
+static void *worker(void *vpool);
+
+/*
+ *  Function:  worker
+ *  Arguments: void *vpool - the Threadpool_T this thread belongs to
+ *  Does:      Body of each worker thread: repeatedly takes the oldest
+ *             pending task off the queue and runs it, until the pool is
+ *             shut down and the queue is empty.
+ *  Return:    void * - always NULL
+ */
+static void *worker(void *vpool)
+{
+    T pool = vpool;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->head == NULL && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->head == NULL) {
+            break;
+        }
+        struct Task *task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->task(task->cl);
+        FREE(task);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (pool->active == 0 && pool->head == NULL) {
+            pthread_cond_broadcast(&pool->all_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ *  Function:  Threadpool_new
+ *  Arguments: unsigned nthreads - number of worker threads, at least 1
+ *  Does:      Creates a pool and starts its worker threads. The pool must
+ *             be freed with Threadpool_free.
+ *  Return:    Threadpool_T - the new pool
+ */
+T Threadpool_new(unsigned nthreads)
+{
+    assert(nthreads > 0);
+    T pool;
+    NEW(pool);
+    pool->nthreads = nthreads;
+    pool->threads = CALLOC(nthreads, sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+    pool->head = pool->tail = NULL;
+    pool->active = 0;
+    pool->shutdown = 0;
+
+    for (unsigned i = 0; i < nthreads; i++) {
+        int err = pthread_create(&pool->threads[i], NULL, worker, pool);
+        assert(err == 0);
+    }
+    return pool;
+}
+
+/*
+ *  Function:  Threadpool_free
+ *  Arguments: Threadpool_T *pool - pointer to the pool to be freed
+ *  Does:      Runs every task still queued, stops and joins the worker
+ *             threads, frees the pool and sets *pool to NULL.
+ *  Return:    void
+ */
+void Threadpool_free(T *pool)
+{
+    assert(pool != NULL && *pool != NULL);
+    T p = *pool;
+
+    pthread_mutex_lock(&p->lock);
+    p->shutdown = 1;
+    pthread_cond_broadcast(&p->work_ready);
+    pthread_mutex_unlock(&p->lock);
+    for (unsigned i = 0; i < p->nthreads; i++) {
+        pthread_join(p->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&p->all_done);
+    pthread_cond_destroy(&p->work_ready);
+    pthread_mutex_destroy(&p->lock);
+    FREE(p->threads);
+    FREE(*pool);
+}
+
+/*
+ *  Function:  Threadpool_submit
+ *  Arguments: Threadpool_T pool - the pool to run the task on
+ *             Threadpool_task *task - the function to run
+ *             void *cl - closure passed to task
+ *  Does:      Queues task(cl) to be run by the next idle worker.
+ *  Return:    void
+ */
+void Threadpool_submit(T pool, Threadpool_task *task, void *cl)
+{
+    assert(pool != NULL && task != NULL);
+    struct Task *t;
+    NEW(t);
+    t->task = task;
+    t->cl = cl;
+    t->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL) {
+        pool->head = t;
+    } else {
+        pool->tail->next = t;
+    }
+    pool->tail = t;
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ *  Function:  Threadpool_wait
+ *  Arguments: Threadpool_T pool - the pool to wait on
+ *  Does:      Blocks until every task submitted so far has finished.
+ *  Return:    void
+ */
+void Threadpool_wait(T pool)
+{
+    assert(pool != NULL);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head != NULL || pool->active > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,32 @@
+/******************************************************************************
+ *
+ *                               threadpool.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for a fixed-size pool of worker threads that run submitted
+ *     tasks in the order they were submitted. (See the implementation file
+ *     threadpool.c for more information)
+ *
+ *     It is a checked run-time error to pass a NULL Threadpool_T or task to
+ *     any function in this interface.
+ *
+ *****************************************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#define T Threadpool_T
+typedef struct T *T;
+
+typedef void Threadpool_task(void *cl);
+
+extern T    Threadpool_new   (unsigned nthreads);
+extern void Threadpool_free  (T *pool);
+extern void Threadpool_submit(T pool, Threadpool_task *task, void *cl);
+extern void Threadpool_wait  (T pool);
+
+#undef T
+#endif
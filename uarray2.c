@@ -1,72 +1,94 @@
-#line 50 "www/solutions/uarray2.nw"
+#include <stddef.h>
 #include "assert.h"
 #include "mem.h"
-#include "uarray.h"
 #include "uarray2.h"
 
 #define T UArray2_T
 
+/* alignment of the cells, enough for any type a cell may hold */
+#define CELL_ALIGN 16
+
 /* 
- * Element (i, j) in the world of ideas maps to
- * rows[j][i] where the square brackets stand for access
- * to a Hanson UArray_T
+ * Element (i, j) in the world of ideas maps to the 'size' bytes at
+ * elems + j * stride + i * size: the cells are laid out row by row in
+ * the same allocation as the handle
  */
-struct T {
-        int width, height;
-        int size;
-        UArray_T rows; /* UArray_T of 'height' UArray_Ts,
-                          each of length 'width' and size 'size' */
-};
-#line 79 "www/solutions/uarray2.nw"
-static inline UArray_T row(T a, int j)
-{
-        UArray_T *prow = UArray_at(a->rows, j);   /* Ramsey idiom */
-        return *prow;
-}
-#line 92 "www/solutions/uarray2.nw"
+
 static int is_ok(T a)
 {
-        return a && UArray_length(a->rows) == a->height &&
-               UArray_size(a->rows) == sizeof(UArray_T) &&
-               (a->height == 0 || (UArray_length(row(a, 0)) == a->width
-                                   && UArray_size  (row(a, 0)) == a->size));
+        return a && a->width >= 0 && a->height >= 0 && a->size > 0 &&
+               a->stride == (size_t)a->width * a->size &&
+               (a->elems != NULL || a->width == 0 || a->height == 0);
 }
-#line 109 "www/solutions/uarray2.nw"
-T UArray2_new(int width, int height, int size)
+
+static T new_array(Region40_T region, int width, int height, int size)
 {
-        int i;  /* interates over row number */
-        T array;
-        NEW(array);
+        assert(width >= 0 && height >= 0 && size > 0);
+        size_t stride = (size_t)width * size;
+        size_t bytes  = stride * height;
+        /* the handle and every cell share one allocation, with the cells
+           starting at the first suitably aligned offset past the handle */
+        size_t offset = (sizeof(struct T) + CELL_ALIGN - 1)
+                        / CELL_ALIGN * CELL_ALIGN;
+        T array = region != NULL ? Region40_alloc(region, offset + bytes)
+                                 : ALLOC(offset + bytes);
         array->width  = width;
         array->height = height;
         array->size   = size;
-        array->rows   = UArray_new(height, sizeof(UArray_T));
-        for (i = 0; i < height; i++) {
-                UArray_T *rowp = UArray_at(array->rows, i);
-                *rowp = UArray_new(width, size);
-        }
+        array->stride = stride;
+        array->elems  = bytes > 0 ? (char *)array + offset : NULL;
+        array->region = region;
         assert(is_ok(array));
         return array;
 }
-#line 131 "www/solutions/uarray2.nw"
+
+T UArray2_new(int width, int height, int size)
+{
+        return new_array(NULL, width, height, size);
+}
+
+/*
+ * like UArray2_new, but the array lives in the region, and is released
+ * with everything else in it when the region is reset or freed
+ */
+T UArray2_new_in(Region40_T region, int width, int height, int size)
+{
+        assert(region);
+        return new_array(region, width, height, size);
+}
+
+/* an array in a region is only forgotten here; the region releases it */
 void UArray2_free(T *array2)
 {
-        int i;
         assert(array2 && *array2);
-        for (i = 0; i < (*array2)->height; i++) {
-                UArray_T p = row(*array2, i);
-                UArray_free(&p);
+        if ((*array2)->region != NULL) {
+                *array2 = NULL;
+        } else {
+                FREE(*array2);
         }
-        UArray_free(&(*array2)->rows);
-        FREE(*array2);
 }
-#line 151 "www/solutions/uarray2.nw"
+
 void *UArray2_at(T array2, int i, int j)
 {
         assert(array2);
-        return UArray_at(row(array2, j), i);
+        assert(i >= 0 && i < array2->width && j >= 0 && j < array2->height);
+        return UArray2_at_unchecked(array2, i, j);
+}
+
+/*
+ * pointer to the first of the 'width' contiguous cells of row j, or NULL
+ * if the array has no cells
+ */
+void *UArray2_row(T array2, int j)
+{
+        assert(array2);
+        assert(j >= 0 && j < array2->height);
+        if (array2->elems == NULL) {
+                return NULL;
+        }
+        return array2->elems + (size_t)j * array2->stride;
 }
-#line 162 "www/solutions/uarray2.nw"
+
 int UArray2_height(T array2)
 {
         assert(array2);
@@ -84,7 +106,7 @@ int UArray2_size(T array2)
         assert(array2);
         return array2->size;
 }
-#line 193 "www/solutions/uarray2.nw"
+
 void UArray2_map_row_major(T array2, 
                            void apply(int i, int j, T array2, 
                                       void *elem, void *cl), 
@@ -93,14 +115,17 @@ void UArray2_map_row_major(T array2,
         assert(array2);
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
+        int size = array2->size;
+        /* a thin wrapper over the row span */
         for (int j = 0; j < h; j++) {
-                /* don't want row/UArray_at in inner loop */
-                UArray_T thisrow = row(array2, j); 
-                for (int i = 0; i < w; i++)
-                        apply(i, j, array2, UArray_at(thisrow, i), cl);
+                char *elem = UArray2_row(array2, j);
+                for (int i = 0; i < w; i++) {
+                        apply(i, j, array2, elem, cl);
+                        elem += size;
+                }
         }
 }
-#line 211 "www/solutions/uarray2.nw"
+
 void UArray2_map_col_major(T array2, 
                            void apply(int i, int j, T array2, 
                                       void *elem, void *cl), 
@@ -109,7 +134,12 @@ void UArray2_map_col_major(T array2,
         assert(array2);
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
-        for (int i = 0; i < w; i++)
-                for (int j = 0; j < h; j++)
-                        apply(i, j, array2, UArray_at(row(array2, j), i), cl);
-}
\ No newline at end of file
+        size_t stride = array2->stride;
+        for (int i = 0; i < w; i++) {
+                char *elem = UArray2_at_unchecked(array2, i, 0);
+                for (int j = 0; j < h; j++) {
+                        apply(i, j, array2, elem, cl);
+                        elem += stride;
+                }
+        }
+}
@@ -1,18 +1,45 @@
 #ifndef ARRAY2_INCLUDED
 #define ARRAY2_INCLUDED
+#include <stddef.h>
+#include "region40.h"
 #define T UArray2_T
 typedef struct T *T;
 
+/*
+ * Cells are stored contiguously in row-major order, so the cells of a row
+ * are adjacent and consecutive rows are 'width' cells apart. The
+ * representation is visible only so that UArray2_at_unchecked can be
+ * inlined; clients must not touch the fields.
+ */
+struct T {
+        int width, height;
+        int size;
+        size_t stride;  /* bytes per row, width * size */
+        char *elems;    /* NULL if the array has no cells */
+        Region40_T region; /* the region holding the array, or NULL if it
+                              came from the heap */
+};
+
 typedef void UArray2_applyfun(int i, int j, T array2, void *elem, void *cl);
 typedef void UArray2_mapfun(T array2, UArray2_applyfun apply, void *cl);
 
 extern T     UArray2_new   (int width, int height, int size);
+extern T     UArray2_new_in(Region40_T region, int width, int height,
+                            int size);
 extern void  UArray2_free  (T *array2);
 extern int   UArray2_width (T array2);
 extern int   UArray2_height(T array2);
 extern int   UArray2_size  (T array2);
 extern void *UArray2_at    (T array2, int i, int j);
+extern void *UArray2_row   (T array2, int j);
 extern void  UArray2_map_row_major(T array2, UArray2_applyfun apply, void *cl);
 extern void  UArray2_map_col_major(T array2, UArray2_applyfun apply, void *cl);
+
+/* like UArray2_at, without the NULL and bounds checks */
+static inline void *UArray2_at_unchecked(T array2, int i, int j)
+{
+        return array2->elems + (size_t)j * array2->stride
+                             + (size_t)i * array2->size;
+}
 #undef T
-#endif
\ No newline at end of file
+#endif
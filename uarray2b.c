@@ -1,83 +1,98 @@
-#line 59 "www/solutions/uarray2b.nw"
 #include <math.h>
+#include <stddef.h>
 #include "assert.h"
 #include "mem.h"
-#include "uarray.h"
-#include "uarray2.h"
 #include "uarray2b.h"
 
 #define T UArray2b_T
 
+/* alignment of the cells, enough for any type a cell may hold */
+#define CELL_ALIGN 16
+
 struct T { /* represents a 2D array of cells each of size 'size' */
         int width, height;
         unsigned blocksize;
         unsigned size;
-        UArray2_T blocks;
+        int xblocks, yblocks;   /* width and height divided by blocksize,
+                                   rounded up */
+        int shift;              /* log2(blocksize) if blocksize is a power
+                                   of two, otherwise -1 */
+        unsigned mask;          /* blocksize - 1 if shift >= 0 */
+        size_t block_bytes;     /* blocksize * blocksize * size */
+        char *cells;
+        Region40_T region;      /* the region holding the array, or NULL
+                                   if it came from the heap */
         /*
-         * matrix of blocks, each blocksize * blocksize 
-         *
-         * matrix dimensions are width and height divided by blocksize,
-         * rounded up
-         *
-         * a block is a Uarray_T of length blocksize * blocksize 
-         * and size 'size'
-         *
-         * invariant relating cells in blocks to cells in the abstraction
-         *  described in section on coordinate transformations below
+         * all cells live in one contiguous buffer (in the same allocation
+         * as this struct), laid out block by block: block (bx, by) is
+         * block number bx * yblocks + by, so the blocks appear in the order
+         * UArray2b_map visits them. Within a block, cell (i, j) is at index
+         * (i % blocksize) * blocksize + j % blocksize. Blocks on the right
+         * and bottom edges are padded out to full size with unused cells.
          */
 };
-#line 94 "www/solutions/uarray2b.nw"
-#include <stdio.h>  /* include so we can print diagnostics */
 
-T UArray2b_new(int width, int height, int size, int blocksize)
+static int log2_exact(unsigned n)
+{
+        int shift = 0;
+        while ((1u << shift) < n) {
+                shift++;
+        }
+        return (1u << shift) == n ? shift : -1;
+}
+
+static T new_array(Region40_T region, int width, int height, int size,
+                   int blocksize)
 {
         assert(blocksize > 0);
-        T array;
-        NEW(array);
+        assert(width >= 0 && height >= 0 && size > 0);
+        int xblocks = (width  + blocksize - 1) / blocksize;
+        int yblocks = (height + blocksize - 1) / blocksize;
+        size_t block_bytes = (size_t)blocksize * blocksize * size;
+        size_t bytes = block_bytes * xblocks * yblocks;
+        size_t offset = (sizeof(struct T) + CELL_ALIGN - 1)
+                        / CELL_ALIGN * CELL_ALIGN;
+
+        /* a single allocation for the handle and every block */
+        T array = region != NULL ? Region40_alloc(region, offset + bytes)
+                                 : ALLOC(offset + bytes);
         array->width  = width;
         array->height = height;
         array->size   = size;
         array->blocksize = blocksize;
-        array->blocks = UArray2_new((width  + blocksize - 1) / blocksize,
-                                    (height + blocksize - 1) / blocksize,
-                                    sizeof(UArray_T));
-        int xblocks = UArray2_width (array->blocks); 
-        int yblocks = UArray2_height(array->blocks);
-        for (int i = 0; i < xblocks; i++) {
-                for (int j = 0; j < yblocks; j++) {
-                        UArray_T *block = UArray2_at(array->blocks, i, j);
-                        *block = UArray_new(blocksize * blocksize, size);
-                        
-#line 169 "www/solutions/uarray2b.nw"
-if (0) {
-        fprintf(stderr, "Allocated %p; put %p at %p\n",
-                (void *)*block, (void *)*(UArray_T*)UArray2_at(array->blocks, i, j),
-                UArray2_at(array->blocks, i, j));
-}
-#line 115 "www/solutions/uarray2b.nw"
-                                  }
-        }
+        array->xblocks = xblocks;
+        array->yblocks = yblocks;
+        array->shift = log2_exact(blocksize);
+        array->mask = blocksize - 1;
+        array->block_bytes = block_bytes;
+        array->cells = bytes > 0 ? (char *)array + offset : NULL;
+        array->region = region;
         return array;
 }
-#line 124 "www/solutions/uarray2b.nw"
+
+T UArray2b_new(int width, int height, int size, int blocksize)
+{
+        return new_array(NULL, width, height, size, blocksize);
+}
+
+T UArray2b_new_in(Region40_T region, int width, int height, int size,
+                  int blocksize)
+{
+        assert(region);
+        return new_array(region, width, height, size, blocksize);
+}
+
+/* an array in a region is only forgotten here; the region releases it */
 void UArray2b_free(T *array2b)
 {
-        int i;
         assert(array2b && *array2b);
-        T array = *array2b;
-        int xblocks = UArray2_width (array->blocks);
-        int yblocks = UArray2_height(array->blocks);
-        assert(UArray2_size(array->blocks) == sizeof(UArray_T));
-        for (i = 0; i < xblocks; i++) {
-                for (int j = 0; j < yblocks; j++) {
-                        UArray_T *p = UArray2_at(array->blocks, i, j);
-                        UArray_free(p);
-                }
+        if ((*array2b)->region != NULL) {
+                *array2b = NULL;
+        } else {
+                FREE(*array2b);
         }
-        UArray2_free(&(*array2b)->blocks);
-        FREE(*array2b);
 }
-#line 148 "www/solutions/uarray2b.nw"
+
 T UArray2b_new_64K_block(int width, int height, int size)
 {
         int blocksize = (int) floor(sqrt((double) (64 * 1024)
@@ -92,19 +107,53 @@ T UArray2b_new_64K_block(int width, int height, int size)
         }
         return UArray2b_new(width, height, size, blocksize);
 }
-#line 200 "www/solutions/uarray2b.nw"
+
 void *UArray2b_at(T array2b, int i, int j)
 {
+        assert(array2b);
         assert(i >= 0 && j >= 0);
         /* avoid unused cells */
         assert(i < array2b->width && j < array2b->height);
-        int b  = array2b->blocksize;
-        int bx = i / b;   /* block x coordinate */
-        int by = j / b;   /* block y coordinate */
-        UArray_T *blockp = UArray2_at(array2b->blocks, bx, by);
-        return UArray_at(*blockp, (i % b) * b + j % b);
+        unsigned bx, by, cell;
+        if (array2b->shift >= 0) {
+                int      s = array2b->shift;
+                unsigned m = array2b->mask;
+                bx   = (unsigned)i >> s;
+                by   = (unsigned)j >> s;
+                cell = ((i & m) << s) | (j & m);
+        } else {
+                unsigned b = array2b->blocksize;
+                bx   = i / b;
+                by   = j / b;
+                cell = (i % b) * b + j % b;
+        }
+        size_t block = (size_t)bx * array2b->yblocks + by;
+        return array2b->cells + block * array2b->block_bytes
+                              + (size_t)cell * array2b->size;
+}
+
+int UArray2b_xblocks(T array2b)
+{
+        assert(array2b);
+        return array2b->xblocks;
+}
+
+int UArray2b_yblocks(T array2b)
+{
+        assert(array2b);
+        return array2b->yblocks;
 }
-#line 222 "www/solutions/uarray2b.nw"
+
+void *UArray2b_block(T array2b, int bx, int by)
+{
+        assert(array2b);
+        assert(bx >= 0 && bx < array2b->xblocks);
+        assert(by >= 0 && by < array2b->yblocks);
+        size_t block = (size_t)bx * array2b->yblocks + by;
+        return array2b->cells + block * array2b->block_bytes;
+}
+
+/* a thin wrapper over the span access above */
 void UArray2b_map(T array2b, 
                   void apply(int col, int row, T array2b,
                              void *elem, void *cl),
@@ -114,32 +163,28 @@ void UArray2b_map(T array2b,
         int       h      = array2b->height;
         int       w      = array2b->width;
         int       b      = array2b->blocksize;
-        UArray2_T blocks = array2b->blocks;
-        int       bw     = UArray2_width(blocks);
-        int       bh     = UArray2_height(blocks);
-
-        for (int bx = 0; bx < bw; bx++) {
-                for (int by = 0; by < bh; by++) {
-                        UArray_T *blockp = UArray2_at(blocks, bx, by);
-                        UArray_T  block  = *blockp;
-                        int       len    = UArray_length(block);
+        int       size   = array2b->size;
+
+        for (int bx = 0; bx < array2b->xblocks; bx++) {
+                for (int by = 0; by < array2b->yblocks; by++) {
+                        char *elem = UArray2b_block(array2b, bx, by);
                         /* (i0, j0) correspond to upper left */
                         /* corner of block (bx, by)          */
                         int i0 = b * bx; 
                         int j0 = b * by; 
-                        for (int cell = 0; cell < len; cell++) {
-                                int i = i0 + cell / b;
-                                int j = j0 + cell % b;
-                                /* measured overhead 0.5% to 1.5% */
-                                if (i < w && j < h) {
-                                        apply(i, j, array2b, 
-                                              UArray_at(block, cell), cl);
+                        for (int i = i0; i < i0 + b; i++) {
+                                for (int j = j0; j < j0 + b; j++) {
+                                        if (i < w && j < h) {
+                                                apply(i, j, array2b, elem,
+                                                      cl);
+                                        }
+                                        elem += size;
                                 }
                         }
                 }
         }
 }
-#line 269 "www/solutions/uarray2b.nw"
+
 int UArray2b_height(T array2b)
 {
         assert(array2b);
@@ -162,5 +207,3 @@ int UArray2b_blocksize(T array2b)
         assert(array2b);
         return array2b->blocksize;
 }
-#line 296 "www/solutions/uarray2b.nw"
-int UArray2b_version_uses_UArray2_T = 1;
\ No newline at end of file
@@ -1,5 +1,6 @@
 #ifndef UARRAY2B_INCLUDED
 #define UARRAY2B_INCLUDED
+#include "region40.h"
 
 #define T UArray2b_T
 typedef struct T *T;
@@ -11,6 +12,13 @@ typedef struct T *T;
  */
 extern T    UArray2b_new (int width, int height, int size, int blocksize);
 
+/* 
+ * new blocked 2d array in a region (see region40.h), released with the
+ * region rather than by UArray2b_free
+ */
+extern T    UArray2b_new_in(Region40_T region, int width, int height,
+                            int size, int blocksize);
+
 /* new blocked 2d array: blocksize as large as possible provided
  * block occupies at most 64KB (if possible)
  */
@@ -28,6 +36,19 @@ extern int   UArray2b_blocksize(T  array2b);
  */
 extern void *UArray2b_at(T array2b, int column, int row);
 
+/*
+ * span access: the array is made of xblocks * yblocks blocks, and
+ * UArray2b_block returns a pointer to the blocksize * blocksize contiguous
+ * cells of block (bx, by). Cell (column, row) of the array is cell
+ * (column % blocksize) * blocksize + row % blocksize of block
+ * (column / blocksize, row / blocksize); cells of edge blocks that lie
+ * outside the array are unused. Block coordinates out of range are a
+ * checked run-time error.
+ */
+extern int   UArray2b_xblocks(T array2b);
+extern int   UArray2b_yblocks(T array2b);
+extern void *UArray2b_block  (T array2b, int bx, int by);
+
 /* visits every cell in one block before moving to another block */
 extern void  UArray2b_map(T array2b, 
                           void apply(int col, int row, T array2b,
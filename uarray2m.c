@@ -0,0 +1,310 @@
+/******************************************************************************
+ *
+ *                                uarray2m.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the uarray2m.h interface. A pure Morton layout needs both
+ *     dimensions padded to the same power of two, which can waste most of
+ *     the memory for a long, narrow image, so the array is cut into square
+ *     tiles whose edge is a power of two. Tiles are stored row by row, and
+ *     the cells of a tile in Morton order: the offset of cell (col, row)
+ *     within its tile interleaves the bits of the row (in the even bit
+ *     positions) with the bits of the column (in the odd ones). Only the
+ *     tiles on the right and bottom edges are padded.
+ *
+ *     With the row in the low bit, every aligned 2x2 group is stored as
+ *     top-left, bottom-left, top-right, bottom-right, which is the same
+ *     order in which UArray2b_map visits a block of size 2; so are the
+ *     larger aligned power-of-two squares, recursively.
+ *
+ *     Interleaving is one pdep per coordinate on processors with BMI2
+ *     (and de-interleaving during a map, one pext), and a few shifts and
+ *     masks otherwise.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "assert.h"
+#include "mem.h"
+
+#include "cpufeatures.h"
+#include "uarray2m.h"
+
+#define T UArray2m_T
+
+/* Alignment of the cells, enough for any type a cell may hold */
+#define CELL_ALIGN 16
+
+/* Bits of a tile offset that hold the row and the column of a cell */
+#define ROW_BITS 0x55555555u
+#define COL_BITS 0xaaaaaaaau
+
+/* Largest tile edge, so that a tile offset fits in 32 bits */
+#define MAX_TILE_SHIFT 15
+
+struct T {
+    int width, height;
+    int size;
+    int shift;           /* log2 of the tile edge */
+    unsigned mask;       /* tile edge - 1 */
+    int xtiles, ytiles;  /* tiles across and down */
+    size_t tile_bytes;   /* bytes per tile */
+    bool bmi2;           /* interleave with pdep/pext */
+    char *cells;         /* in the same allocation as this struct */
+};
+
+/* Static function declarations */
+static inline uint32_t spread_bits(uint32_t x);
+static inline uint32_t gather_bits(uint32_t x);
+static inline uint32_t interleave(T array2m, unsigned col, unsigned row);
+static void map_rows(T array2m, UArray2m_applyfun apply, void *cl,
+                     bool row_major);
+
+/*
+ *  Function:  spread_bits
+ *  Arguments: uint32_t x - a value of at most 16 bits
+ *  Does:      Moves bit k of x to bit 2k (portable pdep with ROW_BITS).
+ *  Return:    uint32_t - the spread value
+ */
+static inline uint32_t spread_bits(uint32_t x)
+{
+    x = (x | (x << 8)) & 0x00ff00ffu;
+    x = (x | (x << 4)) & 0x0f0f0f0fu;
+    x = (x | (x << 2)) & 0x33333333u;
+    x = (x | (x << 1)) & 0x55555555u;
+    return x;
+}
+
+/*
+ *  Function:  gather_bits
+ *  Arguments: uint32_t x - a value
+ *  Does:      Moves bit 2k of x to bit k, dropping the odd bits (portable
+ *             pext with ROW_BITS).
+ *  Return:    uint32_t - the gathered value
+ */
+static inline uint32_t gather_bits(uint32_t x)
+{
+    x &= 0x55555555u;
+    x = (x | (x >> 1)) & 0x33333333u;
+    x = (x | (x >> 2)) & 0x0f0f0f0fu;
+    x = (x | (x >> 4)) & 0x00ff00ffu;
+    x = (x | (x >> 8)) & 0x0000ffffu;
+    return x;
+}
+
+#ifdef CPUFEATURES_X86
+
+TARGET_BMI2
+static inline uint32_t interleave_bmi2(unsigned col, unsigned row)
+{
+    return _pdep_u32(row, ROW_BITS) | _pdep_u32(col, COL_BITS);
+}
+
+TARGET_BMI2
+static inline void deinterleave_bmi2(uint32_t offset, unsigned *col,
+                                     unsigned *row)
+{
+    *row = _pext_u32(offset, ROW_BITS);
+    *col = _pext_u32(offset, COL_BITS);
+}
+
+#endif
+
+/*
+ *  Function:  interleave
+ *  Arguments: UArray2m_T array2m - the array
+ *             unsigned col, row - coordinates of a cell within its tile
+ *  Does:      Computes the Morton offset of a cell within its tile.
+ *  Return:    uint32_t - the offset, in cells
+ */
+static inline uint32_t interleave(T array2m, unsigned col, unsigned row)
+{
+#ifdef CPUFEATURES_X86
+    if (array2m->bmi2) {
+        return interleave_bmi2(col, row);
+    }
+#endif
+    (void)array2m;
+    return spread_bits(row) | spread_bits(col) << 1;
+}
+
+/*
+ *  Function:  UArray2m_new
+ *  Arguments: int width, height - dimensions of the array, at least 0
+ *             int size - size in bytes of a cell, at least 1
+ *             int tilesize - edge of a tile in cells, rounded up to a power
+ *                            of two
+ *  Does:      Allocates an array, handle and cells together in a single
+ *             allocation. The contents of the cells are undefined.
+ *  Return:    UArray2m_T - the new array
+ */
+T UArray2m_new(int width, int height, int size, int tilesize)
+{
+    assert(width >= 0 && height >= 0 && size > 0 && tilesize > 0);
+    int shift = 0;
+    while ((1 << shift) < tilesize) {
+        shift++;
+    }
+    assert(shift <= MAX_TILE_SHIFT);
+    int edge = 1 << shift;
+    int xtiles = (width + edge - 1) >> shift;
+    int ytiles = (height + edge - 1) >> shift;
+    size_t tile_bytes = (size_t)edge * edge * size;
+    size_t bytes = tile_bytes * xtiles * ytiles;
+    size_t offset = (sizeof(struct T) + CELL_ALIGN - 1) / CELL_ALIGN *
+                    CELL_ALIGN;
+
+    T array = ALLOC(offset + bytes);
+    array->width = width;
+    array->height = height;
+    array->size = size;
+    array->shift = shift;
+    array->mask = edge - 1;
+    array->xtiles = xtiles;
+    array->ytiles = ytiles;
+    array->tile_bytes = tile_bytes;
+    array->bmi2 = cpu_has_bmi2();
+    array->cells = bytes > 0 ? (char *)array + offset : NULL;
+    return array;
+}
+
+/*
+ *  Function:  UArray2m_free
+ *  Arguments: UArray2m_T *array2m - pointer to the array to be freed
+ *  Does:      Frees the array and sets *array2m to NULL.
+ *  Return:    void
+ */
+void UArray2m_free(T *array2m)
+{
+    assert(array2m != NULL && *array2m != NULL);
+    FREE(*array2m);
+}
+
+int UArray2m_width(T array2m)
+{
+    assert(array2m != NULL);
+    return array2m->width;
+}
+
+int UArray2m_height(T array2m)
+{
+    assert(array2m != NULL);
+    return array2m->height;
+}
+
+int UArray2m_size(T array2m)
+{
+    assert(array2m != NULL);
+    return array2m->size;
+}
+
+int UArray2m_tilesize(T array2m)
+{
+    assert(array2m != NULL);
+    return 1 << array2m->shift;
+}
+
+/*
+ *  Function:  UArray2m_at
+ *  Arguments: UArray2m_T array2m - the array
+ *             int col, row - coordinates of a cell within the array
+ *  Does:      Finds a cell: its tile is found with shifts, and its offset
+ *             within the tile by interleaving the low bits of col and row.
+ *  Return:    void * - pointer to the cell
+ */
+void *UArray2m_at(T array2m, int col, int row)
+{
+    assert(array2m != NULL);
+    assert(col >= 0 && col < array2m->width);
+    assert(row >= 0 && row < array2m->height);
+    int s = array2m->shift;
+    size_t tile = (size_t)(row >> s) * array2m->xtiles + (col >> s);
+    uint32_t cell = interleave(array2m, col & array2m->mask,
+                               row & array2m->mask);
+    return array2m->cells + tile * array2m->tile_bytes +
+           (size_t)cell * array2m->size;
+}
+
+/*
+ *  Function:  UArray2m_map_morton
+ *  Arguments: UArray2m_T array2m - the array to map over
+ *             UArray2m_applyfun apply - called with each cell
+ *             void *cl - closure passed to apply
+ *  Does:      Visits every cell in storage order: tile by tile, row-major
+ *             over the tiles, and in Morton order within a tile. A pointer
+ *             walks the storage, and each cell's coordinates are recovered
+ *             by de-interleaving its offset. Padding cells are skipped.
+ *  Return:    void
+ */
+void UArray2m_map_morton(T array2m, UArray2m_applyfun apply, void *cl)
+{
+    assert(array2m != NULL && apply != NULL);
+    int s = array2m->shift;
+    uint32_t cells = 1u << (2 * s);
+    char *elem = array2m->cells;
+
+    for (int ty = 0; ty < array2m->ytiles; ty++) {
+        for (int tx = 0; tx < array2m->xtiles; tx++) {
+            int col0 = tx << s;
+            int row0 = ty << s;
+            for (uint32_t cell = 0; cell < cells; cell++) {
+                unsigned col, row;
+#ifdef CPUFEATURES_X86
+                if (array2m->bmi2) {
+                    deinterleave_bmi2(cell, &col, &row);
+                } else
+#endif
+                {
+                    row = gather_bits(cell);
+                    col = gather_bits(cell >> 1);
+                }
+                col += col0;
+                row += row0;
+                if ((int)col < array2m->width && (int)row < array2m->height) {
+                    apply(col, row, array2m, elem, cl);
+                }
+                elem += array2m->size;
+            }
+        }
+    }
+}
+
+/*
+ *  Function:  map_rows
+ *  Arguments: UArray2m_T array2m - the array to map over
+ *             UArray2m_applyfun apply - called with each cell
+ *             void *cl - closure passed to apply
+ *             bool row_major - visit rows (true) or columns (false) in turn
+ *  Does:      Visits every cell in row-major or column-major order.
+ *  Return:    void
+ */
+static void map_rows(T array2m, UArray2m_applyfun apply, void *cl,
+                     bool row_major)
+{
+    assert(array2m != NULL && apply != NULL);
+    int outer = row_major ? array2m->height : array2m->width;
+    int inner = row_major ? array2m->width : array2m->height;
+    for (int a = 0; a < outer; a++) {
+        for (int b = 0; b < inner; b++) {
+            int col = row_major ? b : a;
+            int row = row_major ? a : b;
+            apply(col, row, array2m, UArray2m_at(array2m, col, row), cl);
+        }
+    }
+}
+
+void UArray2m_map_row_major(T array2m, UArray2m_applyfun apply, void *cl)
+{
+    map_rows(array2m, apply, cl, true);
+}
+
+void UArray2m_map_col_major(T array2m, UArray2m_applyfun apply, void *cl)
+{
+    map_rows(array2m, apply, cl, false);
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+ *
+ *                                uarray2m.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for an unboxed 2D array whose cells are stored in Morton
+ *     (Z) order, so that cells that are close in both dimensions are close
+ *     in memory. (See the implementation file uarray2m.c for more
+ *     information)
+ *
+ *     Indices out of range and a NULL UArray2m_T are checked run-time
+ *     errors.
+ *
+ *****************************************************************************/
+
+#ifndef UARRAY2M_H
+#define UARRAY2M_H
+
+#define T UArray2m_T
+typedef struct T *T;
+
+typedef void UArray2m_applyfun(int col, int row, T array2m, void *elem,
+                               void *cl);
+
+/* tilesize is rounded up to a power of two; tilesize < 1 is a checked
+   run-time error */
+extern T    UArray2m_new     (int width, int height, int size, int tilesize);
+extern void UArray2m_free    (T *array2m);
+extern int  UArray2m_width   (T array2m);
+extern int  UArray2m_height  (T array2m);
+extern int  UArray2m_size    (T array2m);
+extern int  UArray2m_tilesize(T array2m);
+
+extern void *UArray2m_at(T array2m, int col, int row);
+
+/* visits cells in storage (Morton) order */
+extern void UArray2m_map_morton   (T array2m, UArray2m_applyfun apply,
+                                   void *cl);
+extern void UArray2m_map_row_major(T array2m, UArray2m_applyfun apply,
+                                   void *cl);
+extern void UArray2m_map_col_major(T array2m, UArray2m_applyfun apply,
+                                   void *cl);
+
+#undef T
+#endif
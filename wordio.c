@@ -0,0 +1,95 @@
+/******************************************************************************
+ *
+ *                                 wordio.c
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Implements the wordio.h interface. Words are moved with one fread or
+ *     fwrite per block rather than one getc or putchar per byte; on little
+ *     endian hosts each word is byte-swapped on the way in or out, and on
+ *     big endian hosts the words are already in file order.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+
+#include "wordio.h"
+
+/* Number of words converted and written per fwrite */
+#define WRITE_CHUNK 4096
+
+/* Static function declarations */
+static inline uint32_t to_big_endian(uint32_t word);
+
+/*
+ *  Function:  to_big_endian
+ *  Arguments: uint32_t word - a word in host byte order (or in big endian
+ *                             order, since the conversion is its own
+ *                             inverse)
+ *  Does:      Converts between host and big endian byte order.
+ *  Return:    uint32_t - the converted word
+ */
+static inline uint32_t to_big_endian(uint32_t word)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return word;
+#elif defined(__GNUC__)
+    return __builtin_bswap32(word);
+#else
+    unsigned char bytes[4] = { word >> 24, word >> 16, word >> 8, word };
+    uint32_t swapped;
+    memcpy(&swapped, bytes, sizeof(swapped));
+    return swapped;
+#endif
+}
+
+/*
+ *  Function:  write_words
+ *  Arguments: FILE *output - the file to write to
+ *             const uint32_t *words - the words to be written
+ *             size_t count - the number of words
+ *  Does:      Writes the words to output in big endian order, converting
+ *             them a chunk at a time into a local buffer.
+ *  Return:    void
+ */
+void write_words(FILE *output, const uint32_t *words, size_t count)
+{
+    assert(output != NULL && (words != NULL || count == 0));
+    uint32_t chunk[WRITE_CHUNK];
+
+    while (count > 0) {
+        size_t n = count < WRITE_CHUNK ? count : WRITE_CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = to_big_endian(words[i]);
+        }
+        fwrite(chunk, sizeof(uint32_t), n, output);
+        words += n;
+        count -= n;
+    }
+}
+
+/*
+ *  Function:  read_words
+ *  Arguments: FILE *input - the file to read from
+ *             uint32_t *words - an array of at least count words to be
+ *                               filled in
+ *             size_t count - the number of words to read
+ *  Does:      Reads up to count big endian words from input in one fread
+ *             and converts them to host order in place.
+ *  Return:    size_t - the number of complete words read, which is less
+ *                      than count only if input ended early
+ */
+size_t read_words(FILE *input, uint32_t *words, size_t count)
+{
+    assert(input != NULL && (words != NULL || count == 0));
+    size_t n = fread(words, sizeof(uint32_t), count, input);
+    for (size_t i = 0; i < n; i++) {
+        words[i] = to_big_endian(words[i]);
+    }
+    return n;
+}
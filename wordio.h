@@ -0,0 +1,49 @@
+/******************************************************************************
+ *
+ *                                 wordio.h
+ *
+ *     Assignment: arith
+ *     Authors:    Ryan Beckwith and Adam Peters
+ *     Date:       10/27/2020
+ *
+ *     Interface for reading and writing arrays of 32-bit words in the big
+ *     endian byte order of the compressed image format, in bulk. (See the
+ *     implementation file wordio.c for more information)
+ *
+ *     load_word reads one word of a row held in memory, either as native
+ *     uint32_ts or as the big endian bytes of the file format.
+ *
+ *****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef WORDIO_H
+#define WORDIO_H
+
+extern void   write_words(FILE *output, const uint32_t *words, size_t count);
+extern size_t read_words (FILE *input, uint32_t *words, size_t count);
+
+/*
+ *  Function:  load_word
+ *  Arguments: const void *words - a row of words
+ *             size_t col - index of the word to load
+ *             bool big_endian - whether the row holds big endian bytes
+ *                               rather than native uint32_ts
+ *  Does:      Loads one word of a row.
+ *  Return:    uint32_t - the word
+ */
+static inline uint32_t load_word(const void *words, size_t col,
+                                 bool big_endian)
+{
+    if (!big_endian) {
+        return ((const uint32_t *)words)[col];
+    }
+    const unsigned char *bytes = (const unsigned char *)words + 4 * col;
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+           (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+#endif